@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * convert a list of standard MIDI files: each file is imported, a
+ * user procedure is called to transform the song (filters, channel
+ * maps, quantization, ...), then the result is exported in the
+ * output directory under the same name.
+ *
+ * the interpreter and the song are global, so files are processed in
+ * worker processes, each with its own copy of the state. Files are
+ * dealt to workers in turn, and results are sent back to the parent
+ * through a pipe per worker.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "utils.h"
+#include "defs.h"
+#include "cons.h"
+#include "data.h"
+#include "exec.h"
+#include "node.h"
+#include "song.h"
+#include "smf.h"
+#include "str.h"
+#include "user.h"
+#include "trace.h"
+#include "batch.h"
+
+/*
+ * result of the conversion of a file, as sent by workers
+ */
+struct batch_rec {
+	unsigned idx;			/* file number */
+	unsigned ok;			/* true if succeeded */
+	unsigned long usec;		/* time spent */
+};
+
+struct batch {
+	struct exec *exec;		/* interpreter */
+	struct proc *proc;		/* transform, or NULL */
+	char *outdir;			/* output directory */
+	char **files;			/* input files */
+	unsigned nfiles;
+	struct batch_rec *res;		/* result of each file */
+	unsigned njobs;			/* number of workers */
+};
+
+/*
+ * call the given procedure, without arguments
+ */
+unsigned
+batch_call(struct exec *x, struct proc *p)
+{
+	struct name **oldlocals, *newlocals;
+	struct data *r;
+	char *procname_save;
+	unsigned result;
+
+	newlocals = NULL;
+	r = NULL;
+	oldlocals = x->locals;
+	x->locals = &newlocals;
+	procname_save = x->procname;
+	x->procname = p->name.str;
+	result = node_exec(p->code, x, &r);
+	x->locals = oldlocals;
+	x->procname = procname_save;
+	var_empty(&newlocals);
+	if (r)
+		data_delete(r);
+	return result != RESULT_ERR;
+}
+
+/*
+ * convert the given file, return 0 on failure
+ */
+unsigned
+batch_file(struct batch *b, char *path)
+{
+	struct song *save;
+	char *base, *outpath;
+	unsigned ok;
+	size_t len;
+
+	base = strrchr(path, '/');
+	base = (base != NULL) ? base + 1 : path;
+	len = strlen(b->outdir) + strlen(base) + 2;
+	outpath = xmalloc(len, "batch");
+	snprintf(outpath, len, "%s/%s", b->outdir, base);
+	if (str_eq(outpath, path)) {
+		cons_err("output file is the input file");
+		xfree(outpath);
+		return 0;
+	}
+	save = usong;
+	usong = song_importsmf(path);
+	if (usong == NULL) {
+		usong = save;
+		xfree(outpath);
+		return 0;
+	}
+	ok = (b->proc == NULL || batch_call(b->exec, b->proc)) &&
+	    song_exportsmf(usong, outpath);
+	song_delete(usong);
+	usong = save;
+	xfree(outpath);
+	return ok;
+}
+
+/*
+ * convert every njobs-th file starting at the given one and send
+ * results to the given file descriptor, or store them if it's -1
+ */
+void
+batch_work(void *arg, unsigned id, int fd)
+{
+	struct batch *b = arg;
+	struct batch_rec rec;
+	unsigned long start;
+	unsigned i;
+
+	for (i = id; i < b->nfiles; i += b->njobs) {
+		start = trace_mdep_gettime();
+		rec.idx = i;
+		rec.ok = batch_file(b, b->files[i]);
+		rec.usec = trace_mdep_gettime() - start;
+		if (!rec.ok)
+			cons_errs(b->files[i], "conversion failed");
+		if (fd < 0)
+			b->res[i] = rec;
+		else if (!batch_mdep_write(fd, &rec, sizeof(struct batch_rec)))
+			break;
+	}
+}
+
+/*
+ * convert the given list of files (or all files of the given
+ * directory) using 'njobs' worker processes, and return the list of
+ * {file status usec} triplets
+ */
+struct data *
+batch_run(struct exec *x, struct data *files, char *outdir,
+    struct proc *proc, unsigned njobs)
+{
+	struct batch b;
+	struct batch_rec rec;
+	struct data *d, *list, *item;
+	unsigned char *data[BATCH_MAXJOBS], *q;
+	unsigned len[BATCH_MAXJOBS], i, n;
+
+	if (files->type == DATA_STRING) {
+		files = batch_mdep_dir(files->val.str);
+		if (files == NULL)
+			return NULL;
+	} else {
+		d = data_newnil();
+		data_assign(d, files);
+		files = d;
+	}
+	b.exec = x;
+	b.proc = proc;
+	b.outdir = outdir;
+	b.nfiles = 0;
+	for (d = files->val.list; d != NULL; d = d->next) {
+		if (d->type != DATA_STRING) {
+			cons_err("file names must be strings");
+			data_delete(files);
+			return NULL;
+		}
+		b.nfiles++;
+	}
+	b.files = xmalloc((b.nfiles + 1) * sizeof(char *), "batch");
+	b.res = xmalloc((b.nfiles + 1) * sizeof(struct batch_rec), "batch");
+	for (i = 0, d = files->val.list; d != NULL; i++, d = d->next) {
+		b.files[i] = d->val.str;
+		b.res[i].ok = 0;
+		b.res[i].usec = 0;
+	}
+	b.njobs = (njobs < b.nfiles) ? njobs : b.nfiles;
+	if (b.njobs <= 1) {
+		b.njobs = 1;
+		batch_work(&b, 0, -1);
+	} else {
+		if (batch_mdep_run(b.njobs, batch_work, &b, data, len)) {
+			for (i = 0; i < b.njobs; i++) {
+				q = data[i];
+				for (n = len[i]; n >= sizeof(struct batch_rec);
+				     n -= sizeof(struct batch_rec)) {
+					memcpy(&rec, q, sizeof(struct batch_rec));
+					if (rec.idx < b.nfiles)
+						b.res[rec.idx] = rec;
+					q += sizeof(struct batch_rec);
+				}
+				xfree(data[i]);
+			}
+		}
+	}
+	list = data_newlist(NULL);
+	for (i = 0; i < b.nfiles; i++) {
+		item = data_newlist(NULL);
+		data_listadd(item, data_newstring(b.files[i]));
+		data_listadd(item, data_newref(b.res[i].ok ? "ok" : "failed"));
+		data_listadd(item, data_newlong(b.res[i].usec));
+		data_listadd(list, item);
+	}
+	xfree(b.res);
+	xfree(b.files);
+	data_delete(files);
+	return list;
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef MIDISH_BATCH_H
+#define MIDISH_BATCH_H
+
+#define BATCH_MAXJOBS	64		/* max worker processes */
+
+struct exec;
+struct proc;
+struct data;
+
+struct data *batch_run(struct exec *, struct data *, char *,
+    struct proc *, unsigned);
+
+struct data *batch_mdep_dir(char *);
+unsigned batch_mdep_ncpu(void);
+unsigned batch_mdep_run(unsigned, void (*)(void *, unsigned, int), void *,
+    unsigned char **, unsigned *);
+unsigned batch_mdep_write(int, void *, unsigned);
+
+#endif /* MIDISH_BATCH_H */
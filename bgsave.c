@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * background saves: the file is written by a child process, created
+ * with fork(), so it works on a copy of the song as it was when the
+ * save started. Memory pages are shared until either process modifies
+ * them, so starting the save is cheap, and the user may continue to
+ * edit or to play the song while the file is written. Once the child
+ * exits, the mux loop calls bgsave_wait(), which reports the result.
+ *
+ * only one save runs at a time. Commands reading or writing song
+ * files wait for it to complete first, so they never see a partial
+ * file and files are written in the order of the commands.
+ */
+#include "utils.h"
+#include "cons.h"
+#include "str.h"
+#include "journal.h"
+#include "bgsave.h"
+
+struct bgsave {
+	struct song *song;		/* song to save (child's copy) */
+	char *func;			/* command that started the save */
+	char *path;			/* file being written */
+	unsigned (*save)(struct song *, char *);
+	unsigned cut;			/* cut the journal once saved */
+};
+
+struct bgsave *bgsave = NULL;
+
+unsigned bgsave_work(void *);
+
+/*
+ * routine run by the child process
+ */
+unsigned
+bgsave_work(void *arg)
+{
+	struct bgsave *b = arg;
+
+	return b->save(b->song, b->path);
+}
+
+/*
+ * start saving the given song in the given file with the given
+ * routine. If the song file is the base of the journal, then 'cut' is
+ * set and the journal is cut once the file is written
+ */
+unsigned
+bgsave_start(struct song *s, char *func, char *path,
+    unsigned (*save)(struct song *, char *), unsigned cut)
+{
+	struct bgsave *b;
+
+	bgsave_wait();
+	b = xmalloc(sizeof(struct bgsave), "bgsave");
+	b->song = s;
+	b->func = str_new(func);
+	b->path = str_new(path);
+	b->save = save;
+	b->cut = cut;
+	if (!bgsave_mdep_start(bgsave_work, b)) {
+		str_delete(b->func);
+		str_delete(b->path);
+		xfree(b);
+		return 0;
+	}
+	if (cut)
+		journal_mark();
+	bgsave = b;
+	return 1;
+}
+
+/*
+ * wait for the running save to complete, if any, and report its result
+ */
+void
+bgsave_wait(void)
+{
+	struct bgsave *b = bgsave;
+
+	if (b == NULL)
+		return;
+	bgsave = NULL;
+	if (bgsave_mdep_wait()) {
+		if (b->cut)
+			journal_cut();
+		cons_errss(b->func, b->path, "saved");
+	} else
+		cons_errss(b->func, b->path, "failed to save");
+	str_delete(b->func);
+	str_delete(b->path);
+	xfree(b);
+}
@@ -33,6 +33,14 @@
 #include "builtin.h"
 #include "version.h"
 #include "undo.h"
+#include "trace.h"
+#include "render.h"
+#include "probe.h"
+#include "stream.h"
+#include "batch.h"
+#include "songbin.h"
+#include "journal.h"
+#include "bgsave.h"
 
 unsigned
 blt_info(struct exec *o, struct data **r)
@@ -116,6 +124,32 @@ blt_builtinlist(struct exec *o, struct data **r)
 	return 1;
 }
 
+unsigned
+blt_trace(struct exec *o, struct data **r)
+{
+	long value;
+
+	if (!exec_lookuplong(o, "value", &value)) {
+		return 0;
+	}
+	if (value)
+		trace_start();
+	else
+		trace_stop();
+	return 1;
+}
+
+unsigned
+blt_tracesave(struct exec *o, struct data **r)
+{
+	char *filename;
+
+	if (!exec_lookupstring(o, "filename", &filename)) {
+		return 0;
+	}
+	return trace_save(filename);
+}
+
 unsigned
 blt_version(struct exec *o, struct data **r)
 {
@@ -136,7 +170,7 @@ blt_debug(struct exec *o, struct data **r)
 {
 	extern unsigned filt_debug, mididev_debug, mux_debug, mixout_debug,
 	    norm_debug, pool_debug, song_debug,
-	    timo_debug;
+	    thru_debug, timo_debug;
 	char *flag;
 	long value;
 
@@ -158,6 +192,8 @@ blt_debug(struct exec *o, struct data **r)
 		pool_debug = value;
 	} else if (str_eq(flag, "song")) {
 		song_debug = value;
+	} else if (str_eq(flag, "thru")) {
+		thru_debug = value;
 	} else if (str_eq(flag, "timo")) {
 		timo_debug = value;
 	} else {
@@ -897,11 +933,77 @@ blt_save(struct exec *o, struct data **r)
 	if (!exec_lookupstring(o, "filename", &filename)) {
 		return 0;
 	}
+	bgsave_wait();
+	song_stop(usong);
+	if (song_save(usong, filename))
+		journal_restart(usong);
+	return 1;
+}
+
+unsigned
+blt_bgsave(struct exec *o, struct data **r)
+{
+	char *filename;
+
+	if (!exec_lookupstring(o, "filename", &filename)) {
+		return 0;
+	}
+	return bgsave_start(usong, o->procname, filename, song_save, 1);
+}
+
+unsigned
+blt_bsave(struct exec *o, struct data **r)
+{
+	char *filename;
+
+	if (!exec_lookupstring(o, "filename", &filename)) {
+		return 0;
+	}
+	bgsave_wait();
 	song_stop(usong);
-	song_save(usong, filename);
+	if (!songbin_save(usong, filename))
+		return 0;
+	journal_restart(usong);
 	return 1;
 }
 
+unsigned
+blt_journal(struct exec *o, struct data **r)
+{
+	char *filename;
+
+	if (!exec_lookupstring(o, "filename", &filename)) {
+		return 0;
+	}
+	bgsave_wait();
+	return journal_start(usong, filename);
+}
+
+unsigned
+blt_nojournal(struct exec *o, struct data **r)
+{
+	journal_stop();
+	return 1;
+}
+
+unsigned
+blt_jreplay(struct exec *o, struct data **r)
+{
+	char *filename;
+
+	if (!exec_lookupstring(o, "filename", &filename)) {
+		return 0;
+	}
+	if (journal_isopen()) {
+		cons_errs(o->procname, "stop journaling first");
+		return 0;
+	}
+	bgsave_wait();
+	song_stop(usong);
+	undo_clear(usong, &usong->undo);
+	return journal_replay(usong, filename);
+}
+
 unsigned
 blt_load(struct exec *o, struct data **r)
 {
@@ -912,6 +1014,7 @@ blt_load(struct exec *o, struct data **r)
 	if (!exec_lookupstring(o, "filename", &filename)) {
 		return 0;
 	}
+	bgsave_wait();
 	song_stop(usong);
 	newsong = song_new();
 	res = song_load(newsong, filename);
@@ -919,6 +1022,7 @@ blt_load(struct exec *o, struct data **r)
 		song_delete(usong);
 		usong = newsong;
 		cons_putpos(usong->curpos, 0, 0);
+		journal_restart(usong);
 	} else
 		song_delete(newsong);
 	return res;
@@ -932,6 +1036,7 @@ blt_reset(struct exec *o, struct data **r)
 	evpat_reset();
 	song_init(usong);
 	cons_putpos(usong->curpos, 0, 0);
+	journal_restart(usong);
 	return 1;
 }
 
@@ -943,10 +1048,44 @@ blt_export(struct exec *o, struct data **r)
 	if (!exec_lookupstring(o, "filename", &filename)) {
 		return 0;
 	}
+	bgsave_wait();
 	song_stop(usong);
 	return song_exportsmf(usong, filename);
 }
 
+unsigned
+blt_bgexport(struct exec *o, struct data **r)
+{
+	char *filename;
+
+	if (!exec_lookupstring(o, "filename", &filename)) {
+		return 0;
+	}
+	return bgsave_start(usong, o->procname, filename, song_exportsmf, 0);
+}
+
+unsigned
+blt_render(struct exec *o, struct data **r)
+{
+	char *filename;
+
+	if (!exec_lookupstring(o, "filename", &filename)) {
+		return 0;
+	}
+	if (!song_try_mode(usong, 0)) {
+		return 0;
+	}
+	if (mididev_clksrc || mididev_mtcsrc) {
+		cons_errs(o->procname, "can't render with external clock");
+		return 0;
+	}
+	if (usong->tap_mode || usong->loop) {
+		cons_errs(o->procname, "can't render in tap or loop mode");
+		return 0;
+	}
+	return song_render(usong, filename);
+}
+
 unsigned
 blt_import(struct exec *o, struct data **r)
 {
@@ -956,6 +1095,7 @@ blt_import(struct exec *o, struct data **r)
 	if (!exec_lookupstring(o, "filename", &filename)) {
 		return 0;
 	}
+	bgsave_wait();
 	song_stop(usong);
 	sng = song_importsmf(filename);
 	if (sng == NULL) {
@@ -964,9 +1104,86 @@ blt_import(struct exec *o, struct data **r)
 	song_delete(usong);
 	usong = sng;
 	cons_putpos(usong->curpos, 0, 0);
+	journal_restart(usong);
 	return 1;
 }
 
+unsigned
+blt_splay(struct exec *o, struct data **r)
+{
+	char *filename;
+	long measure;
+
+	if (!song_try_mode(usong, 0)) {
+		return 0;
+	}
+	if (!exec_lookupstring(o, "filename", &filename) ||
+	    !exec_lookuplong(o, "measure", &measure)) {
+		return 0;
+	}
+	if (measure < 0) {
+		cons_errs(o->procname, "measure must be positive");
+		return 0;
+	}
+	return stream_play(usong, filename, measure);
+}
+
+unsigned
+blt_smfconv(struct exec *o, struct data **r)
+{
+	struct var *files, *arg;
+	struct proc *proc;
+	char *outdir;
+	long jobs;
+
+	if (!song_try_mode(usong, 0)) {
+		return 0;
+	}
+	files = exec_varlookup(o, "files");
+	if (!files) {
+		log_puts("blt_smfconv: files: no such param\n");
+		return 0;
+	}
+	if (files->data->type != DATA_STRING &&
+	    files->data->type != DATA_LIST) {
+		cons_errs(o->procname, "files must be a directory or a list");
+		return 0;
+	}
+	if (!exec_lookupstring(o, "outdir", &outdir) ||
+	    !exec_lookuplong(o, "jobs", &jobs)) {
+		return 0;
+	}
+	arg = exec_varlookup(o, "proc");
+	if (!arg) {
+		log_puts("blt_smfconv: proc: no such param\n");
+		return 0;
+	}
+	if (arg->data->type == DATA_NIL) {
+		proc = NULL;
+	} else if (arg->data->type == DATA_REF) {
+		proc = exec_proclookup(o, arg->data->val.ref);
+		if (proc == NULL) {
+			cons_errss(o->procname, arg->data->val.ref,
+			    "no such proc");
+			return 0;
+		}
+		if (proc->args != NULL) {
+			cons_errss(o->procname, arg->data->val.ref,
+			    "proc must take no arguments");
+			return 0;
+		}
+	} else {
+		cons_errs(o->procname, "proc must be a name or nil");
+		return 0;
+	}
+	if (jobs < 1 || jobs > BATCH_MAXJOBS) {
+		cons_errs(o->procname, "jobs must be in the 1..64 range");
+		return 0;
+	}
+	*r = batch_run(o, files->data, outdir, proc, jobs);
+	return *r != NULL;
+}
+
 unsigned
 blt_idle(struct exec *o, struct data **r)
 {
@@ -1765,6 +1982,7 @@ blt_taddev(struct exec *o, struct data **r)
 	}
 	undo_track_save(usong, &t->track, o->procname, t->name.str);
 	pos += beat * tpb + tic;
+	track_uncache(&t->track);
 	tp = seqptr_new(&t->track);
 	seqptr_seek(tp, pos);
 	seqptr_evput(tp, &ev);
@@ -2008,7 +2226,14 @@ blt_tcopy(struct exec *o, struct data **r)
 		len -= qstep;
 	}
 	track_clear(&usong->clip);
+
+	/*
+	 * copying may add events to the source track to restore the
+	 * state of the frames it cuts, so record the change
+	 */
+	undo_track_save(usong, &t->track, o->procname, t->name.str);
 	track_move(&t->track, tic, len, &usong->curev, &usong->clip, 1, 0);
+	undo_track_diff(usong);
 	track_shift(&usong->clip, tic2);
 	return 1;
 }
@@ -2026,10 +2251,10 @@ blt_tmerge(struct exec *o, struct data **r)
 		cons_errs(o->procname, "no current track");
 		return 0;
 	}
-	if (!song_try_trk(usong, dst)) {
+	if (!song_try_trk(usong, src)) {
 		return 0;
 	}
-	undo_track_save(usong, &dst->track, o->procname, dst->name.str);
+	undo_track_save(usong, &src->track, o->procname, src->name.str);
 	track_merge(&src->track, &dst->track);
 	undo_track_diff(usong);
 	return 1;
@@ -3481,7 +3706,10 @@ blt_dnew(struct exec *o, struct data **r)
 		    "bad mode (allowed: ro, wo, rw)");
 		return 0;
 	}
-	return mididev_attach(unit, path, mode);
+	if (!mididev_attach(unit, path, mode))
+		return 0;
+	norm_devinit(unit);
+	return 1;
 }
 
 unsigned
@@ -3654,6 +3882,8 @@ unsigned
 blt_dinfo(struct exec *o, struct data **r)
 {
 	struct mididev *dev;
+	struct mididev_stat rate;
+	struct norm_bucket *b;
 	long unit;
 	int i, more;
 
@@ -3732,11 +3962,398 @@ blt_dinfo(struct exec *o, struct data **r)
 	textout_putlong(tout, mididev_byunit[unit]->ticrate);
 	textout_putstr(tout, "\n");
 
+	if (dev->obitrate) {
+		textout_putstr(tout, "bitrate ");
+		textout_putlong(tout, dev->obitrate);
+		textout_putstr(tout, "\n");
+		textout_putstr(tout, "# queue delay: avg ");
+		textout_putlong(tout, dev->odelay_cnt == 0 ? 0 :
+		    dev->odelay_sum / dev->odelay_cnt / 24);
+		textout_putstr(tout, "us, max ");
+		textout_putlong(tout, dev->odelay_max / 24);
+		textout_putstr(tout, "us\n");
+		textout_putstr(tout, "# deferred: ");
+		textout_putlong(tout, dev->odeferred);
+		textout_putstr(tout, ", merged: ");
+		textout_putlong(tout, dev->omerged);
+		textout_putstr(tout, "\n");
+	}
+
+	mididev_getrate(dev, &rate);
+	textout_putstr(tout, "# in: ");
+	textout_putlong(tout, dev->stat.ibytes);
+	textout_putstr(tout, " bytes, ");
+	textout_putlong(tout, dev->stat.iev);
+	textout_putstr(tout, " events, ");
+	textout_putlong(tout, dev->stat.isysex);
+	textout_putstr(tout, " sysex, ");
+	textout_putlong(tout, dev->stat.ierr);
+	textout_putstr(tout, " errors\n");
+	textout_putstr(tout, "# out: ");
+	textout_putlong(tout, dev->stat.obytes);
+	textout_putstr(tout, " bytes, ");
+	textout_putlong(tout, dev->stat.oev);
+	textout_putstr(tout, " events, ");
+	textout_putlong(tout, dev->stat.osysex);
+	textout_putstr(tout, " sysex, ");
+	textout_putlong(tout, dev->stat.nflush);
+	textout_putstr(tout, " writes, ");
+	textout_putlong(tout, dev->stat.nshort);
+	textout_putstr(tout, " short\n");
+	textout_putstr(tout, "# rate: in ");
+	textout_putlong(tout, rate.ibytes);
+	textout_putstr(tout, " bytes/s, ");
+	textout_putlong(tout, rate.iev);
+	textout_putstr(tout, " events/s, out ");
+	textout_putlong(tout, rate.obytes);
+	textout_putstr(tout, " bytes/s, ");
+	textout_putlong(tout, rate.oev);
+	textout_putstr(tout, " events/s\n");
+
+	for (i = 0; i < NORM_NCLASS; i++) {
+		b = &norm_dbucket[unit][i];
+		textout_putstr(tout, "dirate ");
+		textout_putstr(tout, norm_classname[i]);
+		textout_putstr(tout, " ");
+		textout_putlong(tout, b->rate);
+		if (b->nthrot > 0) {
+			textout_putstr(tout, "\t\t# throttled: ");
+			textout_putlong(tout, b->nthrot);
+		}
+		textout_putstr(tout, "\n");
+	}
+
 	textout_shiftleft(tout);
 	textout_putstr(tout, "}\n");
 	return 1;
 }
 
+/*
+ * append a {name value} pair to the given list
+ */
+void
+blt_addstat(struct data *list, char *name, unsigned long val)
+{
+	struct data *d;
+
+	d = data_newlist(NULL);
+	data_listadd(d, data_newref(name));
+	data_listadd(d, data_newlong(val));
+	data_listadd(list, d);
+}
+
+/*
+ * return the summary of a standard MIDI file as a list of
+ * {name value} pairs
+ */
+struct data *
+blt_smfstats(struct stream_stats *st)
+{
+	struct data *list, *chans, *d;
+	unsigned i;
+
+	list = data_newlist(NULL);
+	blt_addstat(list, "format", st->format);
+	blt_addstat(list, "tracks", st->ntrks);
+	blt_addstat(list, "tpq", st->tpq);
+	blt_addstat(list, "tics", st->tics);
+	blt_addstat(list, "msec", st->usec24 / 24000);
+	blt_addstat(list, "notes", st->nnote);
+	blt_addstat(list, "kat", st->nkat);
+	blt_addstat(list, "ctl", st->nctl);
+	blt_addstat(list, "pc", st->npc);
+	blt_addstat(list, "cat", st->ncat);
+	blt_addstat(list, "bend", st->nbend);
+	blt_addstat(list, "sysex", st->nsx);
+	blt_addstat(list, "tempo", st->ntempo);
+	if (st->ntempo > 0) {
+		blt_addstat(list, "tempomin", st->tempo_min);
+		blt_addstat(list, "tempomax", st->tempo_max);
+	}
+	blt_addstat(list, "sig", st->nsig);
+	blt_addstat(list, "meta", st->nmeta);
+	blt_addstat(list, "bad", st->nbad);
+	chans = data_newlist(NULL);
+	for (i = 0; i < 16; i++) {
+		if (st->chans & (1 << i))
+			data_listadd(chans, data_newlong(i));
+	}
+	d = data_newlist(NULL);
+	data_listadd(d, data_newref("chans"));
+	data_listadd(d, chans);
+	data_listadd(list, d);
+	return list;
+}
+
+unsigned
+blt_smfinfo(struct exec *o, struct data **r)
+{
+	struct stream_stats st;
+	char *filename;
+
+	if (!exec_lookupstring(o, "filename", &filename)) {
+		return 0;
+	}
+	if (!stream_scan(filename, &st)) {
+		return 0;
+	}
+	*r = blt_smfstats(&st);
+	return 1;
+}
+
+unsigned
+blt_smfscan(struct exec *o, struct data **r)
+{
+	struct stream_stats st;
+	struct var *arg;
+	struct data *files, *d, *item;
+
+	arg = exec_varlookup(o, "files");
+	if (!arg) {
+		log_puts("blt_smfscan: files: no such param\n");
+		return 0;
+	}
+	if (arg->data->type == DATA_STRING) {
+		files = batch_mdep_dir(arg->data->val.str);
+		if (files == NULL)
+			return 0;
+	} else if (arg->data->type == DATA_LIST) {
+		files = data_newnil();
+		data_assign(files, arg->data);
+	} else {
+		cons_errs(o->procname, "files must be a directory or a list");
+		return 0;
+	}
+	*r = data_newlist(NULL);
+	for (d = files->val.list; d != NULL; d = d->next) {
+		if (d->type != DATA_STRING) {
+			cons_errs(o->procname, "file names must be strings");
+			data_delete(files);
+			return 0;
+		}
+		item = data_newlist(NULL);
+		data_listadd(item, data_newstring(d->val.str));
+		if (stream_scan(d->val.str, &st)) {
+			data_listadd(item, blt_smfstats(&st));
+		} else {
+			cons_errs(d->val.str, "couldn't scan file");
+			data_listadd(item, data_newnil());
+		}
+		data_listadd(*r, item);
+	}
+	data_delete(files);
+	return 1;
+}
+
+unsigned
+blt_dstat(struct exec *o, struct data **r)
+{
+	struct mididev *dev;
+	struct mididev_stat rate;
+	long unit;
+
+	if (!exec_lookuplong(o, "devnum", &unit)) {
+		return 0;
+	}
+	if (unit < 0 || unit >= DEFAULT_MAXNDEVS || !mididev_byunit[unit]) {
+		cons_errs(o->procname, "bad device number");
+		return 0;
+	}
+	dev = mididev_byunit[unit];
+	mididev_getrate(dev, &rate);
+	*r = data_newlist(NULL);
+	blt_addstat(*r, "ibytes", dev->stat.ibytes);
+	blt_addstat(*r, "iev", dev->stat.iev);
+	blt_addstat(*r, "isysex", dev->stat.isysex);
+	blt_addstat(*r, "ierr", dev->stat.ierr);
+	blt_addstat(*r, "obytes", dev->stat.obytes);
+	blt_addstat(*r, "oev", dev->stat.oev);
+	blt_addstat(*r, "osysex", dev->stat.osysex);
+	blt_addstat(*r, "nflush", dev->stat.nflush);
+	blt_addstat(*r, "nshort", dev->stat.nshort);
+	blt_addstat(*r, "ibytes_rate", rate.ibytes);
+	blt_addstat(*r, "iev_rate", rate.iev);
+	blt_addstat(*r, "obytes_rate", rate.obytes);
+	blt_addstat(*r, "oev_rate", rate.oev);
+	return 1;
+}
+
+unsigned
+blt_dlatency(struct exec *o, struct data **r)
+{
+	struct probe_res res;
+	long odev, idev, count;
+	char *pathname;
+	unsigned path;
+
+	if (!song_try_mode(usong, 0)) {
+		return 0;
+	}
+	if (!exec_lookuplong(o, "outdev", &odev) ||
+	    !exec_lookuplong(o, "indev", &idev) ||
+	    !exec_lookuplong(o, "count", &count) ||
+	    !exec_lookupname(o, "path", &pathname)) {
+		return 0;
+	}
+	if (odev < 0 || odev >= DEFAULT_MAXNDEVS || !mididev_byunit[odev] ||
+	    !(mididev_byunit[odev]->mode & MIDIDEV_MODE_OUT)) {
+		cons_errs(o->procname, "bad output device number");
+		return 0;
+	}
+	if (idev < 0 || idev >= DEFAULT_MAXNDEVS || !mididev_byunit[idev] ||
+	    !(mididev_byunit[idev]->mode & MIDIDEV_MODE_IN)) {
+		cons_errs(o->procname, "bad input device number");
+		return 0;
+	}
+	if (count <= 0 || count > PROBE_MAXN) {
+		cons_errs(o->procname, "count must be in the 1..10000 range");
+		return 0;
+	}
+	if (str_eq(pathname, "dev")) {
+		path = PROBE_DEV;
+	} else if (str_eq(pathname, "song")) {
+		path = PROBE_SONG;
+	} else if (str_eq(pathname, "thru")) {
+		path = PROBE_THRU;
+	} else {
+		cons_errss(o->procname, pathname,
+		    "bad path (allowed: dev, song, thru)");
+		return 0;
+	}
+	if (!probe_run(usong, path, odev, idev, count, &res))
+		cons_errs(o->procname, "interrupted");
+	*r = data_newlist(NULL);
+	blt_addstat(*r, "sent", res.nsent);
+	blt_addstat(*r, "lost", res.nlost);
+	blt_addstat(*r, "min", res.min);
+	blt_addstat(*r, "median", res.med);
+	blt_addstat(*r, "p99", res.p99);
+	blt_addstat(*r, "max", res.max);
+	blt_addstat(*r, "jitter", res.jitter);
+	return 1;
+}
+
+unsigned
+blt_dcapture(struct exec *o, struct data **r)
+{
+	struct var *arg;
+	char *path;
+	long unit;
+
+	if (!exec_lookuplong(o, "devnum", &unit)) {
+		return 0;
+	}
+	if (unit < 0 || unit >= DEFAULT_MAXNDEVS || !mididev_byunit[unit]) {
+		cons_errs(o->procname, "bad device number");
+		return 0;
+	}
+	if (!(mididev_byunit[unit]->mode & MIDIDEV_MODE_IN)) {
+		cons_errs(o->procname, "device is not in input mode");
+		return 0;
+	}
+	arg = exec_varlookup(o, "path");
+	if (!arg) {
+		log_puts("blt_dcapture: path: no such param\n");
+		return 0;
+	}
+	if (arg->data->type == DATA_NIL) {
+		path = NULL;
+	} else if (arg->data->type == DATA_STRING) {
+		path = arg->data->val.str;
+	} else {
+		cons_errs(o->procname, "path must be string or nil");
+		return 0;
+	}
+	if (!mididev_capture(mididev_byunit[unit], path)) {
+		cons_errs(o->procname, "couldn't create capture file");
+		return 0;
+	}
+	return 1;
+}
+
+unsigned
+blt_dbitrate(struct exec *o, struct data **r)
+{
+	long unit, bitrate;
+
+	if (!song_try_mode(usong, 0)) {
+		return 0;
+	}
+	if (!exec_lookuplong(o, "devnum", &unit) ||
+	    !exec_lookuplong(o, "bitrate", &bitrate)) {
+		return 0;
+	}
+	if (unit < 0 || unit >= DEFAULT_MAXNDEVS || !mididev_byunit[unit]) {
+		cons_errs(o->procname, "bad device number");
+		return 0;
+	}
+	if (bitrate < 0 || bitrate > 10000000) {
+		cons_errs(o->procname, "bitrate must be in the 0..10000000 range");
+		return 0;
+	}
+	mididev_byunit[unit]->obitrate = bitrate;
+	return 1;
+}
+
+unsigned
+blt_dirate(struct exec *o, struct data **r)
+{
+	long unit, rate;
+	char *name;
+	unsigned c;
+
+	if (!exec_lookuplong(o, "devnum", &unit) ||
+	    !exec_lookupname(o, "class", &name) ||
+	    !exec_lookuplong(o, "rate", &rate)) {
+		return 0;
+	}
+	if (unit < 0 || unit >= DEFAULT_MAXNDEVS || !mididev_byunit[unit]) {
+		cons_errs(o->procname, "bad device number");
+		return 0;
+	}
+	if (!norm_str2class(name, &c)) {
+		cons_errss(o->procname, name,
+		    "bad class (allowed: kat, ctl, pc, cat, bend, sx)");
+		return 0;
+	}
+	if (rate < 0 || rate > 100000) {
+		cons_errs(o->procname, "rate must be in the 0..100000 range");
+		return 0;
+	}
+	norm_setrate(&norm_dbucket[unit][c], rate);
+	return 1;
+}
+
+unsigned
+blt_irate(struct exec *o, struct data **r)
+{
+	long rate;
+
+	if (!exec_lookuplong(o, "rate", &rate)) {
+		return 0;
+	}
+	if (rate < 0 || rate > 100000) {
+		cons_errs(o->procname, "rate must be in the 0..100000 range");
+		return 0;
+	}
+	norm_setrate(&norm_ibucket, rate);
+	return 1;
+}
+
+unsigned
+blt_getirate(struct exec *o, struct data **r)
+{
+	*r = data_newlong(norm_ibucket.rate);
+	return 1;
+}
+
+unsigned
+blt_getithrot(struct exec *o, struct data **r)
+{
+	*r = data_newlong(norm_ibucket.nthrot);
+	return 1;
+}
+
 unsigned
 blt_dixctl(struct exec *o, struct data **r)
 {
@@ -25,6 +25,8 @@ unsigned blt_shut(struct exec *, struct data **);
 unsigned blt_proclist(struct exec *, struct data **);
 unsigned blt_builtinlist(struct exec *, struct data **);
 
+unsigned blt_trace(struct exec *, struct data **);
+unsigned blt_tracesave(struct exec *, struct data **);
 unsigned blt_version(struct exec *, struct data **);
 unsigned blt_panic(struct exec *, struct data **);
 unsigned blt_debug(struct exec *, struct data **);
@@ -61,10 +63,21 @@ unsigned blt_unmute(struct exec *, struct data **);
 unsigned blt_getmute(struct exec *, struct data **);
 unsigned blt_ls(struct exec *, struct data **);
 unsigned blt_save(struct exec *, struct data **);
+unsigned blt_bgsave(struct exec *, struct data **);
+unsigned blt_bsave(struct exec *, struct data **);
+unsigned blt_journal(struct exec *, struct data **);
+unsigned blt_nojournal(struct exec *, struct data **);
+unsigned blt_jreplay(struct exec *, struct data **);
 unsigned blt_load(struct exec *, struct data **);
 unsigned blt_reset(struct exec *, struct data **);
 unsigned blt_export(struct exec *, struct data **);
+unsigned blt_bgexport(struct exec *, struct data **);
+unsigned blt_render(struct exec *, struct data **);
 unsigned blt_import(struct exec *, struct data **);
+unsigned blt_splay(struct exec *, struct data **);
+unsigned blt_smfconv(struct exec *, struct data **);
+unsigned blt_smfinfo(struct exec *, struct data **);
+unsigned blt_smfscan(struct exec *, struct data **);
 unsigned blt_idle(struct exec *, struct data **);
 unsigned blt_play(struct exec *, struct data **);
 unsigned blt_rec(struct exec *, struct data **);
@@ -177,6 +190,14 @@ unsigned blt_dclkrx(struct exec *, struct data **);
 unsigned blt_dclktx(struct exec *, struct data **);
 unsigned blt_dclkrate(struct exec *, struct data **);
 unsigned blt_dinfo(struct exec *, struct data **);
+unsigned blt_dstat(struct exec *, struct data **);
+unsigned blt_dcapture(struct exec *, struct data **);
+unsigned blt_dlatency(struct exec *, struct data **);
+unsigned blt_dbitrate(struct exec *, struct data **);
+unsigned blt_dirate(struct exec *, struct data **);
+unsigned blt_irate(struct exec *, struct data **);
+unsigned blt_getirate(struct exec *, struct data **);
+unsigned blt_getithrot(struct exec *, struct data **);
 unsigned blt_dixctl(struct exec *, struct data **);
 unsigned blt_doxctl(struct exec *, struct data **);
 unsigned blt_diev(struct exec *, struct data **);
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * capture.c
+ *
+ * records bytes received by a device, with a monotonic time-stamp,
+ * in a compact binary file, which can be fed back later through a
+ * "replay" device (see mdep_replay.c), allowing to reproduce a given
+ * input load.
+ *
+ */
+
+#include "utils.h"
+#include "str.h"
+#include "capture.h"
+#include "trace.h"
+
+/*
+ * create the given capture file and write its header
+ */
+struct capture *
+capture_new(char *path)
+{
+	struct capture *o;
+	FILE *fp;
+
+	fp = fopen(path, "wb");
+	if (fp == NULL) {
+		log_perror(path);
+		return NULL;
+	}
+	if (fwrite(CAPTURE_MAGIC, CAPTURE_MAGICLEN, 1, fp) != 1) {
+		log_perror(path);
+		fclose(fp);
+		return NULL;
+	}
+	o = xmalloc(sizeof(struct capture), "capture");
+	o->fp = fp;
+	o->path = str_new(path);
+	o->nrec = 0;
+	return o;
+}
+
+/*
+ * close the capture file
+ */
+void
+capture_delete(struct capture *o)
+{
+	if (fclose(o->fp) != 0)
+		log_perror(o->path);
+	str_delete(o->path);
+	xfree(o);
+}
+
+/*
+ * write a variable length quantity
+ */
+void
+capture_putvar(FILE *fp, unsigned long val)
+{
+	unsigned char buf[(sizeof(unsigned long) * 8 + 6) / 7];
+	unsigned n;
+
+	n = sizeof(buf);
+	buf[--n] = val & 0x7f;
+	while ((val >>= 7) != 0)
+		buf[--n] = 0x80 | (val & 0x7f);
+	fwrite(buf + n, sizeof(buf) - n, 1, fp);
+}
+
+/*
+ * read a variable length quantity, return 0 on end of file
+ */
+unsigned
+capture_getvar(FILE *fp, unsigned long *res)
+{
+	unsigned long val;
+	unsigned i;
+	int c;
+
+	val = 0;
+	for (i = 0; i < (sizeof(unsigned long) * 8 + 6) / 7; i++) {
+		c = fgetc(fp);
+		if (c == EOF)
+			return 0;
+		val = (val << 7) | (c & 0x7f);
+		if (!(c & 0x80)) {
+			*res = val;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * append the given bytes, as one or more records
+ */
+void
+capture_put(struct capture *o, unsigned char *buf, unsigned count)
+{
+	unsigned long now;
+	unsigned n;
+
+	now = trace_mdep_gettime();
+	if (o->nrec == 0)
+		o->stamp = now;
+	while (count > 0) {
+		n = count < CAPTURE_MAXLEN ? count : CAPTURE_MAXLEN;
+		capture_putvar(o->fp, now - o->stamp);
+		capture_putvar(o->fp, n);
+		fwrite(buf, n, 1, o->fp);
+		o->stamp = now;
+		o->nrec++;
+		buf += n;
+		count -= n;
+	}
+	if (ferror(o->fp)) {
+		log_perror(o->path);
+		clearerr(o->fp);
+	}
+}
+
+/*
+ * read and check the header of a capture file
+ */
+unsigned
+capture_gethdr(FILE *fp)
+{
+	char buf[CAPTURE_MAGICLEN];
+	unsigned i;
+
+	if (fread(buf, CAPTURE_MAGICLEN, 1, fp) != 1)
+		return 0;
+	for (i = 0; i < CAPTURE_MAGICLEN; i++) {
+		if (buf[i] != CAPTURE_MAGIC[i])
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * read the next record, return 0 on end of file or if the
+ * record is corrupted
+ */
+unsigned
+capture_getrec(FILE *fp, unsigned long *delta,
+    unsigned char *buf, unsigned *count)
+{
+	unsigned long len;
+
+	if (!capture_getvar(fp, delta) || !capture_getvar(fp, &len))
+		return 0;
+	if (len == 0 || len > CAPTURE_MAXLEN)
+		return 0;
+	if (fread(buf, len, 1, fp) != 1)
+		return 0;
+	*count = len;
+	return 1;
+}
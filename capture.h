@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef MIDISH_CAPTURE_H
+#define MIDISH_CAPTURE_H
+
+#include <stdio.h>
+
+/*
+ * capture files start with CAPTURE_MAGIC, followed by records made
+ * of: the time since the previous record in microseconds, the
+ * number of bytes, both as variable length quantities (as in
+ * standard MIDI files), then the bytes themselves
+ */
+#define CAPTURE_MAGIC		"MIDICAP1"
+#define CAPTURE_MAGICLEN	8
+#define CAPTURE_MAXLEN		0x400	/* max bytes per record */
+
+struct capture {
+	FILE *fp;
+	char *path;
+	unsigned long stamp;		/* time of last record */
+	unsigned nrec;			/* records written */
+};
+
+struct capture *capture_new(char *);
+void capture_delete(struct capture *);
+void capture_put(struct capture *, unsigned char *, unsigned);
+unsigned capture_gethdr(FILE *);
+unsigned capture_getrec(FILE *, unsigned long *, unsigned char *, unsigned *);
+
+#endif /* MIDISH_CAPTURE_H */
@@ -1036,6 +1036,12 @@ evctl_done(void)
 	}
 }
 
+/*
+ * incremented whenever sysex patterns change, as text representation
+ * of events depends on them
+ */
+unsigned evpat_gen = 0;
+
 /*
  * find the sysex pattern corresponding to the given name
  */
@@ -1065,6 +1071,7 @@ evpat_unconf(unsigned cmd)
 	evinfo[cmd].ev = NULL;
 	evinfo[cmd].spec = NULL;
 	evinfo[cmd].pattern = NULL;
+	evpat_gen++;
 }
 
 void
@@ -1134,6 +1141,7 @@ evpat_set(unsigned cmd, char *name, unsigned char *pattern, unsigned size)
 	evinfo[cmd].v0_max = EV_MAXFINE;
 	evinfo[cmd].v1_min = 0;
 	evinfo[cmd].v1_max = EV_MAXFINE;
+	evpat_gen++;
 #if 0
 	log_puts("evpat: nparams = ");
 	log_putu(evinfo[cmd].nparams);
@@ -153,6 +153,7 @@ struct evinfo {
 };
 
 extern struct evinfo evinfo[EV_NUMCMD];
+extern unsigned evpat_gen;
 
 void	 ev_log(struct ev *);
 unsigned ev_str2cmd(struct ev *, char *);
@@ -31,6 +31,12 @@
 
 unsigned filt_debug = 0;
 
+/*
+ * incremented each time a rule of any filter is added or removed, so
+ * code caching information derived from filters can detect changes
+ */
+unsigned filt_gen = 0;
+
 void
 rule_log(struct evspec *from, struct  evspec *to)
 {
@@ -52,6 +58,7 @@ filtnode_new(struct evspec *from, struct filtnode **loc)
 	s->es = *from;
 	s->next = *loc;
 	*loc = s;
+	filt_gen++;
 	return s;
 }
 
@@ -67,6 +74,7 @@ filtnode_del(struct filtnode **loc)
 		filtnode_del(&s->dstlist);
 	*loc = s->next;
 	xfree(s);
+	filt_gen++;
 }
 
 /*
@@ -154,6 +162,27 @@ filtnode_mkdst(struct filtnode *s, struct evspec *to)
 	return filtnode_new(to, pd);
 }
 
+/*
+ * add a source node restored from a file, at the beginning of the list
+ * if 'head' is set, else at its end. Return NULL if the source conflicts
+ * with the ones on the list, ie. if filtnode_mksrc() wouldn't keep both
+ */
+struct filtnode *
+filtnode_putsrc(struct filtnode **root, struct evspec *from, int head)
+{
+	struct filtnode **ps, *s;
+
+	for (ps = root; (s = *ps) != NULL; ps = &s->next) {
+		if (!evspec_isec(&s->es, from))
+			continue;
+		if (evspec_eq(&s->es, from))
+			return NULL;
+		if (head ? !evspec_in(from, &s->es) : !evspec_in(&s->es, from))
+			return NULL;
+	}
+	return filtnode_new(from, head ? root : ps);
+}
+
 
 /*
  * initialize a filter
@@ -178,6 +207,11 @@ filt_reset(struct filt *o)
 		filtnode_del(&o->transp);
 	while (o->vcurve)
 		filtnode_del(&o->vcurve);
+
+	/*
+	 * undo assigns saved rules to the filter after resetting it
+	 */
+	filt_gen++;
 }
 
 /*
@@ -334,6 +368,35 @@ filt_mapnew(struct filt *f, struct evspec *from, struct evspec *to)
 	filtnode_mkdst(s, to);
 }
 
+/*
+ * restore a rule stored by songbin_putfilt(), which stores sources
+ * in reverse order. Unlike filt_mapnew(), the rule is not reordered
+ * with respect to the existing ones, so the filter is rebuilt as it
+ * was saved. Return 0 if the rule conflicts with the existing ones
+ */
+int
+filt_mapload(struct filt *f, struct evspec *from, struct evspec *to)
+{
+	struct filtnode *s, *d, **pd;
+
+	if (to->cmd != EVSPEC_EMPTY && !evspec_isamap(from, to))
+		return 0;
+	s = f->map;
+	if (s == NULL || !evspec_eq(&s->es, from)) {
+		s = filtnode_putsrc(&f->map, from, 1);
+		if (s == NULL)
+			return 0;
+	}
+	for (pd = &s->dstlist; (d = *pd) != NULL; pd = &d->next) {
+		if (evspec_isec(&d->es, to) ||
+		    to->cmd == EVSPEC_EMPTY ||
+		    d->es.cmd == EVSPEC_EMPTY)
+			return 0;
+	}
+	filtnode_new(to, pd);
+	return 1;
+}
+
 struct filtnode *
 filt_detach(struct filt *o)
 {
@@ -441,6 +504,41 @@ filt_vcurve(struct filt *f, struct evspec *from, int weight)
 	s->u.vel.nweight = (64 - weight) & 0x7f;
 }
 
+/*
+ * restore transp and vcurve rules stored by songbin_putfilt() in list
+ * order, see filt_mapload()
+ */
+int
+filt_transpload(struct filt *f, struct evspec *from, int plus)
+{
+	struct filtnode *s;
+
+	if (from->cmd != EVSPEC_ANY && from->cmd != EVSPEC_NOTE)
+		return 0;
+	if (from->cmd == EVSPEC_NOTE &&
+	    (from->v0_min != 0 || from->v0_max != EV_MAXCOARSE))
+		return 0;
+	s = filtnode_putsrc(&f->transp, from, 0);
+	if (s == NULL)
+		return 0;
+	s->u.transp.plus = plus & 0x7f;
+	return 1;
+}
+
+int
+filt_vcurveload(struct filt *f, struct evspec *from, int weight)
+{
+	struct filtnode *s;
+
+	if (from->cmd != EVSPEC_ANY && from->cmd != EVSPEC_NOTE)
+		return 0;
+	s = filtnode_putsrc(&f->vcurve, from, 0);
+	if (s == NULL)
+		return 0;
+	s->u.vel.nweight = (64 - weight) & 0x7f;
+	return 1;
+}
+
 unsigned
 filt_evcnt(struct filt *f, unsigned cmd)
 {
@@ -52,15 +52,19 @@ void filt_reset(struct filt *);
 unsigned filt_do(struct filt *, struct ev *, struct ev *);
 void filt_mapnew(struct filt *, struct evspec *, struct  evspec *);
 void filt_mapdel(struct filt *, struct evspec *, struct  evspec *);
+int filt_mapload(struct filt *, struct evspec *, struct evspec *);
 void filt_chgin(struct filt *, struct evspec *, struct evspec *, int);
 void filt_chgout(struct filt *, struct evspec *, struct evspec *, int);
 void filt_transp(struct filt *, struct evspec *, int);
 void filt_vcurve(struct filt *, struct evspec *, int);
+int filt_transpload(struct filt *, struct evspec *, int);
+int filt_vcurveload(struct filt *, struct evspec *, int);
 unsigned filt_evcnt(struct filt *, unsigned);
 
 struct filtnode *filtnode_new(struct evspec *, struct filtnode **);
 void filtnode_del(struct filtnode **);
+struct filtnode *filtnode_putsrc(struct filtnode **, struct evspec *, int);
 
-extern unsigned filt_debug;
+extern unsigned filt_debug, filt_gen;
 
 #endif /* MIDISH_FILT_H */
@@ -834,6 +834,7 @@ track_merge(struct track *dst, struct track *src)
 	unsigned delta1, delta2, deltad;
 	struct ev ca;
 
+	track_uncache(dst);
 	pd = seqptr_new(dst);
 	p2 = seqptr_new(src);
 	statelist_init(&orglist);
@@ -908,6 +909,7 @@ track_move(struct track *src, unsigned start, unsigned len,
 	struct statelist slist;		/* original src track state */
 	struct state *st;
 
+	track_uncache(src);
 #define TAG_KEEP	1		/* frame is not erased */
 #define TAG_COPY	2		/* frame is copied */
 
@@ -1106,6 +1108,7 @@ track_quantize(struct track *src, struct evspec *es,
 	unsigned fluct, notes;
 	int ofs, delta;
 
+	track_uncache(src);
 	track_init(&qt);
 	sp = seqptr_new(src);
 	qp = seqptr_new(&qt);
@@ -1220,6 +1223,7 @@ track_quantize_frame(struct track *src, struct evspec *es,
 	unsigned fluct, notes;
 	int ofs, delta;
 
+	track_uncache(src);
 	sp = seqptr_new(src);
 
 	/*
@@ -1352,6 +1356,7 @@ track_prescale(struct track *t, unsigned oldunit, unsigned newunit)
 	struct ev ev;
 	unsigned delta, round, err;
 
+	track_uncache(t);
 	round = oldunit / newunit;
 	if (round == 0)
 		round = 1;
@@ -1413,6 +1418,7 @@ track_scale(struct track *t, unsigned oldunit, unsigned newunit)
 	}
 	statelist_done(&slist);
 	seqptr_del(sp);
+	track_uncache(t);
 }
 
 /*
@@ -1429,6 +1435,7 @@ track_transpose(struct track *src, unsigned start, unsigned len,
 	struct statelist slist;
 	struct ev ev;
 
+	track_uncache(src);
 	track_init(&qt);
 	sp = seqptr_new(src);
 	qp = seqptr_new(&qt);
@@ -1515,6 +1522,7 @@ track_vcurve(struct track *src, unsigned start, unsigned len,
 	struct statelist slist;
 	struct ev ev;
 
+	track_uncache(src);
 	/* put weight from -63:63 to 1:127 range */
 	weight = (64 - weight) & 0x7f;
 
@@ -1558,6 +1566,7 @@ track_rewrite(struct track *src)
 	struct seqptr *sp, *dp;
 	unsigned delta;
 
+	track_uncache(src);
 	track_check(src);
 
 	track_init(&frame);
@@ -1602,6 +1611,7 @@ track_check(struct track *src)
 	struct statelist slist;
 	unsigned delta;
 
+	track_uncache(src);
 	sp = seqptr_new(src);
 	statelist_init(&slist);
 
@@ -1798,6 +1808,7 @@ track_settempo(struct track *t, unsigned measure, unsigned tempo)
 	unsigned tic, bpm, tpb;
 	unsigned delta;
 
+	track_uncache(t);
 	/*
 	 * go to the requested position, insert blank if necessary
 	 */
@@ -1861,6 +1872,7 @@ track_confev(struct track *src, struct ev *ev)
 	struct statelist slist;
 	struct state *st;
 
+	track_uncache(src);
 	if (ev_phase(ev) != (EV_PHASE_FIRST | EV_PHASE_LAST)) {
 		log_puts("track_confev: ");
 		ev_log(ev);
@@ -1903,6 +1915,7 @@ track_unconfev(struct track *src, struct evspec *es)
 	struct seqptr *sp;
 	struct state *st;
 
+	track_uncache(src);
 	sp = seqptr_new(src);
 	statelist_init(&slist);
 
@@ -1934,6 +1947,7 @@ track_ins(struct track *t, unsigned stic, unsigned len)
 {
 	struct track t1, t2;
 
+	track_uncache(t);
 	track_init(&t1);
 	track_init(&t2);
 	track_move(t, 0 ,  stic, NULL, &t1, 1, 1);
@@ -1956,6 +1970,7 @@ track_cut(struct track *t, unsigned stic, unsigned len)
 {
 	struct track t1, t2;
 
+	track_uncache(t);
 	track_init(&t1);
 	track_init(&t2);
 	track_move(t, 0,	 stic, NULL, &t1, 1, 1);
@@ -1984,6 +1999,7 @@ track_evmap(struct track *src, unsigned start, unsigned len,
 	struct statelist slist;
 	struct ev ev;
 
+	track_uncache(src);
 	if (!evspec_isamap(from, to))
 		return;
 
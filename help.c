@@ -694,11 +694,44 @@ struct help help_list[] = {
 	"Save the song into the given file. The file name is a "
 	"quoted string."},
 
+	{"bgsave",
+	"bgsave filename\n"
+	"\n"
+	"Save the song into the given file in the background, while "
+	"the program continues to play and to accept commands. A message "
+	"is printed once the file is written."},
+
+	{"bsave",
+	"bsave filename\n"
+	"\n"
+	"Save the song into the given file, in binary format. The file "
+	"name is a quoted string."},
+
+	{"journal",
+	"journal filename\n"
+	"\n"
+	"Record changes made to the song in the given file, until the "
+	"song is saved. After a crash, they can be restored by loading "
+	"the last saved song and replaying the journal. The file must "
+	"be empty or not exist."},
+
+	{"nojournal",
+	"nojournal\n"
+	"\n"
+	"Stop recording changes in the journal."},
+
+	{"jreplay",
+	"jreplay filename\n"
+	"\n"
+	"Apply the changes recorded in the given journal to the "
+	"current song."},
+
 	{"load",
 	"load filename\n"
 	"\n"
-	"Load the song from the given file. The file name is a "
-	"quoted string. The current song will be overwritten."},
+	"Load the song from the given file, in text or binary format. "
+	"The file name is a quoted string. The current song will be "
+	"overwritten."},
 
 	{"reset",
 	"reset\n"
@@ -712,6 +745,21 @@ struct help help_list[] = {
 	"Save the song into the given standard MIDI file. The file name "
 	"is a quoted string."},
 
+	{"bgexport",
+	"bgexport filename\n"
+	"\n"
+	"Save the song into the given standard MIDI file in the "
+	"background, as bgsave does."},
+
+	{"render",
+	"render filename\n"
+	"\n"
+	"Play the song from the current position to its end as fast as "
+	"possible, without using the MIDI devices, and save the events "
+	"that would be sent to them (including metronome, channel config, "
+	"sysex messages and tempo changes) into the given standard MIDI "
+	"file. Tap and loop modes must be disabled."},
+
 	{"import",
 	"import filename\n"
 	"\n"
@@ -719,6 +767,47 @@ struct help help_list[] = {
 	"is a quoted string. The current song will be overwritten. "
 	"Only MIDI file formats 0 and 1 are supported."},
 
+	{"splay",
+	"splay filename measure\n"
+	"\n"
+	"Play the given standard MIDI file on device 0, starting at the "
+	"given measure, without loading it into the song, which must be "
+	"stopped. Events are read from the file as they are played, so "
+	"large files start playing immediately. Controllers, programs "
+	"and bender values set before the start measure are sent first. "
+	"The current song and its filter are not used, except for "
+	"input events."},
+
+	{"smfconv",
+	"smfconv files outdir proc jobs\n"
+	"\n"
+	"Convert the given list of standard MIDI files, or all .mid "
+	"files of the given directory: each file is imported, the given "
+	"proc (without arguments, or nil) is called to transform the "
+	"song, then the song is exported in outdir under the same "
+	"name. Files are processed by the given number of worker "
+	"processes. Return the list of {file status usec} triplets, "
+	"where status is ok or failed. The current song is not "
+	"changed."},
+
+	{"smfinfo",
+	"smfinfo filename\n"
+	"\n"
+	"Read the given standard MIDI file without importing it, and "
+	"return its summary as a list of {name value} pairs: format, "
+	"number of tracks, tics per quarter, duration in tics and "
+	"milliseconds, number of events of each type, number of tempo "
+	"changes with the min and max tempo (in microseconds per "
+	"quarter), number of corrupted tracks and the list of channels "
+	"used."},
+
+	{"smfscan",
+	"smfscan files\n"
+	"\n"
+	"Same as smfinfo for a list of files, or for all .mid files of "
+	"the given directory. Return the list of {file summary} pairs, "
+	"the summary is nil if the file couldn't be read."},
+
 	{"u",
 	"u\n"
 	"\n"
@@ -749,7 +838,19 @@ struct help help_list[] = {
 	"If nil is given instead of the path, then the port is not "
 	"connected to any existing port}, this allows other ALSA sequencer "
 	"clients to subscribe to it and to provide events to midish or to "
-	"consume events midish sends to the port."},
+	"consume events midish sends to the port.\n"
+	"\n"
+	"A path of the form loop[:unit[:delay]] creates a loopback "
+	"device: bytes sent to it are received as input by the given "
+	"device number (itself if omitted) after the given delay "
+	"in milliseconds, at the rate set with dbitrate.\n"
+	"\n"
+	"A path of the form replay:[speed:]filename creates a read-only "
+	"device that plays back a file recorded with dcapture, with its "
+	"original timing multiplied by the given speed factor, or as "
+	"fast as possible if it's 0. At the end of the file, the number "
+	"of bytes played and the time elapsed since the first one are "
+	"displayed."},
 
 	{"ddel",
 	"ddel devnum\n"
@@ -802,6 +903,75 @@ struct help help_list[] = {
 	"\n"
 	"Print some information about the MIDI device."},
 
+	{"dstat",
+	"dstat devnum\n"
+	"\n"
+	"Return the list of statistics of the MIDI device, as {name value} "
+	"pairs: bytes, events, sysex messages and errors received (ibytes, "
+	"iev, isysex, ierr), bytes, events and sysex messages sent (obytes, "
+	"oev, osysex), number of writes and short writes (nflush, nshort), "
+	"and the rates per second over the last second (ibytes_rate, "
+	"iev_rate, obytes_rate, oev_rate)."},
+
+	{"dcapture",
+	"dcapture devnum path\n"
+	"\n"
+	"Record all bytes received by the given MIDI device, with their "
+	"time-stamps, in the given file. If nil is given instead of the "
+	"path, recording stops. The file can be played back with a "
+	"device whose path is replay:[speed:]path, see dnew."},
+
+	{"dlatency",
+	"dlatency outdev indev count path\n"
+	"\n"
+	"Measure the round-trip latency between the given output and "
+	"input devices, connected with a cable or a loopback device, by "
+	"sending count probe messages (controller 119 on channel 16). "
+	"If path is dev, probes are sent directly to the device, if it's "
+	"song, they go through the current filter and the output mixer. "
+	"If it's thru, probes are notes sent directly to the device, so "
+	"if indev is reached through the current filter, they take the "
+	"MIDI-thru fast path. "
+	"Return the list of {name value} pairs: number of probes sent "
+	"and lost, and min, median, p99, max latency and jitter, in "
+	"microseconds."},
+
+	{"dbitrate",
+	"dbitrate devnum bitrate\n"
+	"\n"
+	"Set the bitrate (in bits per second) of the link to the MIDI "
+	"device, 31250 for a standard MIDI cable. If set, notes are sent "
+	"before controllers, bender and aftertouch messages, which are "
+	"deferred until the link is free. Deferred messages for the same "
+	"parameter are merged. The default is 0, i.e. no limit."},
+
+	{"dirate",
+	"dirate devnum class rate\n"
+	"\n"
+	"Set the max number of input events per second of the given class "
+	"received from the MIDI device. The class is one of kat, ctl, pc, "
+	"cat, bend or sx. Excess events are delayed, and only the last value "
+	"of each controller, bender, etc. is kept. Notes are never throttled. "
+	"0 means no limit. The number of throttled events is reported by "
+	"dinfo."},
+
+	{"irate",
+	"irate rate\n"
+	"\n"
+	"Set the max number of input events per second received from all "
+	"devices (except notes), 0 means no limit. The default is 2000."},
+
+	{"getirate",
+	"getirate\n"
+	"\n"
+	"Return the max number of input events per second, as set by irate."},
+
+	{"getithrot",
+	"getithrot\n"
+	"\n"
+	"Return the total number of input events throttled, i.e. delayed "
+	"or replaced by a newer value, because of dirate or irate limits."},
+
 	{"dixctl",
 	"dixctl devnum ctlset\n"
 	"\n"
@@ -955,9 +1125,26 @@ struct help help_list[] = {
 	"    norm - show events in the input normalizer\n"
 	"    pool - show pool usage on exit\n"
 	"    song - show start/stop events\n"
+	"    thru - show events sent through the fast MIDI-thru path\n"
 	"    timo - show timer internal errors\n"
 	"    mem - show memory usage"},
 
+	{"trace",
+	"trace value\n"
+	"\n"
+	"If value is 1, start recording events passing through the "
+	"stages of the pipeline (input, normalizer, filter, mixer, output, "
+	"device writes) in a ring buffer, along with a time-stamp. The "
+	"ring is cleared. If value is 0, stop recording."},
+
+	{"tracesave",
+	"tracesave filename\n"
+	"\n"
+	"Save the events recorded with trace in the given file, in the "
+	"Chrome trace event format, readable by chrome://tracing and "
+	"Perfetto. Stages reached by the same input event are linked "
+	"by a flow."},
+
 	{"version",
 	"version\n"
 	"\n"
@@ -0,0 +1,1374 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * journal of the changes made to the song since it was last saved or
+ * loaded, allowing to recover them after a crash.
+ *
+ * each change recorded by the undo routines is appended to the
+ * journal as a record describing its result: the part of a track that
+ * changed, the new name of an object, a created or deleted object,
+ * and so on. Records are small binary sections, using the same
+ * encoding as binary song files: a tag, a size and the payload.
+ * Tracks are addressed by name, so records don't depend on memory
+ * addresses.
+ *
+ * filters and sysex banks are small, so their whole contents is
+ * recorded once the command that changed them completes. Current
+ * objects and settings are recorded the same way, when they change.
+ *
+ * records are accumulated while a command is running and written
+ * once it completes; written data survives a crash of the program,
+ * and fsync() is called at most every JOURNAL_SYNCTIME, when further
+ * changes are made, so a system crash loses at most the changes made
+ * during that time. Saving or loading the song empties the journal.
+ *
+ * a background save writes the song as it was when the save started,
+ * so once it completes, only the records written before that point
+ * are removed. Records written since are kept in memory until then.
+ *
+ * to recover, the song is loaded from the last saved file and the
+ * journal is replayed on top of it. An incomplete record at the end
+ * of the journal (the program crashed while writing it) is ignored.
+ */
+#include <stddef.h>
+#include <string.h>
+#include "utils.h"
+#include "defs.h"
+#include "ev.h"
+#include "cons.h"
+#include "str.h"
+#include "song.h"
+#include "filt.h"
+#include "sysex.h"
+#include "frame.h"
+#include "trace.h"
+#include "stream.h"
+#include "user.h"
+#include "songbin.h"
+#include "journal.h"
+
+#define JOURNAL_MAGIC		"MIDISHJ\n"
+#define JOURNAL_VERSION		1
+#define JOURNAL_HDRSIZE		12
+#define JOURNAL_SYNCTIME	1000000		/* usec between fsync() */
+
+/*
+ * kinds of objects a record applies to
+ */
+#define JOURNAL_META	0
+#define JOURNAL_TRK	1
+#define JOURNAL_CHAN	2
+#define JOURNAL_FILT	3
+#define JOURNAL_SX	4
+
+/*
+ * object whose contents must be recorded at the end of the command
+ */
+struct journal_pend {
+	struct journal_pend *next;
+	void *obj;
+};
+
+struct journal {
+	struct song *song;		/* song whose changes are recorded */
+	char *path;
+	int fd;
+	struct songbin_out out;		/* records not written yet */
+	struct songbin_out cur;		/* last recorded current objects */
+	struct journal_pend *filts;	/* filters to record */
+	struct journal_pend *sxs;	/* sysex banks to record */
+	unsigned long synctime;		/* time of the last fsync() */
+	unsigned nsync;			/* bytes written since then */
+	unsigned lost;			/* a change couldn't be recorded */
+	unsigned marked;		/* a background save is running */
+	unsigned tailskip;		/* bytes of 'out' before the mark */
+	struct songbin_out tail;	/* records written since the mark */
+};
+
+struct journal *journal = NULL;
+
+void journal_hdr(struct songbin_out *);
+void journal_pend(struct journal_pend **, void *);
+void journal_pendclear(struct journal_pend **);
+unsigned journal_puttarget(struct song *, struct track *);
+void journal_lost(unsigned);
+struct track *journal_gettarget(struct songbin_in *, struct song *);
+struct songchan *journal_getchan(struct songbin_in *, struct song *, int *);
+void journal_gettrk(struct songbin_in *, struct song *);
+void journal_getren(struct songbin_in *, struct song *);
+void journal_getunit(struct songbin_in *, struct song *);
+void journal_getcset(struct songbin_in *, struct song *);
+void journal_getscale(struct songbin_in *, struct song *);
+void journal_gettnew(struct songbin_in *, struct song *);
+void journal_gettdel(struct songbin_in *, struct song *);
+void journal_getmute(struct songbin_in *, struct song *);
+void journal_getfilt(struct songbin_in *, struct song *);
+void journal_getfnew(struct songbin_in *, struct song *);
+void journal_getfdel(struct songbin_in *, struct song *);
+void journal_getcnew(struct songbin_in *, struct song *);
+void journal_getcadd(struct songbin_in *, struct song *);
+void journal_getcdel(struct songbin_in *, struct song *);
+void journal_getxset(struct songbin_in *, struct song *);
+void journal_getxnew(struct songbin_in *, struct song *);
+void journal_getxdel(struct songbin_in *, struct song *);
+
+/*
+ * write the journal header, the journal must be empty
+ */
+void
+journal_hdr(struct songbin_out *o)
+{
+	songbin_grow(o, 8);
+	memcpy(o->buf + o->used, JOURNAL_MAGIC, 8);
+	o->used += 8;
+	songbin_putu32(o, JOURNAL_VERSION);
+}
+
+/*
+ * start recording changes of the given song in the given file. The
+ * file must be empty, so changes not replayed yet are not lost
+ */
+unsigned
+journal_start(struct song *s, char *path)
+{
+	struct journal *j;
+	unsigned long size;
+	int fd;
+
+	journal_stop();
+	fd = journal_mdep_open(path, &size);
+	if (fd < 0)
+		return 0;
+	if (size > JOURNAL_HDRSIZE) {
+		cons_errs(path, "journal not empty, replay or remove it first");
+		journal_mdep_close(fd);
+		return 0;
+	}
+	if (!journal_mdep_reset(fd)) {
+		journal_mdep_close(fd);
+		return 0;
+	}
+	j = xmalloc(sizeof(struct journal), "journal");
+	j->song = s;
+	j->path = str_new(path);
+	j->fd = fd;
+	songbin_outinit(&j->out);
+	songbin_outinit(&j->cur);
+	j->filts = NULL;
+	j->sxs = NULL;
+	j->synctime = trace_mdep_gettime();
+	j->nsync = 0;
+	j->lost = 0;
+	j->marked = 0;
+	songbin_outinit(&j->tail);
+	journal_hdr(&j->out);
+	songbin_putcur(&j->cur, s);
+	journal = j;
+	return 1;
+}
+
+/*
+ * stop recording changes, the journal is kept
+ */
+void
+journal_stop(void)
+{
+	struct journal *j = journal;
+
+	if (j == NULL)
+		return;
+	if (j->out.used > 0)
+		journal_mdep_write(j->fd, j->out.buf, j->out.used);
+	journal_mdep_sync(j->fd);
+	journal_mdep_close(j->fd);
+	journal_pendclear(&j->filts);
+	journal_pendclear(&j->sxs);
+	songbin_outdone(&j->out);
+	songbin_outdone(&j->cur);
+	songbin_outdone(&j->tail);
+	str_delete(j->path);
+	xfree(j);
+	journal = NULL;
+}
+
+/*
+ * empty the journal, called when the song is saved or replaced, so
+ * it records changes from this point
+ */
+void
+journal_restart(struct song *s)
+{
+	struct journal *j = journal;
+
+	if (j == NULL)
+		return;
+	j->song = s;
+	journal_pendclear(&j->filts);
+	journal_pendclear(&j->sxs);
+	j->out.used = 0;
+	j->cur.used = 0;
+	songbin_putcur(&j->cur, s);
+	j->lost = 0;
+	j->marked = 0;
+	if (!journal_mdep_reset(j->fd)) {
+		journal_stop();
+		return;
+	}
+	journal_hdr(&j->out);
+	journal_mdep_write(j->fd, j->out.buf, j->out.used);
+	journal_mdep_sync(j->fd);
+	j->synctime = trace_mdep_gettime();
+	j->nsync = 0;
+	j->out.used = 0;
+}
+
+/*
+ * a background save of the song starts, remember the current end of
+ * the journal, i.e. what the saved file will contain
+ */
+void
+journal_mark(void)
+{
+	struct journal *j = journal;
+
+	if (j == NULL)
+		return;
+	j->marked = 1;
+	j->tailskip = j->out.used;
+	j->tail.used = 0;
+}
+
+/*
+ * the background save started by journal_mark() succeeded, remove
+ * records written before the mark, as the saved file contains them
+ */
+void
+journal_cut(void)
+{
+	struct journal *j = journal;
+	struct songbin_out o;
+	unsigned ok;
+
+	if (j == NULL || !j->marked)
+		return;
+	j->marked = 0;
+	if (j->tailskip > j->out.used)
+		j->tailskip = j->out.used;
+	memmove(j->out.buf, j->out.buf + j->tailskip,
+	    j->out.used - j->tailskip);
+	j->out.used -= j->tailskip;
+	if (!journal_mdep_reset(j->fd)) {
+		journal_stop();
+		return;
+	}
+	songbin_outinit(&o);
+	journal_hdr(&o);
+	songbin_grow(&o, j->tail.used);
+	memcpy(o.buf + o.used, j->tail.buf, j->tail.used);
+	o.used += j->tail.used;
+	ok = journal_mdep_write(j->fd, o.buf, o.used);
+	songbin_outdone(&o);
+	if (!ok) {
+		cons_errs(j->path, "failed to write journal");
+		journal_stop();
+		return;
+	}
+	journal_mdep_sync(j->fd);
+	j->synctime = trace_mdep_gettime();
+	j->nsync = 0;
+}
+
+unsigned
+journal_isopen(void)
+{
+	return journal != NULL;
+}
+
+void
+journal_pend(struct journal_pend **list, void *obj)
+{
+	struct journal_pend *p;
+
+	for (p = *list; p != NULL; p = p->next) {
+		if (p->obj == obj)
+			return;
+	}
+	p = xmalloc(sizeof(struct journal_pend), "journal_pend");
+	p->obj = obj;
+	p->next = *list;
+	*list = p;
+}
+
+void
+journal_pendclear(struct journal_pend **list)
+{
+	struct journal_pend *p;
+
+	while ((p = *list) != NULL) {
+		*list = p->next;
+		xfree(p);
+	}
+}
+
+/*
+ * called when a change couldn't be recorded, the journal is no
+ * longer enough to recover the song
+ */
+void
+journal_lost(unsigned start)
+{
+	struct journal *j = journal;
+
+	j->out.used = start;
+	if (!j->lost) {
+		cons_errs(j->path, "change not recorded, save the song");
+		j->lost = 1;
+	}
+}
+
+/*
+ * record the contents of changed objects and the current objects, then
+ * write the records of the command that just completed
+ */
+void
+journal_commit(struct song *s)
+{
+	struct journal *j = journal;
+	struct songbin_out *o;
+	struct journal_pend *p;
+	struct songfilt *g;
+	struct songsx *l;
+	struct songbin_out cur;
+	unsigned long now;
+	unsigned pos;
+
+	if (j == NULL || s != j->song)
+		return;
+	o = &j->out;
+	for (p = j->filts; p != NULL; p = p->next) {
+		SONG_FOREACH_FILT(s, g) {
+			if (&g->filt == p->obj)
+				break;
+		}
+		if (g == NULL)
+			continue;
+		pos = songbin_begin(o, "FILT");
+		songbin_putstr(o, g->name.str);
+		songbin_putfilt(o, &g->filt);
+		songbin_end(o, pos);
+	}
+	journal_pendclear(&j->filts);
+	for (p = j->sxs; p != NULL; p = p->next) {
+		SONG_FOREACH_SX(s, l) {
+			if (l == p->obj)
+				break;
+		}
+		if (l == NULL)
+			continue;
+		pos = songbin_begin(o, "XSET");
+		songbin_putstr(o, l->name.str);
+		songbin_putsxlist(o, &l->sx);
+		songbin_end(o, pos);
+	}
+	journal_pendclear(&j->sxs);
+
+	songbin_outinit(&cur);
+	songbin_putcur(&cur, s);
+	if (cur.used != j->cur.used ||
+	    memcmp(cur.buf, j->cur.buf, cur.used) != 0) {
+		pos = songbin_begin(o, "CURS");
+		songbin_grow(o, cur.used);
+		memcpy(o->buf + o->used, cur.buf, cur.used);
+		o->used += cur.used;
+		songbin_end(o, pos);
+		songbin_outdone(&j->cur);
+		j->cur = cur;
+	} else
+		songbin_outdone(&cur);
+
+	if (o->used > 0) {
+		if (!journal_mdep_write(j->fd, o->buf, o->used)) {
+			cons_errs(j->path, "failed to write journal");
+			journal_stop();
+			return;
+		}
+		j->nsync += o->used;
+		if (j->marked && o->used > j->tailskip) {
+			songbin_grow(&j->tail, o->used - j->tailskip);
+			memcpy(j->tail.buf + j->tail.used, o->buf + j->tailskip,
+			    o->used - j->tailskip);
+			j->tail.used += o->used - j->tailskip;
+		}
+		j->tailskip = 0;
+		o->used = 0;
+	}
+	now = trace_mdep_gettime();
+	if (j->nsync > 0 && now - j->synctime >= JOURNAL_SYNCTIME) {
+		journal_mdep_sync(j->fd);
+		j->synctime = now;
+		j->nsync = 0;
+	}
+}
+
+/*
+ * store the kind and the name of the object the track belongs to,
+ * return 0 if the track isn't saved with the song
+ */
+unsigned
+journal_puttarget(struct song *s, struct track *t)
+{
+	struct songbin_out *o = &journal->out;
+	struct songtrk *i;
+	struct songchan *c;
+
+	if (t == &s->meta) {
+		songbin_putu32(o, JOURNAL_META);
+		return 1;
+	}
+	SONG_FOREACH_TRK(s, i) {
+		if (t == &i->track) {
+			songbin_putu32(o, JOURNAL_TRK);
+			songbin_putstr(o, i->name.str);
+			return 1;
+		}
+	}
+	SONG_FOREACH_CHAN(s, c) {
+		if (t == &c->conf) {
+			songbin_putu32(o, JOURNAL_CHAN);
+			songbin_putu32(o, c->isinput);
+			songbin_putstr(o, c->name.str);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * record that "nrm" events were removed from the track at position
+ * "pos", and replaced by "nins" events, either the given ones or, if
+ * NULL, the ones currently at this position
+ */
+void
+journal_track(struct song *s, struct track *t,
+    unsigned pos, unsigned nrm, unsigned nins, struct seqev_data *evs)
+{
+	struct songbin_out *o;
+	struct seqev *se;
+	unsigned start, i;
+
+	if (journal == NULL || s != journal->song ||
+	    t == &s->clip || t == &s->rec)
+		return;
+	if (nrm == 0 && nins == 0)
+		return;
+	o = &journal->out;
+	start = o->used;
+	songbin_begin(o, "TRKD");
+	if (!journal_puttarget(s, t)) {
+		journal_lost(start);
+		return;
+	}
+	songbin_putu32(o, pos);
+	songbin_putu32(o, nrm);
+	songbin_putu32(o, nins);
+	if (evs != NULL) {
+		for (i = 0; i < nins; i++)
+			songbin_putev(o, evs[i].delta, &evs[i].ev);
+	} else {
+		se = t->first;
+		for (i = 0; i < pos; i++)
+			se = se->next;
+		for (i = 0; i < nins; i++) {
+			songbin_putev(o, se->delta, &se->ev);
+			se = se->next;
+		}
+	}
+	songbin_end(o, start + 8);
+}
+
+/*
+ * record that the object whose name is stored at the given location
+ * was renamed
+ */
+void
+journal_ren(struct song *s, char **ptr, char *from, char *to)
+{
+	struct songbin_out *o;
+	struct songtrk *t;
+	struct songchan *c;
+	struct songfilt *g;
+	struct songsx *l;
+	unsigned kind, input, pos;
+
+	if (journal == NULL || s != journal->song)
+		return;
+	input = 0;
+	SONG_FOREACH_TRK(s, t) {
+		if (ptr == &t->name.str) {
+			kind = JOURNAL_TRK;
+			goto found;
+		}
+	}
+	SONG_FOREACH_CHAN(s, c) {
+		if (ptr == &c->name.str) {
+			kind = JOURNAL_CHAN;
+			input = c->isinput;
+			goto found;
+		}
+	}
+	SONG_FOREACH_FILT(s, g) {
+		if (ptr == &g->name.str) {
+			kind = JOURNAL_FILT;
+			goto found;
+		}
+	}
+	SONG_FOREACH_SX(s, l) {
+		if (ptr == &l->name.str) {
+			kind = JOURNAL_SX;
+			goto found;
+		}
+	}
+	journal_lost(journal->out.used);
+	return;
+found:
+	o = &journal->out;
+	pos = songbin_begin(o, "RENM");
+	songbin_putu32(o, kind);
+	songbin_putu32(o, input);
+	songbin_putstr(o, from);
+	songbin_putstr(o, to);
+	songbin_end(o, pos);
+}
+
+/*
+ * record the new value of the given integer
+ */
+void
+journal_uint(struct song *s, unsigned *ptr)
+{
+	struct songbin_out *o;
+	struct songchan *c;
+	struct songsx *l;
+	struct sysex *x;
+	unsigned pos;
+
+	if (journal == NULL || s != journal->song)
+		return;
+	o = &journal->out;
+	if (ptr == &s->curquant)
+		return;
+	if (ptr == &s->tics_per_unit) {
+		pos = songbin_begin(o, "UNIT");
+		songbin_putu32(o, s->tics_per_unit);
+		songbin_end(o, pos);
+		return;
+	}
+	SONG_FOREACH_CHAN(s, c) {
+		if (ptr == &c->dev || ptr == &c->ch) {
+			pos = songbin_begin(o, "CSET");
+			songbin_putu32(o, c->isinput);
+			songbin_putstr(o, c->name.str);
+			songbin_putu32(o, c->dev);
+			songbin_putu32(o, c->ch);
+			songbin_end(o, pos);
+			return;
+		}
+	}
+	SONG_FOREACH_SX(s, l) {
+		for (x = l->sx.first; x != NULL; x = x->next) {
+			if (ptr == &x->unit) {
+				journal_sx(s, l);
+				return;
+			}
+		}
+	}
+	journal_lost(o->used);
+}
+
+void
+journal_scale(struct song *s, unsigned oldunit, unsigned newunit)
+{
+	struct songbin_out *o;
+	unsigned pos;
+
+	if (journal == NULL || s != journal->song)
+		return;
+	o = &journal->out;
+	pos = songbin_begin(o, "SCAL");
+	songbin_putu32(o, oldunit);
+	songbin_putu32(o, newunit);
+	songbin_end(o, pos);
+}
+
+/*
+ * record a track added to the song, either created or restored
+ */
+void
+journal_tnew(struct song *s, struct songtrk *t)
+{
+	struct songbin_out *o;
+	unsigned pos;
+
+	if (journal == NULL || s != journal->song)
+		return;
+	o = &journal->out;
+	pos = songbin_begin(o, "TNEW");
+	songbin_putstr(o, t->name.str);
+	songbin_putname(o, (struct name *)t->curfilt);
+	songbin_putu32(o, t->mute);
+	songbin_end(o, pos);
+}
+
+void
+journal_tdel(struct song *s, struct songtrk *t)
+{
+	struct songbin_out *o;
+	unsigned pos;
+
+	if (journal == NULL || s != journal->song)
+		return;
+	o = &journal->out;
+	pos = songbin_begin(o, "TDEL");
+	songbin_putstr(o, t->name.str);
+	songbin_end(o, pos);
+}
+
+/*
+ * record a track muted or unmuted; this is not undoable, but it's
+ * saved with the song
+ */
+void
+journal_mute(struct song *s, struct songtrk *t)
+{
+	struct songbin_out *o;
+	unsigned pos;
+
+	if (journal == NULL || s != journal->song)
+		return;
+	o = &journal->out;
+	pos = songbin_begin(o, "TMUT");
+	songbin_putstr(o, t->name.str);
+	songbin_putu32(o, t->mute);
+	songbin_end(o, pos);
+}
+
+/*
+ * the given filter is about to change, record it once the command
+ * completes
+ */
+void
+journal_filt(struct song *s, struct filt *f)
+{
+	if (journal == NULL || s != journal->song)
+		return;
+	journal_pend(&journal->filts, f);
+}
+
+/*
+ * record a filter added to the song, either created or restored,
+ * along with the tracks using it
+ */
+void
+journal_fnew(struct song *s, struct songfilt *g)
+{
+	struct songbin_out *o;
+	struct songtrk *t;
+	unsigned pos, n;
+
+	if (journal == NULL || s != journal->song)
+		return;
+	o = &journal->out;
+	pos = songbin_begin(o, "FNEW");
+	songbin_putstr(o, g->name.str);
+	songbin_putfilt(o, &g->filt);
+	n = 0;
+	SONG_FOREACH_TRK(s, t) {
+		if (t->curfilt == g)
+			n++;
+	}
+	songbin_putu32(o, n);
+	SONG_FOREACH_TRK(s, t) {
+		if (t->curfilt == g)
+			songbin_putstr(o, t->name.str);
+	}
+	songbin_end(o, pos);
+}
+
+void
+journal_fdel(struct song *s, struct songfilt *g)
+{
+	struct songbin_out *o;
+	unsigned pos;
+
+	if (journal == NULL || s != journal->song)
+		return;
+	o = &journal->out;
+	pos = songbin_begin(o, "FDEL");
+	songbin_putstr(o, g->name.str);
+	songbin_end(o, pos);
+}
+
+/*
+ * record a channel created with song_channew()
+ */
+void
+journal_cnew(struct song *s, struct songchan *c)
+{
+	struct songbin_out *o;
+	unsigned pos;
+
+	if (journal == NULL || s != journal->song)
+		return;
+	o = &journal->out;
+	pos = songbin_begin(o, "CNEW");
+	songbin_putu32(o, c->isinput);
+	songbin_putstr(o, c->name.str);
+	songbin_putu32(o, c->dev);
+	songbin_putu32(o, c->ch);
+	songbin_end(o, pos);
+}
+
+/*
+ * record a deleted channel restored in the song
+ */
+void
+journal_cadd(struct song *s, struct songchan *c)
+{
+	struct songbin_out *o;
+	unsigned pos;
+
+	if (journal == NULL || s != journal->song)
+		return;
+	o = &journal->out;
+	pos = songbin_begin(o, "CADD");
+	songbin_putu32(o, c->isinput);
+	songbin_putstr(o, c->name.str);
+	songbin_putu32(o, c->dev);
+	songbin_putu32(o, c->ch);
+	songbin_putname(o, (struct name *)c->filt);
+	songbin_end(o, pos);
+}
+
+/*
+ * record a channel removed from the song, its filter is deleted
+ * separately
+ */
+void
+journal_cdel(struct song *s, struct songchan *c)
+{
+	struct songbin_out *o;
+	unsigned pos;
+
+	if (journal == NULL || s != journal->song)
+		return;
+	o = &journal->out;
+	pos = songbin_begin(o, "CDEL");
+	songbin_putu32(o, c->isinput);
+	songbin_putstr(o, c->name.str);
+	songbin_end(o, pos);
+}
+
+/*
+ * the given sysex bank changed, record it once the command completes
+ */
+void
+journal_sx(struct song *s, struct songsx *l)
+{
+	if (journal == NULL || s != journal->song)
+		return;
+	journal_pend(&journal->sxs, l);
+}
+
+/*
+ * record a sysex bank added to the song, its contents is recorded
+ * separately
+ */
+void
+journal_xnew(struct song *s, struct songsx *l)
+{
+	struct songbin_out *o;
+	unsigned pos;
+
+	if (journal == NULL || s != journal->song)
+		return;
+	o = &journal->out;
+	pos = songbin_begin(o, "XNEW");
+	songbin_putstr(o, l->name.str);
+	songbin_end(o, pos);
+	if (l->sx.first != NULL)
+		journal_sx(s, l);
+}
+
+void
+journal_xdel(struct song *s, struct songsx *l)
+{
+	struct songbin_out *o;
+	unsigned pos;
+
+	if (journal == NULL || s != journal->song)
+		return;
+	o = &journal->out;
+	pos = songbin_begin(o, "XDEL");
+	songbin_putstr(o, l->name.str);
+	songbin_end(o, pos);
+}
+
+/*
+ * read a track reference and return the track
+ */
+struct track *
+journal_gettarget(struct songbin_in *o, struct song *s)
+{
+	char name[SONGBIN_MAXSTR];
+	struct songtrk *t;
+	struct songchan *c;
+	unsigned kind, input;
+
+	kind = songbin_getu32(o);
+	if (o->err)
+		return NULL;
+	switch (kind) {
+	case JOURNAL_META:
+		return &s->meta;
+	case JOURNAL_TRK:
+		if (!songbin_getname(o, name))
+			return NULL;
+		t = song_trklookup(s, name);
+		if (t == NULL)
+			break;
+		return &t->track;
+	case JOURNAL_CHAN:
+		input = songbin_getu32(o);
+		if (!songbin_getname(o, name))
+			return NULL;
+		c = song_chanlookup(s, name, input);
+		if (c == NULL)
+			break;
+		return &c->conf;
+	}
+	songbin_err(o, "no such track");
+	return NULL;
+}
+
+/*
+ * read a channel reference and return the channel
+ */
+struct songchan *
+journal_getchan(struct songbin_in *o, struct song *s, int *input)
+{
+	char name[SONGBIN_MAXSTR];
+	struct songchan *c;
+
+	*input = songbin_getu32(o) != 0;
+	if (!songbin_getname(o, name))
+		return NULL;
+	c = song_chanlookup(s, name, *input);
+	if (c == NULL)
+		songbin_err(o, "no such channel");
+	return c;
+}
+
+/*
+ * replace part of a track, the same way undo does
+ */
+void
+journal_gettrk(struct songbin_in *o, struct song *s)
+{
+	struct track *t;
+	struct track_data data;
+	unsigned pos, nrm, nins, n, i, last;
+
+	t = journal_gettarget(o, s);
+	if (t == NULL)
+		return;
+	pos = songbin_getu32(o);
+	nrm = songbin_getu32(o);
+	nins = songbin_getu32(o);
+	if (o->err)
+		return;
+	n = track_numev(t);
+	if (pos >= n || nrm > n - pos ||
+	    (o->end - o->p) / SONGBIN_EVSIZE < nins) {
+		songbin_err(o, "corrupted track change");
+		return;
+	}
+
+	/*
+	 * the end-of-track event can be replaced only by another
+	 * end-of-track event
+	 */
+	last = (pos + nrm == n);
+	if (last && nins == 0) {
+		songbin_err(o, "corrupted track change");
+		return;
+	}
+	data.evs = xmalloc(nins * sizeof(struct seqev_data), "track_data");
+	for (i = 0; i < nins; i++) {
+		if (!songbin_getev(o, &data.evs[i].delta, &data.evs[i].ev))
+			break;
+		if ((data.evs[i].ev.cmd == EV_NULL) != (last && i == nins - 1)) {
+			songbin_err(o, "corrupted track change");
+			break;
+		}
+	}
+	if (o->err) {
+		xfree(data.evs);
+		return;
+	}
+	data.pos = pos;
+	data.nins = nrm;
+	data.nrm = nins;
+	track_undorestore(t, &data);
+}
+
+void
+journal_getren(struct songbin_in *o, struct song *s)
+{
+	char from[SONGBIN_MAXSTR], to[SONGBIN_MAXSTR];
+	struct name *n, *dup;
+	unsigned kind, input;
+
+	kind = songbin_getu32(o);
+	input = songbin_getu32(o);
+	if (!songbin_getname(o, from) || !songbin_getname(o, to))
+		return;
+	switch (kind) {
+	case JOURNAL_TRK:
+		n = (struct name *)song_trklookup(s, from);
+		dup = (struct name *)song_trklookup(s, to);
+		break;
+	case JOURNAL_CHAN:
+		n = (struct name *)song_chanlookup(s, from, input);
+		dup = (struct name *)song_chanlookup(s, to, input);
+		break;
+	case JOURNAL_FILT:
+		n = (struct name *)song_filtlookup(s, from);
+		dup = (struct name *)song_filtlookup(s, to);
+		break;
+	case JOURNAL_SX:
+		n = (struct name *)song_sxlookup(s, from);
+		dup = (struct name *)song_sxlookup(s, to);
+		break;
+	default:
+		n = dup = NULL;
+	}
+	if (n == NULL || dup != NULL || to[0] == '\0') {
+		songbin_err(o, "bad rename");
+		return;
+	}
+	str_delete(n->str);
+	n->str = str_new(to);
+}
+
+void
+journal_getunit(struct songbin_in *o, struct song *s)
+{
+	unsigned tpu;
+
+	tpu = songbin_getu32(o);
+	if (o->err)
+		return;
+	if (tpu < DEFAULT_TPU || tpu % DEFAULT_TPU != 0 || tpu > TPU_MAX) {
+		songbin_err(o, "bad tics per unit");
+		return;
+	}
+	s->tics_per_unit = tpu;
+}
+
+void
+journal_getcset(struct songbin_in *o, struct song *s)
+{
+	struct songchan *c;
+	unsigned dev, ch;
+	int input;
+
+	c = journal_getchan(o, s, &input);
+	dev = songbin_getu32(o);
+	ch = songbin_getu32(o);
+	if (o->err)
+		return;
+	if (dev > EV_MAXDEV || ch > EV_MAXCH) {
+		songbin_err(o, "bad channel number");
+		return;
+	}
+	c->dev = dev;
+	c->ch = ch;
+}
+
+void
+journal_getscale(struct songbin_in *o, struct song *s)
+{
+	struct songtrk *t;
+	unsigned oldunit, newunit;
+
+	oldunit = songbin_getu32(o);
+	newunit = songbin_getu32(o);
+	if (o->err)
+		return;
+	if (oldunit < DEFAULT_TPU || oldunit % DEFAULT_TPU != 0 ||
+	    oldunit > TPU_MAX ||
+	    newunit < DEFAULT_TPU || newunit % DEFAULT_TPU != 0 ||
+	    newunit > TPU_MAX) {
+		songbin_err(o, "bad time scale");
+		return;
+	}
+	track_scale(&s->meta, oldunit, newunit);
+	SONG_FOREACH_TRK(s, t)
+		track_scale(&t->track, oldunit, newunit);
+}
+
+void
+journal_gettnew(struct songbin_in *o, struct song *s)
+{
+	char name[SONGBIN_MAXSTR], fname[SONGBIN_MAXSTR];
+	struct songtrk *t;
+	unsigned mute;
+
+	if (!songbin_getname(o, name) || !songbin_getname(o, fname))
+		return;
+	mute = songbin_getu32(o);
+	if (o->err)
+		return;
+	if (name[0] == '\0' || song_trklookup(s, name) != NULL) {
+		songbin_err(o, "bad track name");
+		return;
+	}
+	t = song_trknew(s, name);
+	t->curfilt = song_filtlookup(s, fname);
+	t->mute = mute != 0;
+}
+
+void
+journal_gettdel(struct songbin_in *o, struct song *s)
+{
+	char name[SONGBIN_MAXSTR];
+	struct songtrk *t;
+
+	if (!songbin_getname(o, name))
+		return;
+	t = song_trklookup(s, name);
+	if (t == NULL) {
+		songbin_err(o, "no such track");
+		return;
+	}
+	song_trkdel(s, t);
+}
+
+void
+journal_getmute(struct songbin_in *o, struct song *s)
+{
+	char name[SONGBIN_MAXSTR];
+	struct songtrk *t;
+	unsigned mute;
+
+	if (!songbin_getname(o, name))
+		return;
+	mute = songbin_getu32(o);
+	if (o->err)
+		return;
+	t = song_trklookup(s, name);
+	if (t == NULL) {
+		songbin_err(o, "no such track");
+		return;
+	}
+	t->mute = mute != 0;
+}
+
+void
+journal_getfilt(struct songbin_in *o, struct song *s)
+{
+	char name[SONGBIN_MAXSTR];
+	struct songfilt *g;
+
+	if (!songbin_getname(o, name))
+		return;
+	g = song_filtlookup(s, name);
+	if (g == NULL) {
+		songbin_err(o, "no such filter");
+		return;
+	}
+	filt_reset(&g->filt);
+	songbin_getfilt(o, &g->filt);
+}
+
+void
+journal_getfnew(struct songbin_in *o, struct song *s)
+{
+	char name[SONGBIN_MAXSTR];
+	struct songfilt *g;
+	struct songtrk *t;
+	unsigned n;
+
+	if (!songbin_getname(o, name))
+		return;
+	if (name[0] == '\0' || song_filtlookup(s, name) != NULL) {
+		songbin_err(o, "bad filter name");
+		return;
+	}
+	g = song_filtnew(s, name);
+	if (!songbin_getfilt(o, &g->filt))
+		return;
+	n = songbin_getu32(o);
+	while (!o->err && n-- > 0) {
+		if (!songbin_getname(o, name))
+			return;
+		t = song_trklookup(s, name);
+		if (t == NULL) {
+			songbin_err(o, "no such track");
+			return;
+		}
+		t->curfilt = g;
+	}
+}
+
+void
+journal_getfdel(struct songbin_in *o, struct song *s)
+{
+	char name[SONGBIN_MAXSTR];
+	struct songfilt *g;
+	struct songchan *c;
+
+	if (!songbin_getname(o, name))
+		return;
+	g = song_filtlookup(s, name);
+	if (g == NULL) {
+		songbin_err(o, "no such filter");
+		return;
+	}
+	SONG_FOREACH_CHAN(s, c) {
+		if (c->filt == g)
+			c->filt = NULL;
+	}
+	song_filtdel(s, g);
+}
+
+void
+journal_getcnew(struct songbin_in *o, struct song *s)
+{
+	char name[SONGBIN_MAXSTR];
+	unsigned input, dev, ch;
+
+	input = songbin_getu32(o) != 0;
+	if (!songbin_getname(o, name))
+		return;
+	dev = songbin_getu32(o);
+	ch = songbin_getu32(o);
+	if (o->err)
+		return;
+	if (name[0] == '\0' || song_chanlookup(s, name, input) != NULL ||
+	    dev > EV_MAXDEV || ch > EV_MAXCH) {
+		songbin_err(o, "bad channel");
+		return;
+	}
+	song_channew(s, name, dev, ch, input);
+}
+
+/*
+ * restore a deleted channel, as undo does: unlike song_channew(),
+ * its filter is not created
+ */
+void
+journal_getcadd(struct songbin_in *o, struct song *s)
+{
+	char name[SONGBIN_MAXSTR], fname[SONGBIN_MAXSTR];
+	struct songchan *c;
+	unsigned input, dev, ch;
+
+	input = songbin_getu32(o) != 0;
+	if (!songbin_getname(o, name))
+		return;
+	dev = songbin_getu32(o);
+	ch = songbin_getu32(o);
+	if (!songbin_getname(o, fname))
+		return;
+	if (name[0] == '\0' || song_chanlookup(s, name, input) != NULL ||
+	    dev > EV_MAXDEV || ch > EV_MAXCH) {
+		songbin_err(o, "bad channel");
+		return;
+	}
+	c = xmalloc(sizeof(struct songchan), "songchan");
+	name_init(&c->name, name);
+	track_init(&c->conf);
+	c->dev = dev;
+	c->ch = ch;
+	c->isinput = input;
+	c->filt = input ? NULL : song_filtlookup(s, fname);
+	name_add(&s->chanlist, (struct name *)c);
+}
+
+/*
+ * remove a channel, its filter is deleted by a separate record
+ */
+void
+journal_getcdel(struct songbin_in *o, struct song *s)
+{
+	struct songchan *c;
+	int input;
+
+	c = journal_getchan(o, s, &input);
+	if (c == NULL)
+		return;
+	if (s->curin == c)
+		s->curin = NULL;
+	if (s->curout == c)
+		s->curout = NULL;
+	name_remove(&s->chanlist, (struct name *)c);
+	track_done(&c->conf);
+	name_done(&c->name);
+	xfree(c);
+}
+
+void
+journal_getxset(struct songbin_in *o, struct song *s)
+{
+	char name[SONGBIN_MAXSTR];
+	struct songsx *l;
+
+	if (!songbin_getname(o, name))
+		return;
+	l = song_sxlookup(s, name);
+	if (l == NULL) {
+		songbin_err(o, "no such sysex bank");
+		return;
+	}
+	sysexlist_clear(&l->sx);
+	songbin_getsxlist(o, &l->sx);
+}
+
+void
+journal_getxnew(struct songbin_in *o, struct song *s)
+{
+	char name[SONGBIN_MAXSTR];
+
+	if (!songbin_getname(o, name))
+		return;
+	if (name[0] == '\0' || song_sxlookup(s, name) != NULL) {
+		songbin_err(o, "bad sysex bank name");
+		return;
+	}
+	song_sxnew(s, name);
+}
+
+void
+journal_getxdel(struct songbin_in *o, struct song *s)
+{
+	char name[SONGBIN_MAXSTR];
+	struct songsx *l;
+
+	if (!songbin_getname(o, name))
+		return;
+	l = song_sxlookup(s, name);
+	if (l == NULL) {
+		songbin_err(o, "no such sysex bank");
+		return;
+	}
+	song_sxdel(s, l);
+}
+
+/*
+ * apply the changes recorded in the given journal to the song; on
+ * error, changes preceding the bad record remain applied
+ */
+unsigned
+journal_replay(struct song *s, char *path)
+{
+	struct songbin_in in, *o = &in;
+	unsigned char *data, *tag, *end;
+	unsigned long mtime;
+	unsigned size, nrec;
+	size_t len;
+
+	data = stream_mdep_map(path, &len, &mtime);
+	if (data == NULL)
+		return 0;
+	o->path = path;
+	o->p = data;
+	o->end = data + len;
+	o->err = 0;
+	if (len < JOURNAL_HDRSIZE || memcmp(data, JOURNAL_MAGIC, 8) != 0) {
+		songbin_err(o, "not a journal");
+		goto done;
+	}
+	o->p += 8;
+	if (songbin_getu32(o) > JOURNAL_VERSION) {
+		songbin_err(o, "midish version too old to read this journal");
+		goto done;
+	}
+	nrec = 0;
+	while (!o->err && o->p != o->end) {
+		tag = o->p;
+		if (o->end - o->p >= 8) {
+			o->p += 4;
+			size = songbin_getu32(o);
+		} else
+			size = ~0U;
+		if (o->end - o->p < size) {
+			cons_errs(path, "ignored incomplete record at the end");
+			break;
+		}
+		end = o->p + size;
+		o->end = end;
+		if (memcmp(tag, "TRKD", 4) == 0)
+			journal_gettrk(o, s);
+		else if (memcmp(tag, "RENM", 4) == 0)
+			journal_getren(o, s);
+		else if (memcmp(tag, "UNIT", 4) == 0)
+			journal_getunit(o, s);
+		else if (memcmp(tag, "CSET", 4) == 0)
+			journal_getcset(o, s);
+		else if (memcmp(tag, "SCAL", 4) == 0)
+			journal_getscale(o, s);
+		else if (memcmp(tag, "TNEW", 4) == 0)
+			journal_gettnew(o, s);
+		else if (memcmp(tag, "TDEL", 4) == 0)
+			journal_gettdel(o, s);
+		else if (memcmp(tag, "TMUT", 4) == 0)
+			journal_getmute(o, s);
+		else if (memcmp(tag, "FILT", 4) == 0)
+			journal_getfilt(o, s);
+		else if (memcmp(tag, "FNEW", 4) == 0)
+			journal_getfnew(o, s);
+		else if (memcmp(tag, "FDEL", 4) == 0)
+			journal_getfdel(o, s);
+		else if (memcmp(tag, "CNEW", 4) == 0)
+			journal_getcnew(o, s);
+		else if (memcmp(tag, "CADD", 4) == 0)
+			journal_getcadd(o, s);
+		else if (memcmp(tag, "CDEL", 4) == 0)
+			journal_getcdel(o, s);
+		else if (memcmp(tag, "XSET", 4) == 0)
+			journal_getxset(o, s);
+		else if (memcmp(tag, "XNEW", 4) == 0)
+			journal_getxnew(o, s);
+		else if (memcmp(tag, "XDEL", 4) == 0)
+			journal_getxdel(o, s);
+		else if (memcmp(tag, "CURS", 4) == 0)
+			songbin_getcur(o, s);
+		else
+			songbin_err(o, "unknown record");
+		o->p = end;
+		o->end = data + len;
+		nrec++;
+	}
+	if (!o->err && user_flag_verb) {
+		log_putu(nrec);
+		log_puts(" changes replayed\n");
+	}
+done:
+	stream_mdep_unmap(data, len);
+	return !o->err;
+}
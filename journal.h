@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef MIDISH_JOURNAL_H
+#define MIDISH_JOURNAL_H
+
+struct song;
+struct track;
+struct filt;
+struct seqev_data;
+struct songtrk;
+struct songchan;
+struct songfilt;
+struct songsx;
+
+unsigned journal_start(struct song *, char *);
+void journal_stop(void);
+void journal_restart(struct song *);
+void journal_commit(struct song *);
+void journal_mark(void);
+void journal_cut(void);
+unsigned journal_replay(struct song *, char *);
+unsigned journal_isopen(void);
+
+void journal_track(struct song *, struct track *,
+    unsigned, unsigned, unsigned, struct seqev_data *);
+void journal_ren(struct song *, char **, char *, char *);
+void journal_uint(struct song *, unsigned *);
+void journal_scale(struct song *, unsigned, unsigned);
+void journal_tnew(struct song *, struct songtrk *);
+void journal_tdel(struct song *, struct songtrk *);
+void journal_mute(struct song *, struct songtrk *);
+void journal_filt(struct song *, struct filt *);
+void journal_fnew(struct song *, struct songfilt *);
+void journal_fdel(struct song *, struct songfilt *);
+void journal_cnew(struct song *, struct songchan *);
+void journal_cadd(struct song *, struct songchan *);
+void journal_cdel(struct song *, struct songchan *);
+void journal_sx(struct song *, struct songsx *);
+void journal_xnew(struct song *, struct songsx *);
+void journal_xdel(struct song *, struct songsx *);
+
+int journal_mdep_open(char *, unsigned long *);
+unsigned journal_mdep_reset(int);
+unsigned journal_mdep_write(int, unsigned char *, unsigned);
+void journal_mdep_sync(int);
+void journal_mdep_close(int);
+
+#endif /* MIDISH_JOURNAL_H */
@@ -22,6 +22,8 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include <dirent.h>
 #ifdef __APPLE__
 #include <mach/mach_time.h>
@@ -45,6 +47,14 @@
 #include "exec.h"
 #include "tty.h"
 #include "utils.h"
+#include "trace.h"
+#include "stream.h"
+#include "batch.h"
+#include "bgsave.h"
+#include "saveload.h"
+#include "journal.h"
+#include "data.h"
+#include "str.h"
 
 #define TIMER_USEC	1000
 
@@ -57,13 +67,16 @@
 #endif
 
 #define MIDI_BUFSIZE	1024
-#define MAXFDS		(DEFAULT_MAXNDEVS + 1)
+#define MAXFDS		(DEFAULT_MAXNDEVS + 2)
 
 volatile sig_atomic_t cons_quit = 0, resize_flag = 0, cont_flag = 0;
 struct timespec ts, ts_last;
 
 int cons_eof, cons_isatty;
 
+int bgsave_mdep_fd = -1;		/* status pipe of the save process */
+pid_t bgsave_mdep_pid;
+
 #if defined(__APPLE__) && !defined(CLOCK_MONOTONIC)
 #define CLOCK_MONOTONIC 0
 
@@ -168,7 +181,7 @@ mux_mdep_wait(int docons)
 {
 	int i, res, revents;
 	nfds_t nfds;
-	struct pollfd *pfd, *tty_pfds, pfds[MAXFDS];
+	struct pollfd *pfd, *tty_pfds, *bg_pfd, pfds[MAXFDS];
 	struct mididev *dev;
 	unsigned char midibuf[MIDI_BUFSIZE];
 	long long delta_nsec;
@@ -194,6 +207,13 @@ mux_mdep_wait(int docons)
 		nfds += dev->ops->pollfd(dev, pfd, POLLIN);
 		dev->pfd = pfd;
 	}
+	if (bgsave_mdep_fd >= 0) {
+		bg_pfd = &pfds[nfds++];
+		bg_pfd->fd = bgsave_mdep_fd;
+		bg_pfd->events = POLLIN;
+		bg_pfd->revents = 0;
+	} else
+		bg_pfd = NULL;
 	if (cons_quit) {
 		fprintf(stderr, "\n--interrupt--\n");
 		cons_quit = 0;
@@ -269,6 +289,8 @@ mux_mdep_wait(int docons)
 			}
 		}
 	}
+	if (bg_pfd && (bg_pfd->revents & (POLLIN | POLLHUP)))
+		bgsave_wait();
 	log_flush();
 	if (tty_pfds) {
 		if (cons_isatty) {
@@ -306,6 +328,8 @@ mux_sleep(unsigned millisecs)
 	int res, delta_msec;
 	struct timespec ts;
 
+	if (mux_offline)
+		return;
 	if (clock_gettime(CLOCK_MONOTONIC, &ts_last) < 0) {
 		log_perror("mux_sleep: clock_gettime");
 		exit(1);
@@ -337,6 +361,446 @@ mux_sleep(unsigned millisecs)
 	}
 }
 
+/*
+ * return the value of the monotonic clock, in microseconds; used to
+ * time-stamp trace entries
+ */
+unsigned long
+trace_mdep_gettime(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
+		log_perror("trace_mdep_gettime: clock_gettime");
+		panic();
+	}
+	return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+/*
+ * map the given file read-only in memory and return its size and
+ * modification time, return NULL on error
+ */
+unsigned char *
+stream_mdep_map(char *path, size_t *size, unsigned long *mtime)
+{
+	struct stat sb;
+	void *addr;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		log_perror(path);
+		return NULL;
+	}
+	if (fstat(fd, &sb) < 0) {
+		log_perror(path);
+		close(fd);
+		return NULL;
+	}
+	if (sb.st_size == 0) {
+		log_puts(path);
+		log_puts(": empty file\n");
+		close(fd);
+		return NULL;
+	}
+	addr = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		log_perror(path);
+		return NULL;
+	}
+	*size = sb.st_size;
+	*mtime = sb.st_mtime;
+	return addr;
+}
+
+/*
+ * unmap a file mapped with stream_mdep_map()
+ */
+void
+stream_mdep_unmap(unsigned char *addr, size_t size)
+{
+	if (munmap(addr, size) < 0)
+		log_perror("stream_mdep_unmap");
+}
+
+/*
+ * compare file names, for qsort()
+ */
+int
+batch_mdep_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char **)a, *(char **)b);
+}
+
+/*
+ * return true if the file name has a standard MIDI file extension
+ */
+unsigned
+batch_mdep_issmf(char *name)
+{
+	static char *ext[] = {".mid", ".MID", ".midi", ".MIDI", ".smf", NULL};
+	size_t len, elen;
+	char **e;
+
+	len = strlen(name);
+	for (e = ext; *e != NULL; e++) {
+		elen = strlen(*e);
+		if (len > elen && strcmp(name + len - elen, *e) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * return the sorted list of standard MIDI files in the given
+ * directory, or NULL on error
+ */
+struct data *
+batch_mdep_dir(char *path)
+{
+	char name[PATH_MAX], **names, **p;
+	struct dirent *dent;
+	struct stat sb;
+	struct data *list;
+	unsigned i, n, maxn;
+	DIR *dirp;
+
+	dirp = opendir(path);
+	if (dirp == NULL) {
+		log_perror(path);
+		return NULL;
+	}
+	n = 0;
+	maxn = 64;
+	names = xmalloc(maxn * sizeof(char *), "batch_dir");
+	while ((dent = readdir(dirp)) != NULL) {
+		if (!batch_mdep_issmf(dent->d_name))
+			continue;
+		if (snprintf(name, PATH_MAX, "%s/%s", path, dent->d_name) >=
+		    PATH_MAX)
+			continue;
+		if (stat(name, &sb) < 0 || !S_ISREG(sb.st_mode))
+			continue;
+		if (n == maxn) {
+			p = xmalloc(2 * maxn * sizeof(char *), "batch_dir");
+			memcpy(p, names, maxn * sizeof(char *));
+			xfree(names);
+			names = p;
+			maxn *= 2;
+		}
+		names[n++] = str_new(name);
+	}
+	closedir(dirp);
+	qsort(names, n, sizeof(char *), batch_mdep_cmp);
+	list = data_newlist(NULL);
+	for (i = 0; i < n; i++) {
+		data_listadd(list, data_newstring(names[i]));
+		str_delete(names[i]);
+	}
+	xfree(names);
+	return list;
+}
+
+/*
+ * return the number of processors available
+ */
+unsigned
+batch_mdep_ncpu(void)
+{
+	long n;
+
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+	return (n > 0) ? n : 1;
+}
+
+/*
+ * fork the given number of processes running the given routine, each
+ * with its own pipe to send its results. Its arguments are the process
+ * number and the write end of the pipe. Store the data sent by each
+ * process in the given arrays and return 1, or return 0 on failure.
+ * Used to convert files in parallel and to serialize large songs
+ */
+unsigned
+batch_mdep_run(unsigned n, void (*work)(void *, unsigned, int), void *arg,
+    unsigned char **data, unsigned *len)
+{
+	struct pollfd *pfds;
+	int fds[2], *rfd;
+	pid_t *pid;
+	unsigned *size, *idx;
+	unsigned char *buf;
+	unsigned i, k, nfds, nrun, ok;
+	ssize_t res;
+
+	pfds = xmalloc(n * sizeof(struct pollfd), "batch_mdep");
+	rfd = xmalloc(n * sizeof(int), "batch_mdep");
+	pid = xmalloc(n * sizeof(pid_t), "batch_mdep");
+	size = xmalloc(n * sizeof(unsigned), "batch_mdep");
+	idx = xmalloc(n * sizeof(unsigned), "batch_mdep");
+	log_flush();
+	fflush(stdout);
+	ok = 1;
+	for (nrun = 0; nrun < n; nrun++) {
+		if (pipe(fds) < 0) {
+			log_perror("batch_mdep_run: pipe");
+			ok = 0;
+			break;
+		}
+		pid[nrun] = fork();
+		if (pid[nrun] < 0) {
+			log_perror("batch_mdep_run: fork");
+			close(fds[0]);
+			close(fds[1]);
+			ok = 0;
+			break;
+		}
+		if (pid[nrun] == 0) {
+			for (k = 0; k < nrun; k++)
+				close(rfd[k]);
+			close(fds[0]);
+			work(arg, nrun, fds[1]);
+			close(fds[1]);
+			log_flush();
+			fflush(stdout);
+			_exit(0);
+		}
+		close(fds[1]);
+		rfd[nrun] = fds[0];
+		size[nrun] = 0x10000;
+		data[nrun] = xmalloc(size[nrun], "batch_mdep");
+		len[nrun] = 0;
+	}
+
+	/*
+	 * read all pipes at once, as processes block once their
+	 * pipe is full
+	 */
+	while (ok) {
+		nfds = 0;
+		for (i = 0; i < nrun; i++) {
+			if (rfd[i] < 0)
+				continue;
+			pfds[nfds].fd = rfd[i];
+			pfds[nfds].events = POLLIN;
+			idx[nfds++] = i;
+		}
+		if (nfds == 0)
+			break;
+		if (poll(pfds, nfds, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			log_perror("batch_mdep_run: poll");
+			ok = 0;
+			break;
+		}
+		for (k = 0; k < nfds; k++) {
+			if (!(pfds[k].revents & (POLLIN | POLLHUP)))
+				continue;
+			i = idx[k];
+			if (len[i] == size[i]) {
+				buf = xmalloc(2 * size[i], "batch_mdep");
+				memcpy(buf, data[i], len[i]);
+				xfree(data[i]);
+				data[i] = buf;
+				size[i] *= 2;
+			}
+			res = read(rfd[i], data[i] + len[i], size[i] - len[i]);
+			if (res < 0) {
+				if (errno == EINTR)
+					continue;
+				log_perror("batch_mdep_run: read");
+				ok = 0;
+				break;
+			}
+			if (res == 0) {
+				close(rfd[i]);
+				rfd[i] = -1;
+			} else
+				len[i] += res;
+		}
+	}
+	for (i = 0; i < nrun; i++) {
+		if (rfd[i] >= 0)
+			close(rfd[i]);
+		while (waitpid(pid[i], NULL, 0) < 0 && errno == EINTR)
+			; /* nothing */
+		if (!ok)
+			xfree(data[i]);
+	}
+	xfree(idx);
+	xfree(size);
+	xfree(pid);
+	xfree(rfd);
+	xfree(pfds);
+	return ok;
+}
+
+/*
+ * send data to the parent process, return 0 on error
+ */
+unsigned
+batch_mdep_write(int fd, void *buf, unsigned len)
+{
+	unsigned char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			log_perror("batch_mdep_write");
+			return 0;
+		}
+		p += n;
+		len -= n;
+	}
+	return 1;
+}
+
+/*
+ * fork a process running the given routine, which returns 1 on
+ * success. Its result is sent back through a pipe, whose read end
+ * becomes readable once the process exits
+ */
+unsigned
+bgsave_mdep_start(unsigned (*work)(void *), void *arg)
+{
+	int fds[2];
+	unsigned char res;
+
+	if (pipe(fds) < 0) {
+		log_perror("bgsave_mdep_start: pipe");
+		return 0;
+	}
+	log_flush();
+	fflush(stdout);
+	bgsave_mdep_pid = fork();
+	if (bgsave_mdep_pid < 0) {
+		log_perror("bgsave_mdep_start: fork");
+		close(fds[0]);
+		close(fds[1]);
+		return 0;
+	}
+	if (bgsave_mdep_pid == 0) {
+		close(fds[0]);
+		res = work(arg);
+		log_flush();
+		fflush(stdout);
+		if (write(fds[1], &res, 1) < 0) {
+			log_perror("bgsave_mdep_start: write");
+			log_flush();
+		}
+		_exit(0);
+	}
+	close(fds[1]);
+	bgsave_mdep_fd = fds[0];
+	return 1;
+}
+
+/*
+ * wait for the process started by bgsave_mdep_start() to exit, and
+ * return its result
+ */
+unsigned
+bgsave_mdep_wait(void)
+{
+	unsigned char res;
+	ssize_t n;
+
+	for (;;) {
+		n = read(bgsave_mdep_fd, &res, 1);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			log_perror("bgsave_mdep_wait: read");
+		break;
+	}
+	close(bgsave_mdep_fd);
+	bgsave_mdep_fd = -1;
+	while (waitpid(bgsave_mdep_pid, NULL, 0) < 0 && errno == EINTR)
+		; /* nothing */
+	return n == 1 && res;
+}
+
+/*
+ * open (or create) the journal file and return its current size,
+ * return -1 on error
+ */
+int
+journal_mdep_open(char *path, unsigned long *size)
+{
+	struct stat sb;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0666);
+	if (fd < 0) {
+		log_perror(path);
+		return -1;
+	}
+	if (fstat(fd, &sb) < 0) {
+		log_perror(path);
+		close(fd);
+		return -1;
+	}
+	*size = sb.st_size;
+	return fd;
+}
+
+/*
+ * discard the contents of the journal
+ */
+unsigned
+journal_mdep_reset(int fd)
+{
+	if (ftruncate(fd, 0) < 0) {
+		log_perror("journal_mdep_reset");
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * append the given bytes to the journal, return 0 on error
+ */
+unsigned
+journal_mdep_write(int fd, unsigned char *buf, unsigned len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			log_perror("journal_mdep_write");
+			return 0;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 1;
+}
+
+/*
+ * make sure data written so far is on disk
+ */
+void
+journal_mdep_sync(int fd)
+{
+	if (fsync(fd) < 0)
+		log_perror("journal_mdep_sync");
+}
+
+void
+journal_mdep_close(int fd)
+{
+	if (close(fd) < 0)
+		log_perror("journal_mdep_close");
+}
+
 void
 cons_mdep_sigint(int s)
 {
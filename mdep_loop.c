@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * in-process loopback devices: bytes written to a loopback device
+ * are read back as input of a loopback device (itself by default),
+ * allowing to measure latency and throughput without hardware. The
+ * path has the form:
+ *
+ *	loop[:unit[:delay]]
+ *
+ * where "unit" is the device number receiving the output and "delay"
+ * the transmission delay in milliseconds. If the output bitrate of
+ * the sending device is set (see dbitrate), bytes arrive at that
+ * rate.
+ *
+ * each device owns a pipe, bytes are queued with their arrival
+ * time on the receiving device and moved to the pipe when they are
+ * due, which wakes up the poll() loop.
+ */
+#include <sys/types.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include "utils.h"
+#include "defs.h"
+#include "cons.h"
+#include "mididev.h"
+#include "mux.h"
+
+#define LOOP_QLEN	0x1000		/* max bytes in transit */
+
+struct loop {
+	struct mididev mididev;		/* device stuff */
+	unsigned dst;			/* unit receiving the output */
+	unsigned long delay;		/* in 24th of microsecond */
+	int fd[2];			/* pipe read & write ends */
+	unsigned long qlast;		/* arrival time of last byte */
+	unsigned qstart, qused;		/* queue of bytes in transit */
+	unsigned char qbuf[LOOP_QLEN];
+	unsigned long qtime[LOOP_QLEN];
+	unsigned ndrop;			/* bytes dropped (queue full) */
+};
+
+void	 loop_open(struct mididev *);
+unsigned loop_read(struct mididev *, unsigned char *, unsigned);
+unsigned loop_write(struct mididev *, unsigned char *, unsigned);
+unsigned loop_nfds(struct mididev *);
+unsigned loop_pollfd(struct mididev *, struct pollfd *, int);
+int	 loop_revents(struct mididev *, struct pollfd *);
+void	 loop_close(struct mididev *);
+void	 loop_del(struct mididev *);
+
+struct devops loop_ops = {
+	loop_open,
+	loop_read,
+	loop_write,
+	loop_nfds,
+	loop_pollfd,
+	loop_revents,
+	loop_close,
+	loop_del
+};
+
+/*
+ * return true if the given path designates a loopback device
+ */
+unsigned
+loop_ispath(char *path)
+{
+	if (path == NULL)
+		return 0;
+	if (path[0] != 'l' || path[1] != 'o' || path[2] != 'o' || path[3] != 'p')
+		return 0;
+	return path[4] == '\0' || path[4] == ':';
+}
+
+/*
+ * parse a decimal number, return a pointer to the first character
+ * after it or NULL if there's no number
+ */
+char *
+loop_getnum(char *p, unsigned long max, unsigned long *res)
+{
+	unsigned long val;
+
+	if (*p < '0' || *p > '9')
+		return NULL;
+	val = 0;
+	while (*p >= '0' && *p <= '9') {
+		val = 10 * val + (*p - '0');
+		if (val > max)
+			return NULL;
+		p++;
+	}
+	*res = val;
+	return p;
+}
+
+struct mididev *
+loop_new(char *path, unsigned mode)
+{
+	struct loop *dev;
+	unsigned long dst, delay;
+	char *p;
+
+	dst = DEFAULT_MAXNDEVS;
+	delay = 0;
+	p = path + 4;
+	if (*p == ':') {
+		p++;
+		if (*p != ':') {
+			p = loop_getnum(p, DEFAULT_MAXNDEVS - 1, &dst);
+			if (p == NULL) {
+				cons_err("bad unit in loopback device path");
+				return NULL;
+			}
+		}
+		if (*p == ':') {
+			p = loop_getnum(p + 1, 10000, &delay);
+			if (p == NULL) {
+				cons_err("loopback delay must be in the 0..10000ms range");
+				return NULL;
+			}
+		}
+		if (*p != '\0') {
+			cons_err("loopback device path must be loop[:unit[:delay]]");
+			return NULL;
+		}
+	}
+	dev = xmalloc(sizeof(struct loop), "loop");
+	mididev_init(&dev->mididev, &loop_ops, mode);
+	dev->dst = dst;
+	dev->delay = delay * 24000;
+	dev->fd[0] = dev->fd[1] = -1;
+	dev->ndrop = 0;
+	return (struct mididev *)&dev->mididev;
+}
+
+void
+loop_del(struct mididev *addr)
+{
+	struct loop *dev = (struct loop *)addr;
+
+	mididev_done(&dev->mididev);
+	xfree(dev);
+}
+
+void
+loop_open(struct mididev *addr)
+{
+	struct loop *dev = (struct loop *)addr;
+	int i;
+
+	if (pipe(dev->fd) < 0) {
+		log_perror("loop_open: pipe");
+		dev->fd[0] = dev->fd[1] = -1;
+		dev->mididev.eof = 1;
+		return;
+	}
+	for (i = 0; i < 2; i++) {
+		if (fcntl(dev->fd[i], F_SETFL, O_NONBLOCK) < 0)
+			log_perror("loop_open: fcntl");
+	}
+	dev->qstart = dev->qused = 0;
+	dev->qlast = 0;
+}
+
+void
+loop_close(struct mididev *addr)
+{
+	struct loop *dev = (struct loop *)addr;
+	int i;
+
+	if (dev->ndrop > 0) {
+		log_puts("loop: dev ");
+		log_putu(dev->mididev.unit);
+		log_puts(": ");
+		log_putu(dev->ndrop);
+		log_puts(" bytes dropped\n");
+		dev->ndrop = 0;
+	}
+	for (i = 0; i < 2; i++) {
+		if (dev->fd[i] < 0)
+			continue;
+		(void)close(dev->fd[i]);
+		dev->fd[i] = -1;
+	}
+}
+
+/*
+ * move to the pipe bytes whose arrival time is reached
+ */
+void
+loop_deliver(struct loop *dev)
+{
+	unsigned long now = mux_wallclock;
+	unsigned char buf[LOOP_QLEN];
+	unsigned i, n;
+	ssize_t res;
+
+	n = 0;
+	i = dev->qstart;
+	while (n < dev->qused && (long)(dev->qtime[i] - now) <= 0) {
+		buf[n++] = dev->qbuf[i];
+		i = (i + 1) & (LOOP_QLEN - 1);
+	}
+	if (n == 0)
+		return;
+	res = write(dev->fd[1], buf, n);
+	if (res < 0) {
+		if (errno != EAGAIN)
+			log_perror("loop_deliver: write");
+		return;
+	}
+	dev->qstart = (dev->qstart + res) & (LOOP_QLEN - 1);
+	dev->qused -= res;
+}
+
+unsigned
+loop_read(struct mididev *addr, unsigned char *buf, unsigned count)
+{
+	struct loop *dev = (struct loop *)addr;
+	ssize_t res;
+
+	res = read(dev->fd[0], buf, count);
+	if (res < 0) {
+		if (errno == EAGAIN)
+			return 0;
+		log_perror("loop_read: read");
+		dev->mididev.eof = 1;
+		return 0;
+	}
+	return res;
+}
+
+/*
+ * queue bytes on the receiving device with their arrival time;
+ * bytes sent to a device not opened for input are discarded
+ */
+unsigned
+loop_write(struct mididev *addr, unsigned char *buf, unsigned count)
+{
+	struct loop *dev = (struct loop *)addr, *rx;
+	struct mididev *dst;
+	unsigned long t, bytelen;
+	unsigned i;
+
+	dst = (dev->dst < DEFAULT_MAXNDEVS) ?
+	    mididev_byunit[dev->dst] : &dev->mididev;
+	if (dst == NULL || dst->ops != &loop_ops ||
+	    !(dst->mode & MIDIDEV_MODE_IN) || dst->eof)
+		return count;
+	rx = (struct loop *)dst;
+	if (rx->fd[1] < 0)
+		return count;
+	bytelen = dev->mididev.obitrate ?
+	    MIDIDEV_BYTELEN(dev->mididev.obitrate) : 0;
+	t = mux_wallclock + dev->delay;
+	if (rx->qused > 0 && (long)(rx->qlast - t) > 0)
+		t = rx->qlast;
+	for (i = 0; i < count; i++) {
+		if (rx->qused == LOOP_QLEN) {
+			rx->ndrop += count - i;
+			break;
+		}
+		t += bytelen;
+		rx->qbuf[(rx->qstart + rx->qused) & (LOOP_QLEN - 1)] = buf[i];
+		rx->qtime[(rx->qstart + rx->qused) & (LOOP_QLEN - 1)] = t;
+		rx->qused++;
+	}
+	rx->qlast = t;
+	loop_deliver(rx);
+	return count;
+}
+
+unsigned
+loop_nfds(struct mididev *addr)
+{
+	return 1;
+}
+
+unsigned
+loop_pollfd(struct mididev *addr, struct pollfd *pfd, int events)
+{
+	struct loop *dev = (struct loop *)addr;
+
+	loop_deliver(dev);
+	pfd->fd = dev->fd[0];
+	pfd->events = events;
+	pfd->revents = 0;
+	return 1;
+}
+
+int
+loop_revents(struct mididev *addr, struct pollfd *pfd)
+{
+	return pfd->revents;
+}
@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * replay devices: input only devices feeding back the contents of a
+ * file created with the "dcapture" function, with its original
+ * timing. The path has the form:
+ *
+ *	replay:[speed:]filename
+ *
+ * where "speed" is the integer speed factor, 1 by default. If it's
+ * 0, the file is fed as fast as possible.
+ *
+ * as for loopback devices, records are moved to a pipe when they are
+ * due, so the poll() loop is woken up and the bytes go through
+ * mididev_inputcb() as any other input.
+ *
+ * the pipe is closed after the last record, and once all bytes are
+ * read, the number of bytes and the time elapsed since the first
+ * record was sent are displayed, so with speed 0 the time midish
+ * takes to process the file can be measured.
+ */
+#include <sys/types.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include "utils.h"
+#include "cons.h"
+#include "mididev.h"
+#include "mux.h"
+#include "str.h"
+#include "capture.h"
+#include "trace.h"
+
+#define REPLAY_MAXSPEED	1000
+
+struct replay {
+	struct mididev mididev;		/* device stuff */
+	char *path;			/* capture file */
+	unsigned speed;			/* speed factor, 0 = no timing */
+	FILE *fp;			/* capture file, NULL if done */
+	int fd[2];			/* pipe read & write ends */
+	unsigned started;		/* 'start' is set */
+	unsigned long start;		/* wall clock of first delivery */
+	unsigned long pos;		/* time of current record, in us */
+	unsigned long ustart;		/* time of first delivery, in us */
+	unsigned long nread;		/* bytes read from the pipe */
+	unsigned char buf[CAPTURE_MAXLEN];
+	unsigned len, off;		/* current record, bytes sent */
+};
+
+void	 replay_open(struct mididev *);
+unsigned replay_read(struct mididev *, unsigned char *, unsigned);
+unsigned replay_write(struct mididev *, unsigned char *, unsigned);
+unsigned replay_nfds(struct mididev *);
+unsigned replay_pollfd(struct mididev *, struct pollfd *, int);
+int	 replay_revents(struct mididev *, struct pollfd *);
+void	 replay_close(struct mididev *);
+void	 replay_del(struct mididev *);
+
+struct devops replay_ops = {
+	replay_open,
+	replay_read,
+	replay_write,
+	replay_nfds,
+	replay_pollfd,
+	replay_revents,
+	replay_close,
+	replay_del
+};
+
+/*
+ * return true if the given path designates a replay device
+ */
+unsigned
+replay_ispath(char *path)
+{
+	char *p = "replay:";
+
+	if (path == NULL)
+		return 0;
+	while (*p != '\0') {
+		if (*path++ != *p++)
+			return 0;
+	}
+	return 1;
+}
+
+struct mididev *
+replay_new(char *path, unsigned mode)
+{
+	struct replay *dev;
+	unsigned speed;
+	char *p;
+
+	if (mode != MIDIDEV_MODE_IN) {
+		cons_err("replay devices are read-only");
+		return NULL;
+	}
+	path += 7;
+	speed = 1;
+	for (p = path; *p >= '0' && *p <= '9'; p++)
+		;
+	if (p != path && *p == ':') {
+		speed = 0;
+		while (path != p) {
+			speed = 10 * speed + (*path++ - '0');
+			if (speed > REPLAY_MAXSPEED) {
+				cons_err("replay speed must be in the 0..1000 range");
+				return NULL;
+			}
+		}
+		path++;
+	}
+	if (*path == '\0') {
+		cons_err("replay device path must be replay:[speed:]filename");
+		return NULL;
+	}
+	dev = xmalloc(sizeof(struct replay), "replay");
+	mididev_init(&dev->mididev, &replay_ops, mode);
+	dev->path = str_new(path);
+	dev->speed = speed;
+	dev->fp = NULL;
+	dev->fd[0] = dev->fd[1] = -1;
+	return (struct mididev *)&dev->mididev;
+}
+
+void
+replay_del(struct mididev *addr)
+{
+	struct replay *dev = (struct replay *)addr;
+
+	mididev_done(&dev->mididev);
+	str_delete(dev->path);
+	xfree(dev);
+}
+
+/*
+ * read the next record, and close the file at the end
+ */
+void
+replay_next(struct replay *dev)
+{
+	unsigned long delta;
+
+	if (!capture_getrec(dev->fp, &delta, dev->buf, &dev->len)) {
+		if (ferror(dev->fp))
+			log_perror(dev->path);
+		fclose(dev->fp);
+		dev->fp = NULL;
+		(void)close(dev->fd[1]);
+		dev->fd[1] = -1;
+		return;
+	}
+	dev->pos += delta;
+	dev->off = 0;
+}
+
+void
+replay_open(struct mididev *addr)
+{
+	struct replay *dev = (struct replay *)addr;
+	int i;
+
+	dev->fp = fopen(dev->path, "rb");
+	if (dev->fp == NULL) {
+		log_perror(dev->path);
+		dev->mididev.eof = 1;
+		return;
+	}
+	if (!capture_gethdr(dev->fp)) {
+		log_puts(dev->path);
+		log_puts(": not a capture file\n");
+		fclose(dev->fp);
+		dev->fp = NULL;
+		dev->mididev.eof = 1;
+		return;
+	}
+	if (pipe(dev->fd) < 0) {
+		log_perror("replay_open: pipe");
+		fclose(dev->fp);
+		dev->fp = NULL;
+		dev->fd[0] = dev->fd[1] = -1;
+		dev->mididev.eof = 1;
+		return;
+	}
+	for (i = 0; i < 2; i++) {
+		if (fcntl(dev->fd[i], F_SETFL, O_NONBLOCK) < 0)
+			log_perror("replay_open: fcntl");
+	}
+	dev->started = 0;
+	dev->pos = 0;
+	dev->nread = 0;
+	replay_next(dev);
+}
+
+void
+replay_close(struct mididev *addr)
+{
+	struct replay *dev = (struct replay *)addr;
+	int i;
+
+	if (dev->fp) {
+		fclose(dev->fp);
+		dev->fp = NULL;
+	}
+	for (i = 0; i < 2; i++) {
+		if (dev->fd[i] < 0)
+			continue;
+		(void)close(dev->fd[i]);
+		dev->fd[i] = -1;
+	}
+}
+
+/*
+ * move to the pipe records whose time is reached
+ */
+void
+replay_deliver(struct replay *dev)
+{
+	unsigned long due;
+	ssize_t res;
+
+	/*
+	 * mux_open() resets the wall clock after opening devices, so
+	 * start counting when the first record is about to be sent
+	 */
+	if (!dev->started) {
+		dev->start = mux_wallclock;
+		dev->ustart = trace_mdep_gettime();
+		dev->started = 1;
+	}
+	while (dev->fp != NULL) {
+		if (dev->speed > 0) {
+			due = dev->start + dev->pos / dev->speed * 24;
+			if ((long)(due - mux_wallclock) > 0)
+				return;
+		}
+		res = write(dev->fd[1], dev->buf + dev->off,
+		    dev->len - dev->off);
+		if (res < 0) {
+			if (errno != EAGAIN)
+				log_perror("replay_deliver: write");
+			return;
+		}
+		dev->off += res;
+		if (dev->off < dev->len)
+			return;
+		replay_next(dev);
+	}
+}
+
+unsigned
+replay_read(struct mididev *addr, unsigned char *buf, unsigned count)
+{
+	struct replay *dev = (struct replay *)addr;
+	ssize_t res;
+
+	res = read(dev->fd[0], buf, count);
+	if (res < 0) {
+		if (errno == EAGAIN)
+			return 0;
+		log_perror("replay_read: read");
+		dev->mididev.eof = 1;
+		return 0;
+	}
+	if (res == 0) {
+		log_putu(dev->mididev.unit);
+		log_puts(": end of capture, ");
+		log_putu(dev->nread);
+		log_puts(" bytes in ");
+		log_putu(trace_mdep_gettime() - dev->ustart);
+		log_puts(" us\n");
+		dev->mididev.eof = 1;
+		return 0;
+	}
+	dev->nread += res;
+	return res;
+}
+
+unsigned
+replay_write(struct mididev *addr, unsigned char *buf, unsigned count)
+{
+	return count;
+}
+
+unsigned
+replay_nfds(struct mididev *addr)
+{
+	return 1;
+}
+
+unsigned
+replay_pollfd(struct mididev *addr, struct pollfd *pfd, int events)
+{
+	struct replay *dev = (struct replay *)addr;
+
+	replay_deliver(dev);
+	pfd->fd = dev->fd[0];
+	pfd->events = events;
+	pfd->revents = 0;
+	return 1;
+}
+
+/*
+ * the pipe is hung-up once the capture is done, but bytes may still be
+ * in it, so handle the hang-up as input and let replay_read() detect
+ * the end of the pipe
+ */
+int
+replay_revents(struct mididev *addr, struct pollfd *pfd)
+{
+	if (pfd->revents & POLLHUP)
+		return (pfd->revents & ~POLLHUP) | POLLIN;
+	return pfd->revents;
+}
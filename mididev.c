@@ -41,6 +41,14 @@
  *   a voice event, clock start, clock stop, clock tick and midi
  *   active sense.
  *
+ * if the output bitrate of the device is set, the time needed to
+ * transmit bytes on the wire is estimated, and controller-like
+ * messages (controllers, bend, aftertouch) are deferred until the
+ * wire is free. Deferred messages for the same parameter are merged,
+ * and notes are sent before them. Messages whose order matters
+ * (bank select, RPN/NRPN, switches, program changes, sysex) first
+ * send all deferred messages of the channel.
+ *
  */
 
 #include "utils.h"
@@ -54,6 +62,8 @@
 #include "mux.h"
 #include "timo.h"
 #include "conv.h"
+#include "trace.h"
+#include "capture.h"
 
 #define MIDI_SYSEXSTART	0xf0
 #define MIDI_QFRAME	0xf1
@@ -73,9 +83,25 @@ unsigned mididev_debug = 0;
 unsigned mididev_evlen[] = { 2, 2, 2, 2, 1, 1, 2, 0 };
 #define MIDIDEV_EVLEN(status) (mididev_evlen[((status) >> 4) & 7])
 
+/*
+ * max number of voice events decoded before passing them to the mux
+ */
+#define MIDIDEV_NIEV	64
+
+/*
+ * class of each input byte, used by the input parser
+ */
+#define MIDIDEV_IC_DATA		0	/* data byte */
+#define MIDIDEV_IC_STATUS	1	/* voice or system common status */
+#define MIDIDEV_IC_REALTIME	2	/* real-time, may interleave */
+unsigned char mididev_iclass[256];
+
 struct mididev *mididev_list, *mididev_clksrc, *mididev_mtcsrc;
 struct mididev *mididev_byunit[DEFAULT_MAXNDEVS];
 
+void mididev_out(struct mididev *, unsigned);
+void mididev_outvoice(struct mididev *, unsigned, unsigned, unsigned);
+
 /*
  * initialize the mtc "parser" to a state, when a full message or 2 complete
  * frames are needed to lock to the master
@@ -250,6 +276,19 @@ mididev_init(struct mididev *o, struct devops *ops, unsigned mode)
 	o->isysex = NULL;
 	o->runst = 1;
 	o->sync = 0;
+	o->obitrate = 0;
+	o->owire = 0;
+	o->npend = 0;
+	o->odelay_sum = o->odelay_max = o->odelay_cnt = 0;
+	o->odeferred = o->omerged = 0;
+	o->stat.ibytes = o->stat.obytes = 0;
+	o->stat.iev = o->stat.oev = 0;
+	o->stat.isysex = o->stat.osysex = 0;
+	o->stat.nflush = o->stat.nshort = 0;
+	o->stat.ierr = 0;
+	o->nsnap = o->snapidx = 0;
+	o->snapto = MIDIDEV_SNAPLEN;
+	o->icap = NULL;
 }
 
 /*
@@ -261,6 +300,8 @@ mididev_done(struct mididev *o)
 {
 	if (mux_isopen)
 		mididev_close(o);
+	if (o->icap)
+		capture_delete(o->icap);
 }
 
 /*
@@ -273,6 +314,10 @@ mididev_open(struct mididev *o)
 	o->oused = 0;
 	o->istatus = o->ostatus = 0;
 	o->isysex = NULL;
+	o->owire = 0;
+	o->npend = 0;
+	o->nsnap = o->snapidx = 0;
+	o->snapto = MIDIDEV_SNAPLEN;
 	mtc_init(&o->imtc);
 	o->ops->open(o);
 }
@@ -283,11 +328,130 @@ mididev_open(struct mididev *o)
 void
 mididev_close(struct mididev *o)
 {
+	mididev_drain(o, -1);
 	mididev_flush(o);
 	o->ops->close(o);
 	o->eof = 1;
 }
 
+/*
+ * save the current counters in the ring of snapshots, called every
+ * MIDIDEV_SNAPLEN by the mux timer
+ */
+void
+mididev_snap(struct mididev *o)
+{
+	o->snap[o->snapidx] = o->stat;
+	o->snapidx = (o->snapidx + 1) % MIDIDEV_NSNAP;
+	if (o->nsnap < MIDIDEV_NSNAP)
+		o->nsnap++;
+	o->snapto = MIDIDEV_SNAPLEN;
+}
+
+/*
+ * fill the given structure with the number of bytes, events,
+ * etc... per second, computed since the oldest snapshot
+ */
+void
+mididev_getrate(struct mididev *o, struct mididev_stat *r)
+{
+	struct mididev_stat *s;
+	unsigned long ms;
+
+	/*
+	 * the last snapshot was taken MIDIDEV_SNAPLEN - snapto ago and
+	 * the oldest one nsnap - 1 periods before it
+	 */
+	ms = (o->nsnap == 0) ? 0 :
+	    (o->nsnap * MIDIDEV_SNAPLEN - o->snapto) / (24 * 1000);
+	if (ms == 0) {
+		r->ibytes = r->obytes = r->iev = r->oev = 0;
+		r->isysex = r->osysex = r->nflush = r->nshort = r->ierr = 0;
+		return;
+	}
+	s = &o->snap[o->nsnap < MIDIDEV_NSNAP ? 0 : o->snapidx];
+	r->ibytes = (o->stat.ibytes - s->ibytes) * 1000 / ms;
+	r->obytes = (o->stat.obytes - s->obytes) * 1000 / ms;
+	r->iev = (o->stat.iev - s->iev) * 1000 / ms;
+	r->oev = (o->stat.oev - s->oev) * 1000 / ms;
+	r->isysex = (o->stat.isysex - s->isysex) * 1000 / ms;
+	r->osysex = (o->stat.osysex - s->osysex) * 1000 / ms;
+	r->nflush = (o->stat.nflush - s->nflush) * 1000 / ms;
+	r->nshort = (o->stat.nshort - s->nshort) * 1000 / ms;
+	r->ierr = (o->stat.ierr - s->ierr) * 1000 / ms;
+}
+
+/*
+ * start recording input bytes in the given capture file, or stop
+ * recording if the path is NULL
+ */
+unsigned
+mididev_capture(struct mididev *o, char *path)
+{
+	struct capture *cap;
+
+	if (path != NULL) {
+		cap = capture_new(path);
+		if (cap == NULL)
+			return 0;
+	} else
+		cap = NULL;
+	if (o->icap)
+		capture_delete(o->icap);
+	o->icap = cap;
+	return 1;
+}
+
+/*
+ * account the given queue delay (time between the moment a message
+ * is queued and the moment it starts being sent on the wire)
+ */
+void
+mididev_delay(struct mididev *o, unsigned long delay)
+{
+	o->odelay_sum += delay;
+	o->odelay_cnt++;
+	if (o->odelay_max < delay)
+		o->odelay_max = delay;
+}
+
+/*
+ * move deferred messages to the output buffer as long as the wire
+ * isn't busy, then account the time needed to send the contents of
+ * the output buffer
+ */
+void
+mididev_sched(struct mididev *o)
+{
+	struct mididev_pend *p;
+	unsigned long now, bytelen, backlog;
+	unsigned i, j;
+
+	now = mux_wallclock;
+	bytelen = MIDIDEV_BYTELEN(o->obitrate);
+	if (o->owire < now)
+		o->owire = now;
+	backlog = o->owire - now + o->oused * bytelen;
+	for (i = 0; i < o->npend; i++) {
+		if (backlog >= MIDIDEV_WIRELAT ||
+		    o->oused + 3 > MIDIDEV_BUFLEN)
+			break;
+		p = &o->opend[i];
+		mididev_delay(o, now - p->stamp + backlog);
+		mididev_outvoice(o, p->status, p->data[0], p->data[1]);
+		backlog = o->owire - now + o->oused * bytelen;
+	}
+	if (i > 0) {
+		for (j = i; j < o->npend; j++)
+			o->opend[j - i] = o->opend[j];
+		o->npend -= i;
+	}
+	if (o->oused > 0) {
+		mididev_delay(o, o->owire - now);
+		o->owire += o->oused * bytelen;
+	}
+}
+
 /*
  * flush the given midi device
  */
@@ -299,6 +463,8 @@ mididev_flush(struct mididev *o)
 	unsigned i;
 
 	if (!o->eof) {
+		if (o->obitrate && mux_isopen)
+			mididev_sched(o);
 		if (mididev_debug && o->oused > 0) {
 			log_puts("mididev_flush: ");
 			log_putu(timo_abstime / 24);
@@ -313,10 +479,18 @@ mididev_flush(struct mididev *o)
 		}
 		todo = o->oused;
 		buf = o->obuf;
+		if (todo > 0) {
+			o->stat.nflush++;
+			if (trace_enabled)
+				trace_flush(o->unit, todo);
+		}
 		while (todo > 0) {
 			count = o->ops->write(o, buf, todo);
 			if (o->eof)
 				break;
+			if (count < todo)
+				o->stat.nshort++;
+			o->stat.obytes += count;
 			todo -= count;
 			buf += count;
 		}
@@ -327,14 +501,52 @@ mididev_flush(struct mididev *o)
 }
 
 /*
- * mididev_inputcb is called when midi data becomes available
- * it calls mux_evcb
+ * decode a complete voice message into the given event
+ */
+void
+mididev_idecode(struct mididev *o, struct ev *ev,
+    unsigned status, unsigned d0, unsigned d1)
+{
+	ev->cmd = status >> 4;
+	ev->dev = o->unit;
+	ev->ch = status & 0x0f;
+	if (ev->cmd == EV_NON && d1 == 0) {
+		ev->cmd = EV_NOFF;
+		ev->note_num = d0;
+		ev->note_vel = EV_NOFF_DEFAULTVEL;
+	} else if (ev->cmd == EV_BEND) {
+		ev->bend_val = (d1 << 7) + d0;
+	} else {
+		ev->v0 = d0;
+		ev->v1 = d1;
+	}
+}
+
+/*
+ * pass decoded events to the mux, must be called before any other
+ * mux callback so that the order of messages is preserved
+ */
+void
+mididev_ibatch(struct mididev *o, struct ev *iev, unsigned *niev)
+{
+	if (*niev > 0) {
+		mux_evcbv(o->unit, iev, *niev);
+		*niev = 0;
+	}
+}
+
+/*
+ * mididev_inputcb is called when midi data becomes available. The
+ * whole buffer is decoded at once: voice messages are stored in an
+ * array passed to the mux in a single batch, and sysex data is
+ * copied in spans of consecutive data bytes
  */
 void
 mididev_inputcb(struct mididev *o, unsigned char *buf, unsigned count)
 {
-	struct ev ev;
-	unsigned i, data;
+	struct ev iev[MIDIDEV_NIEV];
+	unsigned char *end, *span;
+	unsigned i, data, len, niev;
 
 	if (!(o->mode & MIDIDEV_MODE_IN)) {
 		log_puts("received data from output only device\n");
@@ -352,11 +564,64 @@ mididev_inputcb(struct mididev *o, unsigned char *buf, unsigned count)
 		}
 		log_puts("\n");
 	}
-	while (count != 0) {
-		data = *buf;
-		count--;
-		buf++;
-		if (data >= 0xf8) {
+	o->stat.ibytes += count;
+	if (o->icap)
+		capture_put(o->icap, buf, count);
+	niev = 0;
+	end = buf + count;
+	while (buf != end) {
+		data = *buf++;
+		switch (mididev_iclass[data]) {
+		case MIDIDEV_IC_DATA:
+			if (o->istatus == MIDI_SYSEXSTART) {
+				span = buf - 1;
+				while (buf != end && *buf < 0x80)
+					buf++;
+				sysex_addbuf(o->isysex, span, buf - span);
+				break;
+			}
+			if (o->istatus >= 0x80 && o->istatus < 0xf0) {
+				len = MIDIDEV_EVLEN(o->istatus);
+				/*
+				 * fast path: the whole message is in the
+				 * buffer, decode it in place
+				 */
+				if (o->icount == 0 && len == 2 &&
+				    buf != end && *buf < 0x80) {
+					mididev_idecode(o, iev + niev,
+					    o->istatus, data, *buf);
+					buf++;
+				} else {
+					o->idata[o->icount++] = data;
+					if (o->icount < len)
+						break;
+					o->icount = 0;
+					mididev_idecode(o, iev + niev, o->istatus,
+					    o->idata[0], o->idata[1]);
+				}
+				o->stat.iev++;
+				if (++niev == MIDIDEV_NIEV)
+					mididev_ibatch(o, iev, &niev);
+			} else if (o->istatus == MIDI_QFRAME) {
+				/*
+				 * NOTE: MIDI uses running status only for voice
+				 *	 events so, if you add new system common
+				 *	 messages here don't forget to reset the
+				 *	 running status
+				 */
+				mididev_ibatch(o, iev, &niev);
+				if (o == mididev_mtcsrc)
+					mtc_tick(&o->imtc, data);
+				o->istatus = 0;
+			} else if (o->istatus == 0) {
+				/*
+				 * data byte without status
+				 */
+				o->stat.ierr++;
+			}
+			break;
+		case MIDIDEV_IC_REALTIME:
+			mididev_ibatch(o, iev, &niev);
 			switch(data) {
 			case MIDI_TIC:
 				if (o == mididev_clksrc)
@@ -383,17 +648,20 @@ mididev_inputcb(struct mididev *o, unsigned char *buf, unsigned count)
 				}
 				break;
 			}
-		} else if (data >= 0x80) {
-			if (mididev_debug &&
-			    o->istatus >= 0x80 &&  o->icount > 0 &&
+			break;
+		default:
+			if (o->istatus >= 0x80 && o->icount > 0 &&
 			    o->icount < MIDIDEV_EVLEN(o->istatus)) {
 				/*
 				 * midi spec says messages can be aborted
 				 * by status byte, so don't trigger an error
 				 */
-				log_puts("mididev_inputcb: ");
-				log_putx(o->istatus);
-				log_puts(": skipped aborted message\n");
+				o->stat.ierr++;
+				if (mididev_debug) {
+					log_puts("mididev_inputcb: ");
+					log_putx(o->istatus);
+					log_puts(": skipped aborted message\n");
+				}
 			}
 			o->istatus = data;
 			o->icount = 0;
@@ -403,6 +671,7 @@ mididev_inputcb(struct mididev *o, unsigned char *buf, unsigned count)
 					if (mididev_debug)
 						log_puts("mididev_inputcb: previous sysex aborted\n");
 					sysex_del(o->isysex);
+					o->stat.ierr++;
 				}
 				o->isysex = sysex_new(o->unit);
 				sysex_add(o->isysex, data);
@@ -410,6 +679,8 @@ mididev_inputcb(struct mididev *o, unsigned char *buf, unsigned count)
 			case MIDI_SYSEXSTOP:
 				if (o->isysex) {
 					sysex_add(o->isysex, data);
+					o->stat.isysex++;
+					mididev_ibatch(o, iev, &niev);
 					if (o == mididev_mtcsrc)
 						mtc_full(&o->imtc, o->isysex);
 					mux_sysexcb(o->unit, o->isysex);
@@ -427,43 +698,14 @@ mididev_inputcb(struct mididev *o, unsigned char *buf, unsigned count)
 						log_puts("mididev_inputcb: current sysex aborted\n");
 					sysex_del(o->isysex);
 					o->isysex = NULL;
+					o->stat.ierr++;
 				}
 				break;
 			}
-		} else if (o->istatus >= 0x80 && o->istatus < 0xf0) {
-			o->idata[o->icount] = (unsigned char)data;
-			o->icount++;
-
-			if (o->icount == MIDIDEV_EVLEN(o->istatus)) {
-				o->icount = 0;
-				ev.cmd = o->istatus >> 4;
-				ev.dev = o->unit;
-				ev.ch = o->istatus & 0x0f;
-				if (ev.cmd == EV_NON && o->idata[1] == 0) {
-					ev.cmd = EV_NOFF;
-					ev.note_num = o->idata[0];
-					ev.note_vel = EV_NOFF_DEFAULTVEL;
-				} else if (ev.cmd == EV_BEND) {
-					ev.bend_val = ((unsigned)o->idata[1] << 7) + o->idata[0];
-				} else {
-					ev.v0 = o->idata[0];
-					ev.v1 = o->idata[1];
-				}
-				mux_evcb(o->unit, &ev);
-			}
-		} else if (o->istatus == MIDI_SYSEXSTART) {
-			sysex_add(o->isysex, data);
-		} else if (o->istatus == MIDI_QFRAME) {
-			/*
-			 * NOTE: MIDI uses running status only for voice events
-			 *	 so, if you add new system common messages
-			 *       here don't forget to reset the running status
-			 */
-			if (o == mididev_mtcsrc)
-				mtc_tick(&o->imtc, data);
-			o->istatus = 0;
+			break;
 		}
 	}
+	mididev_ibatch(o, iev, &niev);
 }
 
 /*
@@ -515,6 +757,108 @@ mididev_putack(struct mididev *o)
 		mididev_flush(o);
 }
 
+/*
+ * queue a voice message for sending, using running status if
+ * possible
+ */
+void
+mididev_outvoice(struct mididev *o, unsigned s, unsigned d0, unsigned d1)
+{
+	if (!o->runst || s != o->ostatus) {
+		o->ostatus = s;
+		mididev_out(o, s);
+	}
+	mididev_out(o, d0);
+	if (MIDIDEV_EVLEN(s) == 2)
+		mididev_out(o, d1);
+}
+
+/*
+ * return 1 if the given controller must not be reordered with respect
+ * to other messages of the same channel: bank select, data entry,
+ * switches, RPN/NRPN and channel mode messages, and 14-bit
+ * controllers
+ */
+unsigned
+mididev_isordered(struct mididev *o, unsigned num)
+{
+	if (num == BANK_HI || num == BANK_LO ||
+	    num == DATAENT_HI || num == DATAENT_LO ||
+	    (num >= 64 && num <= 69) ||
+	    (num >= 96 && num <= 101) ||
+	    num >= 120)
+		return 1;
+	if (num < 32)
+		return EVCTL_ISFINE(o->oxctlset, num) ? 1 : 0;
+	if (num < 64)
+		return EVCTL_ISFINE(o->oxctlset, num - 32) ? 1 : 0;
+	return 0;
+}
+
+/*
+ * send deferred messages of the given channel (all channels if
+ * negative), regardless of the wire usage
+ */
+void
+mididev_drain(struct mididev *o, int ch)
+{
+	struct mididev_pend *p;
+	unsigned i, j;
+
+	for (i = 0; i < o->npend;) {
+		p = &o->opend[i];
+		if (ch >= 0 && (p->status & 0x0f) != ch) {
+			i++;
+			continue;
+		}
+		if (o->oused + 3 > MIDIDEV_BUFLEN) {
+			/*
+			 * flushing may send deferred messages,
+			 * so start over
+			 */
+			mididev_flush(o);
+			i = 0;
+			continue;
+		}
+		mididev_delay(o, mux_wallclock - p->stamp);
+		mididev_outvoice(o, p->status, p->data[0], p->data[1]);
+		for (j = i + 1; j < o->npend; j++)
+			o->opend[j - 1] = o->opend[j];
+		o->npend--;
+	}
+}
+
+/*
+ * defer the given controller-like message; if there's already
+ * a deferred message for the same parameter, replace its value
+ */
+void
+mididev_defer(struct mididev *o, unsigned s, unsigned d0, unsigned d1)
+{
+	struct mididev_pend *p;
+	unsigned i, cmd;
+
+	cmd = s >> 4;
+	for (i = 0, p = o->opend; i < o->npend; i++, p++) {
+		if (p->status != s)
+			continue;
+		if (cmd == EV_CAT || cmd == EV_BEND || p->data[0] == d0) {
+			p->data[0] = d0;
+			p->data[1] = d1;
+			o->omerged++;
+			return;
+		}
+	}
+	if (o->npend == MIDIDEV_NPEND)
+		mididev_drain(o, -1);
+	p = &o->opend[o->npend++];
+	p->status = s;
+	p->data[0] = d0;
+	p->data[1] = d1;
+	p->stamp = mux_wallclock;
+	o->odeferred++;
+}
+
 /*
  * convert a voice event to byte stream and queue
  * it for sending
@@ -523,9 +867,12 @@ void
 mididev_putev(struct mididev *o, struct ev *ev)
 {
 	unsigned char *p;
-	unsigned s;
+	unsigned s, d0, d1;
 
 	if (EV_ISSX(ev)) {
+		o->stat.osysex++;
+		if (o->npend > 0)
+			mididev_drain(o, -1);
 		o->ostatus = 0;
 		p = evinfo[ev->cmd].pattern;
 		for (;;) {
@@ -553,40 +900,50 @@ mididev_putev(struct mididev *o, struct ev *ev)
 	if (!EV_ISVOICE(ev)) {
 		return;
 	}
+	o->stat.oev++;
 	if (ev->cmd == EV_NOFF) {
 		s = ev->ch + (EV_NON << 4);
-		if (!o->runst || s != o->ostatus) {
-			o->ostatus = s;
-			mididev_out(o, s);
-		}
-		mididev_out(o, ev->note_num);
-		mididev_out(o, 0);
+		d0 = ev->note_num;
+		d1 = 0;
 	} else if (ev->cmd == EV_BEND) {
 		s = ev->ch + (EV_BEND << 4);
-		if (!o->runst || s != o->ostatus) {
-			o->ostatus = s;
-			mididev_out(o, s);
-		}
-		mididev_out(o, ev->bend_val & 0x7f);
-		mididev_out(o, ev->bend_val >> 7);
+		d0 = ev->bend_val & 0x7f;
+		d1 = ev->bend_val >> 7;
 	} else {
 		s = ev->ch + (ev->cmd << 4);
-		if (!o->runst || s != o->ostatus) {
-			o->ostatus = s;
-			mididev_out(o, s);
-		}
-		mididev_out(o, ev->v0);
-		if (MIDIDEV_EVLEN(s) == 2) {
-			mididev_out(o, ev->v1);
+		d0 = ev->v0;
+		d1 = ev->v1;
+	}
+	if (o->obitrate && mux_isopen) {
+		switch (ev->cmd) {
+		case EV_NON:
+		case EV_NOFF:
+			break;
+		case EV_CTL:
+			if (mididev_isordered(o, d0)) {
+				mididev_drain(o, ev->ch);
+				break;
+			}
+			/* FALLTHROUGH */
+		case EV_KAT:
+		case EV_CAT:
+		case EV_BEND:
+			if (o->mode & MIDIDEV_MODE_OUT)
+				mididev_defer(o, s, d0, d1);
+			goto end;
+		default:
+			mididev_drain(o, ev->ch);
 		}
 	}
+	mididev_outvoice(o, s, d0, d1);
 end:
 	if (o->sync)
 		mididev_flush(o);
 }
 
 /*
- * queue raw data for sending
+ * queue raw data for sending. Messages may be sent in several chunks,
+ * so count a sysex message each time its first byte is queued
  */
 void
 mididev_sendraw(struct mididev *o, unsigned char *buf, unsigned len)
@@ -594,10 +951,14 @@ mididev_sendraw(struct mididev *o, unsigned char *buf, unsigned len)
 	if (!(o->mode & MIDIDEV_MODE_OUT)) {
 		return;
 	}
+	if (o->npend > 0)
+		mididev_drain(o, -1);
 	while (len > 0) {
 		if (o->oused == MIDIDEV_BUFLEN) {
 			mididev_flush(o);
 		}
+		if (*buf == 0xf0)
+			o->stat.osysex++;
 		o->obuf[o->oused] = *buf;
 		o->oused++;
 		len--;
@@ -621,6 +982,14 @@ mididev_listinit(void)
 	for (i = 0; i < DEFAULT_MAXNDEVS; i++) {
 		mididev_byunit[i] = NULL;
 	}
+	for (i = 0; i < 256; i++) {
+		if (i < 0x80)
+			mididev_iclass[i] = MIDIDEV_IC_DATA;
+		else if (i < 0xf8)
+			mididev_iclass[i] = MIDIDEV_IC_STATUS;
+		else
+			mididev_iclass[i] = MIDIDEV_IC_REALTIME;
+	}
 	mididev_list = NULL;
 	mididev_mtcsrc = NULL;	/* no external timer, use internal timer */
 	mididev_clksrc = NULL;	/* no clock source, use internal clock */
@@ -662,6 +1031,11 @@ mididev_attach(unsigned unit, char *path, unsigned mode)
 		cons_err("device already exists");
 		return 0;
 	}
+	if (loop_ispath(path))
+		dev = loop_new(path, mode);
+	else if (replay_ispath(path))
+		dev = replay_new(path, mode);
+	else
 #if defined(USE_SNDIO)
 	dev = sndio_new(path, mode);
 #elif defined(USE_ALSA)
@@ -35,9 +35,37 @@
  */
 #define MIDIDEV_BUFLEN	0x400
 
+/*
+ * max number of deferred messages per device, used only if the
+ * output bitrate is set
+ */
+#define MIDIDEV_NPEND	64
+
+/*
+ * deferred messages are held back if there are more than this amount
+ * of data (in 24th of microsecond) waiting to be sent on the wire. It
+ * must be larger than the timer period
+ */
+#define MIDIDEV_WIRELAT	(2 * 24 * 1000)
+
+/*
+ * time (in 24th of microsecond) to transmit a single byte at the
+ * given bitrate: 1 start bit, 8 data bits and 1 stop bit
+ */
+#define MIDIDEV_BYTELEN(bitrate) (10UL * 24000000 / (bitrate))
+
+/*
+ * counters are saved every MIDIDEV_SNAPLEN (in 24th of microsecond)
+ * in a ring of MIDIDEV_NSNAP snapshots, so rates are computed over
+ * the last second
+ */
+#define MIDIDEV_NSNAP	4
+#define MIDIDEV_SNAPLEN	(250 * 24 * 1000)
+
 struct pollfd;
 struct mididev;
 struct ev;
+struct capture;
 
 struct devops {
 	/*
@@ -94,6 +122,26 @@ struct mtc {
 	unsigned timo;
 };
 
+/*
+ * a deferred controller-like message, waiting for the wire to be free
+ */
+struct mididev_pend {
+	unsigned char status, data[2];
+	unsigned long stamp;		/* when it was queued */
+};
+
+/*
+ * always-on device statistics
+ */
+struct mididev_stat {
+	unsigned long ibytes, obytes;	/* bytes received/written */
+	unsigned long iev, oev;		/* voice events received/sent */
+	unsigned long isysex, osysex;	/* sysex messages received/sent */
+	unsigned long nflush;		/* writes to the device */
+	unsigned long nshort;		/* writes that didn't complete */
+	unsigned long ierr;		/* aborted or unexpected input */
+};
+
 struct mididev {
 	struct devops *ops;
 
@@ -129,6 +177,30 @@ struct mididev {
 	unsigned 	  oused;		/* bytes in obuf */
 	unsigned	  ostatus;		/* output running status */
 	unsigned char	  obuf[MIDIDEV_BUFLEN];	/* output buffer */
+
+	/*
+	 * output scheduler, used only if obitrate is not zero
+	 */
+	unsigned	  obitrate;		/* wire bitrate, in bits/s */
+	unsigned long	  owire;		/* time the wire becomes idle */
+	unsigned	  npend;		/* messages in opend[] */
+	struct mididev_pend opend[MIDIDEV_NPEND]; /* deferred messages */
+	unsigned long	  odelay_sum;		/* sum of queue delays */
+	unsigned long	  odelay_max;		/* max queue delay */
+	unsigned long	  odelay_cnt;		/* number of delay samples */
+	unsigned long	  odeferred;		/* deferred messages */
+	unsigned long	  omerged;		/* merged messages */
+
+	/*
+	 * statistics, and snapshots used to compute rates
+	 */
+	struct mididev_stat stat;
+	struct mididev_stat snap[MIDIDEV_NSNAP];
+	unsigned	  nsnap;		/* valid entries in snap[] */
+	unsigned	  snapidx;		/* next entry to write */
+	unsigned	  snapto;		/* time to next snapshot */
+
+	struct capture	 *icap;			/* input capture, or NULL */
 };
 
 void mididev_init(struct mididev *, struct devops *, unsigned);
@@ -139,10 +211,14 @@ void mididev_putstop(struct mididev *);
 void mididev_puttic(struct mididev *);
 void mididev_putack(struct mididev *);
 void mididev_putev(struct mididev *, struct ev *);
+void mididev_drain(struct mididev *, int);
 void mididev_sendraw(struct mididev *, unsigned char *, unsigned);
 void mididev_open(struct mididev *);
 void mididev_close(struct mididev *);
 void mididev_inputcb(struct mididev *, unsigned char *, unsigned);
+void mididev_snap(struct mididev *);
+void mididev_getrate(struct mididev *, struct mididev_stat *);
+unsigned mididev_capture(struct mididev *, char *);
 
 void mtc_timo(struct mtc *); /* XXX, use timeouts */
 
@@ -156,6 +232,10 @@ extern struct mididev *mididev_byunit[];
 struct mididev *raw_new(char *, unsigned);
 struct mididev *alsa_new(char *, unsigned);
 struct mididev *sndio_new(char *, unsigned);
+struct mididev *loop_new(char *, unsigned);
+struct mididev *replay_new(char *, unsigned);
+unsigned replay_ispath(char *);
+unsigned loop_ispath(char *);
 
 void mididev_listinit(void);
 void mididev_listdone(void);
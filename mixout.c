@@ -30,6 +30,15 @@
  * realtime while a track using the same controller is playing (input
  * ID is zero, and has precedence over tracks).
  *
+ * Events are queued and sent to the mux when it's flushed, ie once
+ * per tick or input event. Continuous controllers (not switches
+ * nor channel mode messages), bender, aftertouch and NRPN/RPN
+ * values are coalesced: if the queue contains already an
+ * event for the same parameter, its value is replaced, as long as
+ * no note or program change for the same channel was queued in
+ * between. Such events are also dropped if they don't change the
+ * current value of the parameter.
+ *
  */
 
 #include "utils.h"
@@ -39,15 +48,44 @@
 #include "mux.h"
 #include "timo.h"
 #include "state.h"
+#include "mixout.h"
+#include "trace.h"
 
 #define MIXOUT_TIMO (1000000UL)
 #define MIXOUT_MAXTICS 24
+#define MIXOUT_NQUEUE 256
+
+/*
+ * true if the given controller number is a continuous one: not bank
+ * select, data entry, a switch, RPN/NRPN selection or a channel mode
+ * message, whose messages must all be sent (see mididev_isordered())
+ */
+#define MIXOUT_ISCONTCTL(num)				\
+	((num) != BANK_HI && (num) != BANK_LO &&	\
+	 (num) != DATAENT_HI && (num) != DATAENT_LO &&	\
+	 ((num) < 64 || (num) > 69) &&			\
+	 ((num) < 96 || (num) > 101) &&			\
+	 (num) < 120)
+
+/*
+ * true if only the last value of the event matters
+ */
+#define MIXOUT_ISCONT(ev)						\
+	(((ev)->cmd == EV_XCTL && MIXOUT_ISCONTCTL((ev)->ctl_num)) ||	\
+	 (ev)->cmd == EV_NRPN ||					\
+	 (ev)->cmd == EV_RPN ||						\
+	 (ev)->cmd == EV_BEND ||					\
+	 (ev)->cmd == EV_CAT ||						\
+	 (ev)->cmd == EV_KAT)
 
 void mixout_timocb(void *);
 
 struct statelist mixout_slist;
 struct timo mixout_timo;
 unsigned mixout_debug = 0;
+struct ev mixout_queue[MIXOUT_NQUEUE];
+unsigned mixout_qid[MIXOUT_NQUEUE];	/* trace id of queued events */
+unsigned mixout_nqueue = 0;
 
 void
 mixout_start(void)
@@ -66,16 +104,75 @@ mixout_stop(void)
 	if (mixout_debug) {
 		log_puts("mixout_stop()\n");
 	}
+	mixout_flush();
 	timo_del(&mixout_timo);
 	statelist_done(&mixout_slist);
 }
 
+/*
+ * send all queued events to the mux
+ */
+void
+mixout_flush(void)
+{
+	unsigned i, id;
+
+	id = trace_id;
+	for (i = 0; i < mixout_nqueue; i++) {
+		trace_id = mixout_qid[i];
+		mux_putev(&mixout_queue[i]);
+	}
+	mixout_nqueue = 0;
+	trace_id = id;
+}
+
+/*
+ * queue the given event, if possible replace the value of a queued
+ * event for the same parameter
+ */
+void
+mixout_queueev(struct ev *ev)
+{
+	struct ev *q;
+	unsigned i;
+
+	if (MIXOUT_ISCONT(ev)) {
+		for (i = mixout_nqueue; i-- > 0;) {
+			q = &mixout_queue[i];
+			if (q->dev != ev->dev || q->ch != ev->ch)
+				continue;
+			if (!MIXOUT_ISCONT(q))
+				break;
+			if (q->cmd == ev->cmd &&
+			    (ev->cmd == EV_BEND ||
+			     ev->cmd == EV_CAT ||
+			     q->v0 == ev->v0)) {
+				if (mixout_debug >= 2) {
+					log_puts("mixout_queueev: ");
+					ev_log(q);
+					log_puts(": replaced by ");
+					ev_log(ev);
+					log_puts("\n");
+				}
+				*q = *ev;
+				mixout_qid[i] = trace_id;
+				return;
+			}
+		}
+	}
+	if (mixout_nqueue == MIXOUT_NQUEUE)
+		mixout_flush();
+	mixout_qid[mixout_nqueue] = trace_id;
+	mixout_queue[mixout_nqueue++] = *ev;
+}
+
 void
 mixout_putev(struct ev *ev, unsigned id)
 {
 	struct state *os;
 	struct ev ca;
 
+	TRACE_EV(TRACE_MIXOUT, ev);
 	if (mixout_debug >= 3) {
 		log_puts("mixout_putev: ");
 		ev_log(ev);
@@ -85,6 +182,17 @@ mixout_putev(struct ev *ev, unsigned id)
 	}
 
 	os = statelist_lookup(&mixout_slist, ev);
+	if (os != NULL && os->tag == id && MIXOUT_ISCONT(ev) &&
+	    (os->flags & (STATE_BOGUS | STATE_NESTED)) == 0 &&
+	    ev_eq(&os->ev, ev)) {
+		if (mixout_debug >= 2) {
+			log_puts("mixout_putev: ");
+			ev_log(ev);
+			log_puts(": no change, dropped\n");
+		}
+		os->tic = 0;
+		return;
+	}
 	if (os != NULL && os->tag != id) {
 		if (os->tag < id) {
 			if (mixout_debug) {
@@ -113,7 +221,7 @@ mixout_putev(struct ev *ev, unsigned id)
 				log_puts(")\n");
 			}
 			statelist_update(&mixout_slist, &ca);
-			mux_putev(&ca);
+			mixout_queueev(&ca);
 		}
 		if (mixout_debug) {
 			log_puts("mixout_putev: ");
@@ -125,7 +233,7 @@ mixout_putev(struct ev *ev, unsigned id)
 	os->tag = id;
 	os->tic = 0;
 	if ((os->flags & (STATE_BOGUS | STATE_NESTED)) == 0)
-		mux_putev(ev);
+		mixout_queueev(ev);
 	else {
 		if (mixout_debug) {
 			log_puts("mixout_putev: ");
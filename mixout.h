@@ -23,6 +23,7 @@
 void mixout_start(void);
 void mixout_stop(void);
 void mixout_putev(struct ev *, unsigned);
+void mixout_flush(void);
 
 extern unsigned mixout_debug;
 
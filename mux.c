@@ -69,7 +69,10 @@
 #include "conv.h"
 
 #include "norm.h"
+#include "trace.h"
+#include "render.h"
 #include "mixout.h"
+#include "probe.h"
 
 /*
  * MUX_START_DELAY:
@@ -88,6 +91,8 @@ unsigned mux_phase, mux_reqphase;
 unsigned mux_manualstart = 1;
 void *mux_addr;
 unsigned long mux_wallclock;
+unsigned mux_inbatch = 0;		/* defer flushes until batch end */
+unsigned mux_offline = 0;		/* no devices, output is rendered */
 
 
 struct statelist mux_istate, mux_ostate;
@@ -135,9 +140,11 @@ mux_open(void)
 		i->ticdelta = i->ticrate;
 		i->isensto = 0;
 		i->osensto = MIDIDEV_OSENSTO;
-		mididev_open(i);
+		if (!mux_offline)
+			mididev_open(i);
 	}
-	mux_mdep_open();
+	if (!mux_offline)
+		mux_mdep_open();
 
 	mux_curpos = 0;
 	mux_nextpos = 0;
@@ -159,14 +166,16 @@ mux_close(void)
 	norm_stop();
 	mixout_stop();
 	mux_flush();
-	for (i = mididev_list; i != NULL; i = i->next) {
-		if (i->isysex) {
-			cons_err("lost incomplete sysex");
-			sysex_del(i->isysex);
+	if (!mux_offline) {
+		for (i = mididev_list; i != NULL; i = i->next) {
+			if (i->isysex) {
+				cons_err("lost incomplete sysex");
+				sysex_del(i->isysex);
+			}
+			mididev_close(i);
 		}
-		mididev_close(i);
+		mux_mdep_close();
 	}
-	mux_mdep_close();
 	mux_isopen = 0;
 	statelist_done(&mux_ostate);
 	statelist_done(&mux_istate);
@@ -306,8 +315,11 @@ mux_putev(struct ev *ev)
 		log_puts(": bogus unit number\n");
 		panic();
 	}
+	TRACE_EV(TRACE_MUXOUT, ev);
 	dev = mididev_byunit[unit];
-	if (dev != NULL) {
+	if (dev != NULL && mux_offline) {
+		render_putev(ev);
+	} else if (dev != NULL) {
 		nev = conv_unpackev(&mux_ostate,
 		    dev->oxctlset, dev->oevset, ev, rev);
 		for (i = 0; i < nev; i++) {
@@ -331,6 +343,10 @@ mux_sendraw(unsigned unit, unsigned char *buf, unsigned len)
 	if (len == 0) {
 		return;
 	}
+	if (mux_offline) {
+		render_sendraw(unit, buf, len);
+		return;
+	}
 	dev = mididev_byunit[unit];
 	if (dev == NULL) {
 		return;
@@ -474,6 +490,17 @@ mux_timercb(unsigned long delta)
 				dev->imtc.timo -= delta;
 			}
 		}
+
+		if (dev->snapto <= delta)
+			mididev_snap(dev);
+		else
+			dev->snapto -= delta;
+
+		/*
+		 * send deferred messages the wire has room for
+		 */
+		if (dev->npend > 0)
+			mididev_flush(dev);
 	}
 
 	/*
@@ -610,9 +637,32 @@ mux_evcb(unsigned unit, struct ev *ev)
 		log_puts("\n");
 	}
 #endif
+	TRACE_BEGIN();
+	TRACE_EV(TRACE_MUXIN, ev);
+	if (probe_active && probe_evcb(ev)) {
+		TRACE_END();
+		return;
+	}
 	if (conv_packev(&mux_istate, dev->ixctlset, dev->ievset, ev, &rev)) {
 		norm_evcb(&rev);
 	}
+	TRACE_END();
+}
+
+/*
+ * called when a batch of events has been received from an external
+ * device. Output is flushed once, after the whole batch is processed
+ */
+void
+mux_evcbv(unsigned unit, struct ev *evs, unsigned n)
+{
+	unsigned i;
+
+	mux_inbatch = 1;
+	for (i = 0; i < n; i++)
+		mux_evcb(unit, evs + i);
+	mux_inbatch = 0;
+	mux_flush();
 }
 
 /*
@@ -702,6 +752,9 @@ mux_flush(void)
 {
 	struct mididev *dev;
 
+	if (mux_inbatch)
+		return;
+	mixout_flush();
 	for (dev = mididev_list; dev != NULL; dev = dev->next) {
 		mididev_flush(dev);
 	}
@@ -728,6 +781,8 @@ mux_chgtempo(unsigned long ticlength)
 		mux_nextpos -= mux_ticlength;
 	}
 	mux_ticlength = ticlength;
+	if (mux_offline)
+		render_chgtempo(ticlength);
 }
 
 /*
@@ -44,6 +44,10 @@ extern struct song *usong;
 extern unsigned mux_isopen;
 extern unsigned mux_manualstart;
 extern unsigned long mux_wallclock;
+extern unsigned long mux_curpos, mux_nextpos;
+extern unsigned mux_curtic;
+extern unsigned mux_offline;
+extern unsigned mux_inbatch;
 
 void song_startcb(struct song *);
 void song_stopcb(struct song *);
@@ -88,6 +92,7 @@ void mux_stopcb(void);
 void mux_ticcb(void);
 void mux_ackcb(unsigned);
 void mux_evcb(unsigned, struct ev *);
+void mux_evcbv(unsigned, struct ev *, unsigned);
 void mux_sysexcb(unsigned, struct sysex *);
 void mux_errorcb(unsigned);
 
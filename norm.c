@@ -20,6 +20,12 @@
  * a stateful midi normalizer. It's used to normalize/sanitize midi
  * input
  *
+ * input is throttled by token buckets: one per device and per event
+ * class plus a global one (the input budget). An event that doesn't
+ * change the phase of its frame is held back if any of the buckets is
+ * empty; the frame is then tagged as pending and only its last event
+ * is sent once the buckets are refilled.
+ *
  */
 
 #include "utils.h"
@@ -29,24 +35,199 @@
 #include "mux.h"
 #include "filt.h"
 #include "mixout.h"
+#include "thru.h"
+#include "str.h"
+#include "timo.h"
+#include "trace.h"
 
 struct song;
 
 #define TAG_PASS 1
 #define TAG_PENDING 2
+#define TAG_THRU 4
 
 /*
- * timeout for throtteling: 1 tick at 60 bpm
+ * timeout for purging terminated frames: 1 tick at 60 bpm
  */
 #define NORM_TIMO TEMPO_TO_USEC24(120,24)
 
+/*
+ * period at which pending frames are retried
+ */
+#define NORM_RTIMO (2 * 24 * 1000)
+
+/*
+ * max credit a bucket can accumulate, ie the length of bursts
+ * allowed after a quiet period
+ */
+#define NORM_BURST (20 * 24 * 1000)
+
 unsigned norm_debug = 0;
 struct statelist norm_slist;		/* state of the normilizer */
-struct timo norm_timo;			/* for throtteling */
+struct timo norm_timo;			/* for purging frames */
+struct timo norm_rtimo;			/* for retrying pending frames */
+
+char *norm_classname[NORM_NCLASS] = {
+	"kat", "ctl", "pc", "cat", "bend", "sx"
+};
+
+/*
+ * default rates, a MIDI 1.0 wire carries at most ~1000 messages
+ * per second
+ */
+unsigned norm_defrate[NORM_NCLASS] = {
+	250, 500, 0, 250, 500, 0
+};
+
+struct norm_bucket norm_ibucket = {2000, 0, 0, 0};
+struct norm_bucket norm_dbucket[DEFAULT_MAXNDEVS][NORM_NCLASS];
 
 /* --------------------------------------------------------------------- */
 
 void norm_timocb(void *);
+void norm_rtimocb(void *);
+
+/*
+ * return the class of the given event, or NORM_NCLASS if the event
+ * is never throttled
+ */
+unsigned
+norm_class(struct ev *ev)
+{
+	switch (ev->cmd) {
+	case EV_KAT:
+		return NORM_KAT;
+	case EV_CTL:
+	case EV_XCTL:
+	case EV_NRPN:
+	case EV_RPN:
+		return NORM_CTL;
+	case EV_PC:
+	case EV_XPC:
+		return NORM_PC;
+	case EV_CAT:
+		return NORM_CAT;
+	case EV_BEND:
+		return NORM_BEND;
+	default:
+		if (EV_ISSX(ev))
+			return NORM_SX;
+		return NORM_NCLASS;
+	}
+}
+
+/*
+ * convert a class name to its number, return 0 if unknown
+ */
+unsigned
+norm_str2class(char *name, unsigned *res)
+{
+	unsigned i;
+
+	for (i = 0; i < NORM_NCLASS; i++) {
+		if (str_eq(norm_classname[i], name)) {
+			*res = i;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * set the rate of the given bucket and fill it
+ */
+void
+norm_setrate(struct norm_bucket *b, unsigned rate)
+{
+	b->rate = rate;
+	b->credit = NORM_BURST;
+	b->stamp = timo_abstime;
+}
+
+/*
+ * reset the buckets of the given device to the default rates
+ */
+void
+norm_devinit(unsigned unit)
+{
+	unsigned i;
+
+	for (i = 0; i < NORM_NCLASS; i++) {
+		norm_setrate(&norm_dbucket[unit][i], norm_defrate[i]);
+		norm_dbucket[unit][i].nthrot = 0;
+	}
+}
+
+/*
+ * add the time elapsed since the last refill to the credit of the
+ * given bucket, and return 1 if there's enough credit for one event
+ */
+unsigned
+norm_refill(struct norm_bucket *b)
+{
+	unsigned cost, max, delta;
+
+	if (b->rate == 0)
+		return 1;
+	cost = 24000000 / b->rate;
+	max = (cost > NORM_BURST) ? cost : NORM_BURST;
+	delta = timo_abstime - b->stamp;
+	b->stamp = timo_abstime;
+	if (delta > max - b->credit)
+		b->credit = max;
+	else
+		b->credit += delta;
+	return b->credit >= cost;
+}
+
+/*
+ * take one event from the given bucket, it must have enough credit
+ */
+void
+norm_take(struct norm_bucket *b)
+{
+	if (b->rate > 0)
+		b->credit -= 24000000 / b->rate;
+}
+
+/*
+ * return 1 if the given event may be sent now and take it from
+ * the buckets, else return 0
+ */
+unsigned
+norm_admit(struct ev *ev)
+{
+	struct norm_bucket *b;
+	unsigned c;
+
+	c = norm_class(ev);
+	if (c == NORM_NCLASS)
+		return 1;
+	b = &norm_dbucket[ev->dev][c];
+	if (!norm_refill(b) || !norm_refill(&norm_ibucket))
+		return 0;
+	norm_take(b);
+	norm_take(&norm_ibucket);
+	return 1;
+}
+
+/*
+ * count a throttled event
+ */
+void
+norm_throt(struct ev *ev)
+{
+	unsigned c;
+
+	c = norm_class(ev);
+	norm_dbucket[ev->dev][c].nthrot++;
+	norm_ibucket.nthrot++;
+	if (norm_debug) {
+		log_puts("norm_evcb: ");
+		ev_log(ev);
+		log_puts(": throttled\n");
+	}
+}
 
 /*
  * inject an event
@@ -60,6 +241,19 @@ norm_putev(struct ev *ev)
 	mux_flush();
 }
 
+/*
+ * output the current event of the given frame, through the fast
+ * path if the frame was started on it
+ */
+void
+norm_out(struct state *st)
+{
+	if (st->tag & TAG_THRU)
+		thru_putev(&st->ev);
+	else
+		norm_putev(&st->ev);
+}
+
 /*
  * configure the normalizer so that output events are passed to the
  * given callback
@@ -67,9 +261,20 @@ norm_putev(struct ev *ev)
 void
 norm_start(void)
 {
+	unsigned i, j;
+
+	/*
+	 * timo_abstime was reset, so fill all buckets
+	 */
+	for (i = 0; i < DEFAULT_MAXNDEVS; i++) {
+		for (j = 0; j < NORM_NCLASS; j++)
+			norm_setrate(&norm_dbucket[i][j], norm_dbucket[i][j].rate);
+	}
+	norm_setrate(&norm_ibucket, norm_ibucket.rate);
 	statelist_init(&norm_slist);
 	timo_set(&norm_timo, norm_timocb, NULL);
 	timo_add(&norm_timo, NORM_TIMO);
+	timo_set(&norm_rtimo, norm_rtimocb, NULL);
 	if (norm_debug) {
 		log_puts("norm_start()\n");
 	}
@@ -98,10 +303,11 @@ norm_stop(void)
 				log_puts("\n");
 			}
 			s = statelist_update(&norm_slist, &ca);
-			norm_putev(&s->ev);
+			norm_out(s);
 		}
 	}
 	timo_del(&norm_timo);
+	timo_del(&norm_rtimo);
 	statelist_done(&norm_slist);
 }
 
@@ -128,7 +334,7 @@ norm_shut(void)
 				log_puts("\n");
 			}
 			s = statelist_update(&norm_slist, &ca);
-			norm_putev(&s->ev);
+			norm_out(s);
 		}
 		s->tag &= ~TAG_PASS;
 	}
@@ -158,7 +364,7 @@ norm_kill(struct ev *ev)
 		 */
 		if (state_cancel(st, &ca)) {
 			st = statelist_update(&norm_slist, &ca);
-			norm_putev(&st->ev);
+			norm_out(st);
 		}
 		st->tag &= ~TAG_PASS;
 		log_puts("norm_kill: ");
@@ -187,6 +393,8 @@ norm_evcb(struct ev *ev)
 	}
 #endif
 
+	TRACE_EV(TRACE_NORM, ev);
+
 	/*
 	 * create/update state for this event
 	 */
@@ -203,8 +411,11 @@ norm_evcb(struct ev *ev)
 				log_puts(": bogus/nested frame\n");
 			}
 			norm_kill(ev);
-		} else
+		} else {
 			st->tag = TAG_PASS;
+			if (thru_isfast(ev))
+				st->tag |= TAG_THRU;
+		}
 	}
 
 	/*
@@ -214,38 +425,54 @@ norm_evcb(struct ev *ev)
 		return;
 
 	/*
-	 * throttling: if we played more than MAXEV
-	 * events skip this event only if it doesnt change the
-	 * phase of the frame
+	 * throttling: if there's no credit left, skip this event
+	 * only if it doesnt change the phase of the frame; it
+	 * will be sent later, unless a newer event replaces it
 	 */
-	if (st->nevents > NORM_MAXEV &&
-	    (st->phase == EV_PHASE_NEXT ||
-	     st->phase == (EV_PHASE_FIRST | EV_PHASE_LAST))) {
+	if ((st->phase == EV_PHASE_NEXT ||
+	     st->phase == (EV_PHASE_FIRST | EV_PHASE_LAST)) &&
+	    ((st->tag & TAG_PENDING) || !norm_admit(ev))) {
+		norm_throt(ev);
 		st->tag |= TAG_PENDING;
+		if (!norm_rtimo.set)
+			timo_add(&norm_rtimo, NORM_RTIMO);
 		return;
 	}
-
-	norm_putev(&st->ev);
+	st->tag &= ~TAG_PENDING;
+	norm_out(st);
 	st->nevents++;
 }
 
 /*
- * timeout: outdate all events, so throttling will enable
- * output again.
+ * timeout: outdate all events
  */
 void
 norm_timocb(void *addr)
+{
+	statelist_outdate(&norm_slist);
+	timo_add(&norm_timo, NORM_TIMO);
+}
+
+/*
+ * timeout: send pending frames for which there's enough credit
+ */
+void
+norm_rtimocb(void *addr)
 {
 	struct state *i;
+	unsigned pending = 0;
 
-	statelist_outdate(&norm_slist);
 	for (i = norm_slist.first; i != NULL; i = i->next) {
-		i->nevents = 0;
-		if (i->tag & TAG_PENDING) {
-			i->tag &= ~TAG_PENDING;
-			norm_putev(&i->ev);
-			i->nevents++;
+		if (!(i->tag & TAG_PENDING))
+			continue;
+		if (!norm_admit(&i->ev)) {
+			pending = 1;
+			continue;
 		}
+		i->tag &= ~TAG_PENDING;
+		norm_out(i);
+		i->nevents++;
 	}
-	timo_add(&norm_timo, NORM_TIMO);
+	if (pending)
+		timo_add(&norm_rtimo, NORM_RTIMO);
 }
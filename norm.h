@@ -17,7 +17,30 @@
 #ifndef MIDISH_NORM_H
 #define MIDISH_NORM_H
 
-#define NORM_MAXEV	1			/* max events per time slice */
+#include "defs.h"
+
+/*
+ * classes of input events subject to throttling; notes are never
+ * throttled because they always change the phase of their frame
+ */
+#define NORM_KAT	0			/* key aftertouch */
+#define NORM_CTL	1			/* controllers, NRPNs, RPNs */
+#define NORM_PC		2			/* program changes */
+#define NORM_CAT	3			/* channel aftertouch */
+#define NORM_BEND	4			/* pitch bend */
+#define NORM_SX		5			/* sysex patterns */
+#define NORM_NCLASS	6
+
+/*
+ * token bucket: ``credit'' is the time (in 24th of microsecond)
+ * accumulated since the last event, each event costs 1/rate seconds
+ */
+struct norm_bucket {
+	unsigned rate;			/* events per second, 0 = unlimited */
+	unsigned credit;		/* accumulated time */
+	unsigned stamp;			/* timo_abstime of last refill */
+	unsigned long nthrot;		/* number of throttled events */
+};
 
 struct filt;
 struct ev;
@@ -29,7 +52,13 @@ void norm_putev(struct ev *);
 
 void norm_evcb(struct ev *);
 void norm_timercb(void);
+void norm_setrate(struct norm_bucket *, unsigned);
+void norm_devinit(unsigned);
+unsigned norm_str2class(char *, unsigned *);
 
 extern unsigned norm_debug;
+extern char *norm_classname[NORM_NCLASS];
+extern struct norm_bucket norm_ibucket;
+extern struct norm_bucket norm_dbucket[DEFAULT_MAXNDEVS][NORM_NCLASS];
 
 #endif /* MIDISH_NORM_H */
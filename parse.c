@@ -90,6 +90,7 @@
 #include <string.h>
 #include "data.h"
 #include "parse.h"
+#include "textio.h"
 #include "node.h"
 #include "utils.h"
 #include "exec.h"
@@ -533,6 +534,49 @@ lex_handle(struct parse *l, int c)
 	}
 }
 
+/*
+ * tokenize the given block of characters. Characters that don't end
+ * the current token are consumed in tight loops, others are handled
+ * one by one by lex_handle()
+ */
+void
+lex_scan(struct parse *l, unsigned char *p, unsigned char *end)
+{
+	unsigned char *q;
+
+	while (p != end) {
+		switch (l->lstate) {
+		case LEX_ANY:
+			while (p != end && IS_SPACE(*p))
+				p++;
+			break;
+		case LEX_ERROR:
+		case LEX_COMMENT:
+			q = memchr(p, '\n', end - p);
+			p = (q != NULL) ? q : end;
+			break;
+		case LEX_NUM:
+			while (p != end && (IS_DIGIT(*p) || IS_ALPHA(*p)) &&
+			    l->used < STRING_MAXSZ - 1)
+				l->buf[l->used++] = *p++;
+			break;
+		case LEX_IDENT:
+			while (p != end && IS_IDNEXT(*p) &&
+			    l->used < IDENT_MAXSZ - 1)
+				l->buf[l->used++] = *p++;
+			break;
+		case LEX_STRING:
+			while (p != end && IS_PRINTABLE(*p) && !IS_QUOTE(*p) &&
+			    l->used < STRING_MAXSZ - 1)
+				l->buf[l->used++] = *p++;
+			break;
+		}
+		if (p == end)
+			break;
+		lex_handle(l, *p++);
+	}
+}
+
 /*
  * return true if the given token is in the given set
  */
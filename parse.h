@@ -37,15 +37,6 @@ enum TOK_ID {
 #define IDENT_MAXSZ	32
 #define STRING_MAXSZ	1024
 
-#define IS_SPACE(c)	((c) == ' ' || (c) == '\r' || (c) == '\t')
-#define IS_PRINTABLE(c)	((c) >= ' ' && (c) != 0x7f)
-#define IS_DIGIT(c)	((c) >= '0' && (c) <= '9')
-#define IS_ALPHA(c)	(((c) >= 'A' && (c) <= 'Z') || \
-			 ((c) >= 'a' && (c) <= 'z'))
-#define IS_IDFIRST(c)	(IS_ALPHA(c) || (c) == '_')
-#define IS_IDNEXT(c)	(IS_IDFIRST(c) || IS_DIGIT(c))
-#define IS_QUOTE(c)	((c) == '"')
-
 
 struct node;
 struct exec;
@@ -84,6 +75,7 @@ void lex_init(struct parse *, char *,
     void (*)(void *, unsigned, unsigned long), void *);
 void lex_done(struct parse *);
 void lex_handle(struct parse *, int);
+void lex_scan(struct parse *, unsigned char *, unsigned char *);
 void lex_toklog(unsigned, unsigned long);
 
 void parse_init(struct parse *,
@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * probe.c
+ *
+ * measures the round-trip latency between an output and an input
+ * device, connected either with a cable or a loopback device. Probes
+ * are controllers sent one at a time: once a probe is received (or
+ * lost, after PROBE_TIMO) the next one is sent PROBE_GAP later.
+ * Probes are sent packed (as the song expects them) but received
+ * unpacked, since they are caught before conv_packev().
+ * Probes may be sent directly to the device, or through the song
+ * input path (filter, mixout), in which case the difference gives
+ * the cost of the latter. Probes may also be notes, sent directly to
+ * the device: if the input device is reached through a filter of
+ * another pair of devices, notes take the MIDI-thru fast path, while
+ * controllers don't.
+ *
+ */
+
+#include <stdlib.h>
+#include "utils.h"
+#include "defs.h"
+#include "ev.h"
+#include "mux.h"
+#include "timo.h"
+#include "song.h"
+#include "probe.h"
+#include "trace.h"
+
+#define PROBE_CH	15		/* channel of probe controllers */
+#define PROBE_CTL	119		/* probe controller number */
+#define PROBE_VEL	100		/* velocity of probe notes */
+#define PROBE_TIMO	(24 * 1000000)	/* time to wait for a probe */
+#define PROBE_GAP	(24 * 10000)	/* time between probes */
+
+unsigned probe_active = 0;
+struct song *probe_song;
+unsigned probe_mode, probe_odev, probe_idev;
+unsigned probe_n;			/* number of probes to send */
+unsigned probe_nsent, probe_nlost, probe_nrecv;
+unsigned probe_wait;			/* waiting for a probe */
+unsigned long probe_stamp;		/* time the probe was sent */
+unsigned long probe_samples[PROBE_MAXN];
+struct timo probe_timo;
+
+/*
+ * send the next probe, and wait for it to come back
+ */
+void
+probe_send(void)
+{
+	struct ev ev;
+
+	ev.dev = probe_odev;
+	ev.ch = PROBE_CH;
+	if (probe_mode == PROBE_THRU) {
+		ev.cmd = EV_NON;
+		ev.note_num = probe_nsent & 0x7f;
+		ev.note_vel = PROBE_VEL;
+	} else {
+		ev.cmd = EV_XCTL;
+		ev.ctl_num = PROBE_CTL;
+		ev.ctl_val = (probe_nsent & 0x7f) << 7;
+	}
+	probe_wait = 1;
+	probe_nsent++;
+	probe_stamp = trace_mdep_gettime();
+	if (probe_mode == PROBE_SONG)
+		song_evcb(probe_song, &ev);
+	else
+		mux_putev(&ev);
+	if (probe_mode == PROBE_THRU) {
+		ev.cmd = EV_NOFF;
+		ev.note_vel = EV_NOFF_DEFAULTVEL;
+		mux_putev(&ev);
+	}
+	mux_flush();
+	timo_add(&probe_timo, PROBE_TIMO);
+}
+
+/*
+ * called when the probe is lost, or when the gap after the last
+ * received probe expired
+ */
+void
+probe_timocb(void *arg)
+{
+	if (probe_wait) {
+		probe_wait = 0;
+		probe_nlost++;
+	}
+	if (probe_nsent < probe_n)
+		probe_send();
+}
+
+/*
+ * called by mux_evcb() for each received event; return 1 if the
+ * event is a probe (and must be dropped). The note-off following a
+ * note probe is dropped as well
+ */
+unsigned
+probe_evcb(struct ev *ev)
+{
+	unsigned val;
+
+	if (ev->dev != probe_idev || ev->ch != PROBE_CH)
+		return 0;
+	if (probe_mode == PROBE_THRU) {
+		if (ev->cmd == EV_NOFF ||
+		    (ev->cmd == EV_NON && ev->note_vel == 0))
+			return 1;
+		if (ev->cmd != EV_NON)
+			return 0;
+		val = ev->note_num;
+	} else {
+		if (ev->cmd != EV_CTL || ev->ctl_num != PROBE_CTL)
+			return 0;
+		val = ev->ctl_val;
+	}
+	if (probe_wait && val == ((probe_nsent - 1) & 0x7f)) {
+		probe_samples[probe_nrecv++] =
+		    trace_mdep_gettime() - probe_stamp;
+		probe_wait = 0;
+		timo_del(&probe_timo);
+		timo_add(&probe_timo, PROBE_GAP);
+	}
+	return 1;
+}
+
+int
+probe_cmp(const void *a, const void *b)
+{
+	unsigned long x = *(unsigned long *)a, y = *(unsigned long *)b;
+
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/*
+ * compute the statistics of the received samples
+ */
+void
+probe_stats(struct probe_res *r)
+{
+	unsigned long sum;
+	unsigned i;
+
+	r->nsent = probe_nsent;
+	r->nlost = probe_nsent - probe_nrecv;
+	if (probe_nrecv == 0) {
+		r->min = r->med = r->p99 = r->max = r->jitter = 0;
+		return;
+	}
+	sum = 0;
+	for (i = 1; i < probe_nrecv; i++) {
+		sum += probe_samples[i] > probe_samples[i - 1] ?
+		    probe_samples[i] - probe_samples[i - 1] :
+		    probe_samples[i - 1] - probe_samples[i];
+	}
+	r->jitter = probe_nrecv > 1 ? sum / (probe_nrecv - 1) : 0;
+	qsort(probe_samples, probe_nrecv, sizeof(unsigned long), probe_cmp);
+	r->min = probe_samples[0];
+	r->med = probe_samples[probe_nrecv / 2];
+	r->p99 = probe_samples[(probe_nrecv * 99 + 99) / 100 - 1];
+	r->max = probe_samples[probe_nrecv - 1];
+}
+
+/*
+ * send the given number of probes on the output device and wait for
+ * them on the input device. The song must be stopped. Return 0 if
+ * interrupted
+ */
+unsigned
+probe_run(struct song *s, unsigned mode, unsigned odev, unsigned idev,
+    unsigned n, struct probe_res *r)
+{
+	unsigned done;
+
+	probe_song = s;
+	probe_mode = mode;
+	probe_odev = odev;
+	probe_idev = idev;
+	probe_n = n;
+	probe_nsent = probe_nlost = probe_nrecv = 0;
+	probe_wait = 0;
+	song_idle(s);
+	timo_set(&probe_timo, probe_timocb, NULL);
+	probe_active = 1;
+	probe_send();
+	for (;;) {
+		if (probe_nsent == probe_n && !probe_wait) {
+			done = 1;
+			break;
+		}
+		if (!mux_mdep_wait(0)) {
+			done = 0;
+			break;
+		}
+	}
+	probe_active = 0;
+	timo_del(&probe_timo);
+	song_stop(s);
+	probe_stats(r);
+	return done;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef MIDISH_PROBE_H
+#define MIDISH_PROBE_H
+
+#define PROBE_MAXN	10000		/* max number of samples */
+
+/*
+ * path probes go through before reaching the output device
+ */
+#define PROBE_DEV	0		/* directly to mux_putev() */
+#define PROBE_SONG	1		/* song_evcb(), filter and mixout */
+#define PROBE_THRU	2		/* notes to mux_putev() */
+
+struct ev;
+struct song;
+
+struct probe_res {
+	unsigned nsent, nlost;		/* probes sent and not received */
+	unsigned long min, med, p99, max; /* latency, in microseconds */
+	unsigned long jitter;		/* mean delta between samples */
+};
+
+unsigned probe_run(struct song *, unsigned, unsigned, unsigned, unsigned,
+    struct probe_res *);
+unsigned probe_evcb(struct ev *);
+
+extern unsigned probe_active;
+
+#endif /* MIDISH_PROBE_H */
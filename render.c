@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * render.c
+ *
+ * offline rendering: the song is played using a virtual clock, ie
+ * mux_timercb() is called directly with the time to the next tick,
+ * so playback runs as fast as the CPU allows. The mux doesn't open
+ * the devices; instead, events, sysex messages and tempo changes sent
+ * to the output are stored in a temporary song, which is saved as a
+ * standard MIDI file when the end of the song is reached.
+ *
+ * Since the whole output path (filters, mixout, metronome, channel
+ * config) is used, the file contains exactly what would be sent to
+ * the devices during a real-time playback.
+ *
+ */
+
+#include "utils.h"
+#include "defs.h"
+#include "ev.h"
+#include "mux.h"
+#include "track.h"
+#include "frame.h"
+#include "song.h"
+#include "sysex.h"
+#include "smf.h"
+#include "cons.h"
+#include "render.h"
+
+struct song *render_song;		/* song receiving the output */
+struct seqptr *render_trkptr;		/* where events are stored */
+struct seqptr *render_metaptr;		/* where tempo changes are stored */
+unsigned render_trktic, render_metatic;	/* position of above pointers */
+struct songsx *render_sx;		/* where sysex messages are stored */
+struct sysex *render_cursx;		/* sysex being received */
+
+/*
+ * move the given pointer to the current tick; events sent before the
+ * first tick (channel config) or after the last one (stop) are stored
+ * at the current position
+ */
+void
+render_seek(struct seqptr *sp, unsigned *ptic)
+{
+	unsigned phase;
+
+	phase = mux_getphase();
+	if (phase != MUX_FIRST && phase != MUX_NEXT)
+		return;
+	if (mux_curtic > *ptic) {
+		seqptr_ticput(sp, mux_curtic - *ptic);
+		*ptic = mux_curtic;
+	}
+}
+
+/*
+ * store an event that would be sent to a device
+ */
+void
+render_putev(struct ev *ev)
+{
+	render_seek(render_trkptr, &render_trktic);
+	seqptr_evput(render_trkptr, ev);
+}
+
+/*
+ * store raw bytes that would be sent to a device, only sysex
+ * messages are expected
+ */
+void
+render_sendraw(unsigned unit, unsigned char *buf, unsigned len)
+{
+	for (; len > 0; len--, buf++) {
+		if (*buf == 0xf0) {
+			if (render_cursx)
+				sysex_del(render_cursx);
+			render_cursx = sysex_new(unit);
+		}
+		if (render_cursx == NULL)
+			continue;
+		sysex_add(render_cursx, *buf);
+		if (*buf == 0xf7) {
+			sysexlist_put(&render_sx->sx, render_cursx);
+			render_cursx = NULL;
+		}
+	}
+}
+
+/*
+ * store a tempo change, the argument is the tick length in 24th of
+ * microsecond (tempo factor applied)
+ */
+void
+render_chgtempo(unsigned long ticlength)
+{
+	struct ev ev;
+
+	ev.cmd = EV_TEMPO;
+	ev.tempo_usec24 = ticlength;
+	render_seek(render_metaptr, &render_metatic);
+	seqptr_evput(render_metaptr, &ev);
+}
+
+/*
+ * play the song from the current position to its end, as fast as
+ * possible, and save the output in the given standard MIDI file
+ */
+unsigned
+song_render(struct song *o, char *path)
+{
+	struct songtrk *t;
+	unsigned long delta;
+	unsigned res;
+
+	render_song = song_new();
+	render_song->tics_per_unit = o->tics_per_unit;
+	track_clear(&render_song->meta);
+	t = song_trknew(render_song, "render");
+	render_sx = song_sxnew(render_song, "render");
+	render_cursx = NULL;
+	render_trkptr = seqptr_new(&t->track);
+	render_metaptr = seqptr_new(&render_song->meta);
+	render_trktic = render_metatic = 0;
+
+	mux_offline = 1;
+	song_play(o);
+	while (!o->complete && mux_getphase() != MUX_STOP) {
+		/*
+		 * jump to the next tick
+		 */
+		delta = (mux_nextpos > mux_curpos) ? mux_nextpos - mux_curpos : 1;
+		mux_timercb(delta);
+	}
+	song_stop(o);
+	mux_offline = 0;
+
+	if (render_cursx) {
+		sysex_del(render_cursx);
+		render_cursx = NULL;
+	}
+	seqptr_del(render_trkptr);
+	seqptr_del(render_metaptr);
+	res = song_exportsmf(render_song, path);
+	song_delete(render_song);
+	render_song = NULL;
+	return res;
+}
@@ -15,6 +15,7 @@
  */
 
 #include <limits.h>
+#include <string.h>
 #include "utils.h"
 #include "name.h"
 #include "mididev.h"
@@ -26,9 +27,28 @@
 #include "conv.h"
 #include "version.h"
 #include "cons.h"
+#include "songbin.h"
+#include "batch.h"
 
 #define FORMAT_VERSION	1
 
+#define SAVE_MAXJOBS	16		/* max processes serializing tracks */
+#define SAVE_MINEVS	0x10000		/* min events to use processes */
+
+/*
+ * tracks to serialize in parallel, and the outputs they are copied
+ * into, giving their indentation level
+ */
+struct save_par {
+	struct track **trks;
+	struct textout **outs;
+	unsigned ntrks;
+	unsigned njobs;
+};
+
+void save_parwork(void *, unsigned, int);
+void song_outputpar(struct song *, struct textout *);
+
 void
 chan_output(unsigned dev, unsigned ch, struct textout *f)
 {
@@ -217,6 +237,139 @@ track_output(struct track *t, struct textout *f)
 	textout_putstr(f, "}");
 }
 
+/*
+ * output the events of a track of the song being saved. The text is
+ * kept in the track and copied by next saves, until the track or
+ * sysex patterns are modified. A given track is always at the same
+ * indentation level in the file, so the copy remains valid
+ */
+void
+track_outputblk(struct track *t, struct textout *f)
+{
+	struct textout *b;
+	unsigned char *data;
+	unsigned len;
+
+	if (t->txt.data == NULL || t->txt.tag != evpat_gen) {
+		b = textout_newbuf(f);
+		track_output(t, b);
+		data = textout_getbuf(b, &len);
+		track_blkset(&t->txt, data, len, evpat_gen);
+		textout_delete(b);
+	}
+	textout_putraw(f, t->txt.data, t->txt.len);
+}
+
+/*
+ * serialize the tracks assigned to the given process, each one is
+ * sent as its index, its length, then its text
+ */
+void
+save_parwork(void *arg, unsigned idx, int fd)
+{
+	struct save_par *p = arg;
+	struct textout *b;
+	unsigned char *data;
+	unsigned hdr[2], i, len;
+
+	for (i = idx; i < p->ntrks; i += p->njobs) {
+		b = textout_newbuf(p->outs[i]);
+		track_output(p->trks[i], b);
+		data = textout_getbuf(b, &len);
+		hdr[0] = i;
+		hdr[1] = len;
+		if (!batch_mdep_write(fd, hdr, sizeof(hdr)) ||
+		    !batch_mdep_write(fd, data, len)) {
+			textout_delete(b);
+			return;
+		}
+		textout_delete(b);
+	}
+}
+
+/*
+ * serialize tracks of large songs with one process per processor,
+ * and store the text in each track, so song_output() only copies it.
+ * Memory outputs at the same indentation level as the tracks in the
+ * file are made, to serialize the tracks exactly as song_output()
+ * would. If anything fails, tracks not stored are serialized by
+ * song_output() as usual
+ */
+void
+song_outputpar(struct song *o, struct textout *f)
+{
+	struct save_par p;
+	struct textout *fmeta, *ftrk;
+	struct songtrk *t;
+	struct songchan *c;
+	unsigned char *data[SAVE_MAXJOBS], *q, *end;
+	unsigned len[SAVE_MAXJOBS], hdr[2], i, nevs, ntrks;
+
+	p.njobs = batch_mdep_ncpu();
+	if (p.njobs <= 1)
+		return;
+	if (p.njobs > SAVE_MAXJOBS)
+		p.njobs = SAVE_MAXJOBS;
+	ntrks = 1;
+	SONG_FOREACH_TRK(o, t)
+		ntrks++;
+	SONG_FOREACH_CHAN(o, c)
+		ntrks++;
+	p.trks = xmalloc(ntrks * sizeof(struct track *), "save_par");
+	p.outs = xmalloc(ntrks * sizeof(struct textout *), "save_par");
+	fmeta = textout_newbuf(f);
+	textout_shiftright(fmeta);
+	textout_putstr(fmeta, "meta ");
+	ftrk = textout_newbuf(fmeta);
+	textout_shiftright(ftrk);
+
+	p.ntrks = 0;
+	nevs = 0;
+	if (o->meta.txt.data == NULL || o->meta.txt.tag != evpat_gen) {
+		p.trks[p.ntrks] = &o->meta;
+		p.outs[p.ntrks++] = fmeta;
+		nevs += track_numev(&o->meta);
+	}
+	SONG_FOREACH_CHAN(o, c) {
+		if (c->conf.txt.data == NULL || c->conf.txt.tag != evpat_gen) {
+			p.trks[p.ntrks] = &c->conf;
+			p.outs[p.ntrks++] = ftrk;
+			nevs += track_numev(&c->conf);
+		}
+	}
+	SONG_FOREACH_TRK(o, t) {
+		if (t->track.txt.data == NULL ||
+		    t->track.txt.tag != evpat_gen) {
+			p.trks[p.ntrks] = &t->track;
+			p.outs[p.ntrks++] = ftrk;
+			nevs += track_numev(&t->track);
+		}
+	}
+	if (p.njobs > p.ntrks)
+		p.njobs = p.ntrks;
+	if (nevs >= SAVE_MINEVS && p.njobs > 1 &&
+	    batch_mdep_run(p.njobs, save_parwork, &p, data, len)) {
+		for (i = 0; i < p.njobs; i++) {
+			q = data[i];
+			end = data[i] + len[i];
+			while (end - q >= sizeof(hdr)) {
+				memcpy(hdr, q, sizeof(hdr));
+				q += sizeof(hdr);
+				if (hdr[0] >= p.ntrks || hdr[1] > end - q)
+					break;
+				track_blkset(&p.trks[hdr[0]]->txt,
+				    q, hdr[1], evpat_gen);
+				q += hdr[1];
+			}
+			xfree(data[i]);
+		}
+	}
+	textout_delete(ftrk);
+	textout_delete(fmeta);
+	xfree(p.outs);
+	xfree(p.trks);
+}
+
 void
 filt_output(struct filt *o, struct textout *f)
 {
@@ -330,7 +483,7 @@ songtrk_output(struct songtrk *o, struct textout *f)
 	textout_putstr(f, "\n");
 
 	textout_putstr(f, "track ");
-	track_output(&o->track, f);
+	track_outputblk(&o->track, f);
 	textout_putstr(f, "\n");
 
 	textout_shiftleft(f);
@@ -348,7 +501,7 @@ songchan_output(struct songchan *o, struct textout *f)
 	textout_putstr(f, "\n");
 
 	textout_putstr(f, "conf ");
-	track_output(&o->conf, f);
+	track_outputblk(&o->conf, f);
 	textout_putstr(f, "\n");
 
 	textout_shiftleft(f);
@@ -484,6 +637,8 @@ song_output(struct song *o, struct textout *f)
 	struct songfilt *g;
 	struct songsx *s;
 
+	song_outputpar(o, f);
+
 	textout_putstr(f, "{\n");
 	textout_shiftright(f);
 
@@ -500,7 +655,7 @@ song_output(struct song *o, struct textout *f)
 	textout_putstr(f, "\n");
 
 	textout_putstr(f, "meta ");
-	track_output(&o->meta, f);
+	track_outputblk(&o->meta, f);
 	textout_putstr(f, "\n");
 
 	evpat_output(f);
@@ -604,8 +759,9 @@ struct load {
 	char strval[TOK_MAXLEN + 1];
 	unsigned long longval;
 	struct textin *in;		/* input file */
+	unsigned char *p, *end;		/* characters not scanned yet */
+	unsigned char *pos;		/* last char, for error reporting */
 	int lookchar;			/* used by ungetchar */
-	unsigned line, col;		/* for error reporting */
 	unsigned lookavail;
 	int format;
 };
@@ -618,18 +774,33 @@ void	      load_ungetsym(struct load *);
 unsigned
 load_getchar(struct load *o, int *c)
 {
-	if (o->lookchar < 0) {
-		textin_getpos(o->in, &o->line, &o->col);
-		if (!textin_getchar(o->in, c)) {
-			return 0;
-		}
-	} else {
+	if (o->lookchar >= 0) {
 		*c = o->lookchar;
 		o->lookchar = -1;
+		return 1;
 	}
+	if (o->p == o->end) {
+		if (!textin_getbuf(o->in, &o->p, &o->end))
+			return 0;
+		if (o->p == o->end) {
+			o->pos = o->p;
+			*c = CHAR_EOF;
+			return 1;
+		}
+	}
+	o->pos = o->p;
+	*c = *o->p++;
 	return 1;
 }
 
+/*
+ * fast path of load_getchar(), for characters of the current block
+ */
+#define LOAD_GETCHAR(o, c)					\
+	(((o)->lookchar < 0 && (o)->p != (o)->end) ?		\
+	    ((o)->pos = (o)->p, *(c) = *(o)->p++, 1) :		\
+	    load_getchar((o), (c)))
+
 void
 load_ungetchar(struct load *o, int c)
 {
@@ -643,7 +814,10 @@ load_ungetchar(struct load *o, int c)
 void
 load_err(struct load *o, char *msg)
 {
-	cons_erruu(o->line + 1, o->col + 1, msg);
+	unsigned line, col;
+
+	textin_getpos(o->in, o->pos, &line, &col);
+	cons_erruu(line + 1, col + 1, msg);
 }
 
 unsigned
@@ -654,7 +828,7 @@ load_scan(struct load *o)
 	unsigned long val, maxq, maxr;
 
 	for (;;) {
-		if (!load_getchar(o, &c))
+		if (!LOAD_GETCHAR(o, &c))
 			return 0;
 
 		if (c == CHAR_EOF) {
@@ -665,7 +839,7 @@ load_scan(struct load *o)
 		/* check if line continues */
 		if (c == '\\') {
 			do {
-				if (!load_getchar(o, &c))
+				if (!LOAD_GETCHAR(o, &c))
 					return 0;
 			} while (c == ' ' || c == '\t' || c == '\r');
 			if (c == '\n')
@@ -679,24 +853,31 @@ load_scan(struct load *o)
 			return 0;
 		}
 
-		/* skip comments */
+		/* skip comments, block by block */
 		if (c == '#') {
-			do {
-				if (!load_getchar(o, &c))
+			for (;;) {
+				o->p = memchr(o->p, '\n', o->end - o->p);
+				if (o->p != NULL)
+					break;
+				o->p = o->end;
+				if (!LOAD_GETCHAR(o, &c))
 					return 0;
-			} while (c != '\n' && c != CHAR_EOF);
-			load_ungetchar(o, c);
+				if (c == CHAR_EOF || c == '\n') {
+					load_ungetchar(o, c);
+					break;
+				}
+			}
 			continue;
 		}
 
 		if (c >= '0' && c <= '9') {
 			base = 10;
 			if (c == '0') {
-				if (!load_getchar(o, &c))
+				if (!LOAD_GETCHAR(o, &c))
 					return 0;
 				if (c == 'x' || c == 'X') {
 					base = 16;
-					if (!load_getchar(o, &c))
+					if (!LOAD_GETCHAR(o, &c))
 						return 0;
 					if ((c < '0' || c > '9') &&
 					    (c < 'A' || c > 'F') &&
@@ -732,7 +913,7 @@ load_scan(struct load *o)
 					return 0;
 				}
 				val = val * base + dig;
-				if (!load_getchar(o, &c))
+				if (!LOAD_GETCHAR(o, &c))
 					return 0;
 			}
 			o->longval = val;
@@ -740,9 +921,7 @@ load_scan(struct load *o)
 			return 1;
 		}
 
-		if ((c >= 'a' && c <= 'z') ||
-		    (c >= 'A' && c <= 'Z') ||
-		    (c == '_')) {
+		if (IS_IDFIRST(c)) {
 			i = 0;
 			for (;;) {
 				if (i >= TOK_MAXLEN) {
@@ -750,13 +929,10 @@ load_scan(struct load *o)
 					return 0;
 				}
 				o->strval[i++] = c;
-				if (!load_getchar(o, &c)) {
+				if (!LOAD_GETCHAR(o, &c)) {
 					return 0;
 				}
-				if ((c < 'a' || c > 'z') &&
-				    (c < 'A' || c > 'Z') &&
-				    (c < '0' || c > '9') &&
-				    (c != '_')) {
+				if (!IS_IDNEXT(c)) {
 					o->strval[i++] = '\0';
 					load_ungetchar(o, c);
 					break;
@@ -790,7 +966,7 @@ load_scan(struct load *o)
 			o->id = TOK_GT;
 			return 1;
 		case '.':
-			if (!load_getchar(o, &cn))
+			if (!LOAD_GETCHAR(o, &cn))
 				return 0;
 			if (cn == '.') {
 				o->id = TOK_RANGE;
@@ -811,6 +987,7 @@ load_init(struct load *o, char *filename)
 	o->in = textin_new(filename);
 	if (!o->in)
 		return 0;
+	o->p = o->end = o->pos = NULL;
 	o->lookavail = 0;
 	o->format = 0;
 	return 1;
@@ -1190,7 +1367,7 @@ unsigned
 load_track(struct load *o, struct track *t)
 {
 	unsigned delta;
-	struct seqev *pos, *se;
+	struct trackbuf tb;
 	struct statelist slist;
 	struct ev ev, rev;
 	struct mididev *dev;
@@ -1203,12 +1380,11 @@ load_track(struct load *o, struct track *t)
 		return 0;
 	}
 	track_clear(t);
+	trackbuf_init(&tb);
 	statelist_init(&slist);
-	pos = t->first;
 	for (;;) {
 		if (!load_getsym(o)) {
-			statelist_done(&slist);
-			return 0;
+			goto err;
 		}
 		if (o->id == TOK_ENDLINE) {
 			/* nothing */
@@ -1217,15 +1393,13 @@ load_track(struct load *o, struct track *t)
 		} else if (o->id == TOK_NUM) {
 			load_ungetsym(o);
 			if (!load_delta(o, &delta)) {
-				statelist_done(&slist);
-				return 0;
+				goto err;
 			}
-			pos->delta += delta;
+			trackbuf_wait(&tb, delta);
 		} else {
 			load_ungetsym(o);
 			if (!load_ev(o, &ev)) {
-				statelist_done(&slist);
-				return 0;
+				goto err;
 			}
 			if (ev.cmd != EV_NULL) {
 				/*
@@ -1246,15 +1420,20 @@ load_track(struct load *o, struct track *t)
 				}
 				if (conv_packev(&slist, xctlset, evset,
 					&ev, &rev)) {
-					se = seqev_new();
-					se->ev = rev;
-					seqev_ins(pos, se);
+					trackbuf_put(&tb, &rev);
 				}
 			}
 		}
 	}
 	statelist_done(&slist);
+	track_build(t, &tb);
+	trackbuf_done(&tb);
 	return 1;
+err:
+	statelist_done(&slist);
+	track_build(t, &tb);
+	trackbuf_done(&tb);
+	return 0;
 }
 
 unsigned
@@ -2298,14 +2477,14 @@ load_song(struct load *o, struct song *s)
 	return 1;
 }
 
-void
+unsigned
 song_save(struct song *o, char *name)
 {
 	struct textout *f;
 
 	f = textout_new(name);
 	if (f == NULL) {
-		return;
+		return 0;
 	}
 	textout_putstr(f,
 	    "#\n"
@@ -2315,6 +2494,7 @@ song_save(struct song *o, char *name)
 	song_output(o, f);
 	textout_putstr(f, "\n");
 	textout_delete(f);
+	return 1;
 }
 
 unsigned
@@ -2323,6 +2503,8 @@ song_load(struct song *o, char *filename)
 	struct load p;
 	unsigned res;
 
+	if (songbin_probe(filename))
+		return songbin_load(o, filename);
 	if (!load_init(&p, filename))
 		return 0;
 	res = load_empty(&p);
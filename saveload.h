@@ -33,6 +33,7 @@ void ev_output(struct ev *, struct textout *);
 void evspec_output(struct evspec *, struct textout *);
 void evpat_output(struct textout *);
 void track_output(struct track *, struct textout *);
+void track_outputblk(struct track *, struct textout *);
 void rule_output(struct rule *, struct textout *);
 void filt_output(struct filt *, struct textout *);
 void songtrk_output(struct songtrk *, struct textout *);
@@ -45,7 +46,7 @@ void song_output(struct song *, struct textout *);
 void track_save(struct track *, char *);
 unsigned track_load(struct track *, char *);
 
-void song_save(struct song *, char *);
+unsigned song_save(struct song *, char *);
 unsigned song_load(struct song *, char *);
 
 
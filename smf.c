@@ -28,22 +28,64 @@
 #include "cons.h"
 #include "frame.h"
 #include "conv.h"
+#include "batch.h"
 
 #define MAXTRACKNAME 100
+#define SMF_MAXJOBS	16		/* max processes parsing tracks */
+#define SMF_MINPAR	0x40000		/* min file size to use processes */
+
+/*
+ * tracks parsed in parallel, process 'n' parses tracks n, n + njobs,
+ * n + 2 * njobs, ...
+ */
+struct smf_par {
+	struct smf *trk;		/* located track chunks */
+	struct song *song;		/* song being imported */
+	unsigned ntrks, njobs;
+	unsigned split;			/* one buffer per channel */
+};
 
 char smftype_header[4] = { 'M', 'T', 'h', 'd' };
 char smftype_track[4]  = { 'M', 'T', 'r', 'k' };
 
 unsigned smf_evlen[] = { 2, 2, 2, 2, 1, 1, 2, 0 };
-#define SMF_EVLEN(status) (smf_evlen[((status) >> 4) & 7])
 
 /* --------------------------------------------- chunk read/write --- */
 
-struct smf
+#define SMF_BUFLEN	0x4000		/* initial write buffer size */
+
+/*
+ * load the given file in memory, return 0 on error
+ */
+unsigned
+smf_load(struct smf *o, char *path)
 {
-	FILE *file;
-	unsigned length, index;		/* current chunk length/position */
-};
+	FILE *f;
+	long size;
+
+	f = fopen(path, "r");
+	if (!f) {
+		cons_errs(path, "failed to open file");
+		return 0;
+	}
+	if (fseek(f, 0, SEEK_END) < 0 || (size = ftell(f)) < 0 ||
+	    fseek(f, 0, SEEK_SET) < 0) {
+		cons_errs(path, "failed to get file size");
+		fclose(f);
+		return 0;
+	}
+	o->data = xmalloc(size > 0 ? size : 1, "smf");
+	if (size > 0 && fread(o->data, size, 1, f) != 1) {
+		cons_errs(path, "failed to read file");
+		xfree(o->data);
+		fclose(f);
+		return 0;
+	}
+	fclose(f);
+	o->p = o->cend = o->data;
+	o->end = o->data + size;
+	return 1;
+}
 
 /*
  * open a standard midi file and initialize
@@ -52,23 +94,41 @@ struct smf
 unsigned
 smf_open(struct smf *o, char *path, char *mode)
 {
+	if (mode[0] == 'r') {
+		o->file = NULL;
+		return smf_load(o, path);
+	}
 	o->file = fopen(path, mode);
 	if (!o->file) {
 		cons_errs(path, "failed to open file");
 		return 0;
 	}
-	o->length = 0;
-	o->index = 0;
+	o->path = path;
+	o->data = xmalloc(SMF_BUFLEN, "smf");
+	o->p = o->cend = o->data;
+	o->end = o->data + SMF_BUFLEN;
 	return 1;
 }
 
 /*
- * close the file
+ * close the file, if writing, store the buffer contents in the file
+ * first. Return 0 on error
  */
-void
+unsigned
 smf_close(struct smf *o)
 {
-	fclose(o->file);
+	unsigned res = 1;
+
+	if (o->file) {
+		if ((o->p > o->data &&
+		    fwrite(o->data, o->p - o->data, 1, o->file) != 1) ||
+		    fclose(o->file) != 0) {
+			cons_errs(o->path, "failed to write file");
+			res = 0;
+		}
+	}
+	xfree(o->data);
+	return res;
 }
 
 /*
@@ -77,13 +137,14 @@ smf_close(struct smf *o)
 unsigned
 smf_get32(struct smf *o, unsigned *val)
 {
-	unsigned char buf[4];
-	if (o->index + 4 > o->length || fread(buf, 1, 4, o->file) != 4) {
+	unsigned char *p = o->p;
+
+	if (o->cend - p < 4) {
 		cons_err("failed to read 32bit number");
 		return 0;
 	}
-	*val = (buf[0] << 24) + (buf[1] << 16) + (buf[2] << 8) + buf[3];
-	o->index += 4;
+	*val = (p[0] << 24) + (p[1] << 16) + (p[2] << 8) + p[3];
+	o->p = p + 4;
 	return 1;
 }
 
@@ -93,13 +154,14 @@ smf_get32(struct smf *o, unsigned *val)
 unsigned
 smf_get24(struct smf *o, unsigned *val)
 {
-	unsigned char buf[4];
-	if (o->index + 3 > o->length || fread(buf, 1, 3, o->file) != 3) {
+	unsigned char *p = o->p;
+
+	if (o->cend - p < 3) {
 		cons_err("failed to read 24bit number");
 		return 0;
 	}
-	*val = (buf[0] << 16) + (buf[1] << 8) + buf[2];
-	o->index += 3;
+	*val = (p[0] << 16) + (p[1] << 8) + p[2];
+	o->p = p + 3;
 	return 1;
 }
 
@@ -109,13 +171,14 @@ smf_get24(struct smf *o, unsigned *val)
 unsigned
 smf_get16(struct smf *o, unsigned *val)
 {
-	unsigned char buf[4];
-	if (o->index + 2 > o->length || fread(buf, 1, 2, o->file) != 2) {
+	unsigned char *p = o->p;
+
+	if (o->cend - p < 2) {
 		cons_err("failed to read 16bit number");
 		return 0;
 	}
-	*val =  (buf[0] << 8) + buf[1];
-	o->index += 2;
+	*val = (p[0] << 8) + p[1];
+	o->p = p + 2;
 	return 1;
 }
 
@@ -125,13 +188,11 @@ smf_get16(struct smf *o, unsigned *val)
 unsigned
 smf_getc(struct smf *o, unsigned *res)
 {
-	int c;
-	if (o->index + 1 > o->length || (c = fgetc(o->file)) < 0) {
+	if (o->p == o->cend) {
 		cons_err("failed to read one byte");
 		return 0;
 	}
-	o->index++;
-	*res = c & 0xff;
+	*res = *o->p++;
 	return 1;
 }
 
@@ -141,21 +202,30 @@ smf_getc(struct smf *o, unsigned *res)
 unsigned
 smf_getvar(struct smf *o, unsigned *val)
 {
-	int c;
-	unsigned bits;
-	*val = 0;
+	unsigned char *p = o->p;
+	unsigned c, v, bits;
+
+	/*
+	 * fast path for the common 1-byte case (ex. delta times)
+	 */
+	if (p != o->cend && !(*p & 0x80)) {
+		*val = *p;
+		o->p = p + 1;
+		return 1;
+	}
+	v = 0;
 	bits = 0;
 	for (;;) {
-		if (o->index + 1 > o->length || (c = fgetc(o->file)) == EOF) {
+		if (p == o->cend) {
 			cons_err("failed to read varlength number");
 			return 0;
 		}
-		o->index++;
-		*val += (c & 0x7f);
+		c = *p++;
+		v += (c & 0x7f);
 		if (!(c & 0x80)) {
 			break;
 		}
-		*val <<= 7;
+		v <<= 7;
 		bits += 7;
 		/*
 		 * smf spec forbids more than 32bit per integer
@@ -165,6 +235,8 @@ smf_getvar(struct smf *o, unsigned *val)
 			return 0;
 		}
 	}
+	*val = v;
+	o->p = p;
 	return 1;
 }
 
@@ -177,102 +249,96 @@ smf_getvar(struct smf *o, unsigned *val)
 unsigned
 smf_getheader(struct smf *o, char *hdr)
 {
-	char buf[4];
 	unsigned len;
-	if (o->index != o->length) {
+
+	if (o->p != o->cend) {
 		cons_err("chunk not finished");
 		return 0;
 	}
-	if (fread(buf, 1, 4, o->file) != 4) {
+	if (o->end - o->p < 8) {
 		cons_err("failed to read header");
 		return 0;
 	}
-	if (memcmp(buf, hdr, 4) != 0) {
+	if (memcmp(o->p, hdr, 4) != 0) {
 		cons_err("header corrupted");
 		return 0;
 	}
-	o->index = 0;
-	o->length = 4;
+	o->p += 4;
+	o->cend = o->p + 4;
 	if (!smf_get32(o, &len)) {
 		return 0;
 	}
-	o->index = 0;
-	o->length = len;
+	if (len > o->end - o->p) {
+		cons_err("chunk truncated");
+		return 0;
+	}
+	o->cend = o->p + len;
 	return 1;
 }
 
 /*
- * in smf_putxxx routines there is a 'unsigned *used' argument if
- * (used == NULL) then data is not written in the smf structure, only
- * *user is incremented by the number of bytes that would be written
- * otherwise.  This is used to determine chunk's length
+ * make room for at least the given number of bytes in the write
+ * buffer
  */
-
+void
+smf_grow(struct smf *o, unsigned len)
+{
+	unsigned char *data;
+	size_t used, size;
+
+	used = o->p - o->data;
+	size = o->end - o->data;
+	while (size - used < len)
+		size *= 2;
+	data = xmalloc(size, "smf");
+	memcpy(data, o->data, used);
+	xfree(o->data);
+	o->cend = data + (o->cend - o->data);
+	o->data = data;
+	o->p = data + used;
+	o->end = data + size;
+}
 
 /*
  * put a fixed-size 32-bit number
  */
 void
-smf_put32(struct smf *o, unsigned *used, unsigned val)
+smf_put32(struct smf *o, unsigned val)
 {
-	unsigned char buf[4];
-	if (used) {
-		(*used) += 4;
-	} else {
-		if (o->index + 4 > o->length) {
-			log_puts("smf_put32: bad chunk length\n");
-			panic();
-		}
-		buf[0] = (val >> 24) & 0xff;
-		buf[1] = (val >> 16) & 0xff;
-		buf[2] = (val >> 8) & 0xff;
-		buf[3] = val & 0xff;
-		fwrite(buf, 1, 4, o->file);
-		o->index += 4;
-	}
+	if (o->end - o->p < 4)
+		smf_grow(o, 4);
+	o->p[0] = (val >> 24) & 0xff;
+	o->p[1] = (val >> 16) & 0xff;
+	o->p[2] = (val >> 8) & 0xff;
+	o->p[3] = val & 0xff;
+	o->p += 4;
 }
 
 /*
  * put a fixed-size 24-bit number
  */
 void
-smf_put24(struct smf *o, unsigned *used, unsigned val)
+smf_put24(struct smf *o, unsigned val)
 {
-	unsigned char buf[4];
-	if (used) {
-		(*used) += 3;
-	} else {
-		if (o->index + 3 > o->length) {
-			log_puts("smf_put24: bad chunk length\n");
-			panic();
-		}
-		buf[0] = (val >> 16) & 0xff;
-		buf[1] = (val >> 8) & 0xff;
-		buf[2] = val & 0xff;
-		fwrite(buf, 1, 3, o->file);
-		o->index += 3;
-	}
+	if (o->end - o->p < 3)
+		smf_grow(o, 3);
+	o->p[0] = (val >> 16) & 0xff;
+	o->p[1] = (val >> 8) & 0xff;
+	o->p[2] = val & 0xff;
+	o->p += 3;
 }
 
 /*
  * put a fixed-size 16-bit number
  */
 void
-smf_put16(struct smf *o, unsigned *used, unsigned val)
+smf_put16(struct smf *o, unsigned val)
 {
-	unsigned char buf[4];
-	if (used) {
-		(*used) += 2;
-	} else {
-		if (o->index + 2 > o->length) {
-			log_puts("smf_put16: bad chunk length\n");
-			panic();
-		}
-		buf[0] = (val >> 8) & 0xff;
-		buf[1] = val & 0xff;
-		fwrite(buf, 1, 2, o->file);
-		o->index += 2;
-	}
+	if (o->end - o->p < 2)
+		smf_grow(o, 2);
+	o->p[0] = (val >> 8) & 0xff;
+	o->p[1] = val & 0xff;
+	o->p += 2;
 }
 
 
@@ -280,30 +346,39 @@ smf_put16(struct smf *o, unsigned *used, unsigned val)
  * put a fixed-size 8-bit number
  */
 void
-smf_putc(struct smf *o, unsigned *used, unsigned val)
+smf_putc(struct smf *o, unsigned val)
 {
-	if (used) {
-		(*used) ++;
-	} else {
-		if (o->index + 1 > o->length) {
-			log_puts("smf_putc: bad chunk length\n");
-			panic();
-		}
-		fputc((int)val & 0xff, o->file);
-		o->index++;
-	}
+	if (o->p == o->end)
+		smf_grow(o, 1);
+	*o->p++ = val & 0xff;
 }
 
+/*
+ * put the given bytes
+ */
+void
+smf_putbuf(struct smf *o, unsigned char *buf, unsigned len)
+{
+	if (o->end - o->p < len)
+		smf_grow(o, len);
+	memcpy(o->p, buf, len);
+	o->p += len;
+}
 
 /*
  * put a variable length number
  */
 void
-smf_putvar(struct smf *o, unsigned *used, unsigned val)
+smf_putvar(struct smf *o, unsigned val)
 {
 #define MAXBYTES 5			/* 32bit / 7bit = 4bytes + 4bit */
 	unsigned char buf[MAXBYTES];
 	unsigned index = 0, bits;
+
+	if (val < 0x80) {
+		smf_putc(o, val);
+		return;
+	}
 	for (bits = 7; bits < MAXBYTES * 7; bits += 7) {
 		if (val < (1U << bits)) {
 			bits -= 7;
@@ -311,16 +386,7 @@ smf_putvar(struct smf *o, unsigned *used, unsigned val)
 				buf[index++] = ((val >> bits) & 0x7f) | 0x80;
 			}
 			buf[index++] = val & 0x7f;
-			if (used) {
-				(*used) += index;
-			} else {
-				if (o->index + index > o->length) {
-					log_puts("smf_putvar: bad chunk length\n");
-					panic();
-				}
-				o->index += index;
-				fwrite(buf, 1, index, o->file);
-			}
+			smf_putbuf(o, buf, index);
 			return;
 		}
 	}
@@ -330,24 +396,39 @@ smf_putvar(struct smf *o, unsigned *used, unsigned val)
 }
 
 /*
- * put the given chunk header with the given magic and size field
+ * start a chunk with the given magic, its size field is set by
+ * smf_putend() once the chunk is complete
  */
 void
-smf_putheader(struct smf *o, char *hdr, unsigned len)
+smf_putheader(struct smf *o, char *hdr)
 {
-	fwrite(hdr, 1, 4, o->file);
-	o->length = 4;
-	o->index = 0;
-	smf_put32(o, NULL, len);
-	o->length = len;
-	o->index = 0;
+	smf_putbuf(o, (unsigned char *)hdr, 4);
+	smf_put32(o, 0);
+	o->cend = o->p;
+}
+
+/*
+ * finish the current chunk by setting its size field
+ */
+void
+smf_putend(struct smf *o)
+{
+	unsigned len;
+	unsigned char *p;
+
+	len = o->p - o->cend;
+	p = o->cend - 4;
+	p[0] = (len >> 24) & 0xff;
+	p[1] = (len >> 16) & 0xff;
+	p[2] = (len >> 8) & 0xff;
+	p[3] = len & 0xff;
 }
 
 /*
  * store a track in the smf
  */
 void
-smf_puttrack(struct smf *o, unsigned *used, struct song *s, struct track *t)
+smf_puttrack(struct smf *o, struct song *s, struct track *t)
 {
 	struct seqev *pos;
 	unsigned status, newstatus, delta, chan, denom;
@@ -368,31 +449,31 @@ smf_puttrack(struct smf *o, unsigned *used, struct song *s, struct track *t)
 			nev = conv_unpackev(&slist, 0U,
 			    CONV_XPC | CONV_NRPN | CONV_RPN, &pos->ev, rev);
 			for (i = 0; i < nev; i++) {
-				smf_putvar(o, used, delta);
+				smf_putvar(o, delta);
 				delta = 0;
 				chan = rev[i].ch;
 				newstatus = (rev[i].cmd << 4) + (chan & 0x0f);
 				if (newstatus != status) {
 					status = newstatus;
-					smf_putc(o, used, status);
+					smf_putc(o, status);
 				}
 				if (rev[i].cmd == EV_BEND) {
-					smf_putc(o, used, rev[i].bend_val & 0x7f);
-					smf_putc(o, used, rev[i].bend_val >> 7);
+					smf_putc(o, rev[i].bend_val & 0x7f);
+					smf_putc(o, rev[i].bend_val >> 7);
 				} else {
-					smf_putc(o, used, rev[i].v0);
+					smf_putc(o, rev[i].v0);
 					if (SMF_EVLEN(status) == 2) {
-						smf_putc(o, used, rev[i].v1);
+						smf_putc(o, rev[i].v1);
 					}
 				}
 			}
 		} else if (pos->ev.cmd == EV_TEMPO) {
-			smf_putvar(o, used, delta);
+			smf_putvar(o, delta);
 			delta = 0;
-			smf_putc(o, used, 0xff);
-			smf_putc(o, used, 0x51);
-			smf_putc(o, used, 0x03);
-			smf_put24(o, used, pos->ev.tempo_usec24 * s->tics_per_unit / 96);
+			smf_putc(o, 0xff);
+			smf_putc(o, 0x51);
+			smf_putc(o, 0x03);
+			smf_put24(o, pos->ev.tempo_usec24 * s->tics_per_unit / 96);
 		} else if (pos->ev.cmd == EV_TIMESIG) {
 			denom = s->tics_per_unit / pos->ev.timesig_tics;
 			switch(denom) {
@@ -415,45 +496,43 @@ smf_puttrack(struct smf *o, unsigned *used, struct song *s, struct track *t)
 				log_puts("smf_puttrack: bad time signature\n");
 				panic();
 			}
-			smf_putvar(o, used, delta);
+			smf_putvar(o, delta);
 			delta = 0;
-			smf_putc(o, used, 0xff);
-			smf_putc(o, used, 0x58);
-			smf_putc(o, used, 0x04);
-			smf_putc(o, used, pos->ev.timesig_beats);
-			smf_putc(o, used, denom);
+			smf_putc(o, 0xff);
+			smf_putc(o, 0x58);
+			smf_putc(o, 0x04);
+			smf_putc(o, pos->ev.timesig_beats);
+			smf_putc(o, denom);
 			/* metronome tics per metro beat */
-			smf_putc(o, used, pos->ev.timesig_tics);
+			smf_putc(o, pos->ev.timesig_tics);
 			/* metronome 1/32 notes per 24 tics */
-			smf_putc(o, used, 8 * s->tics_per_unit / 96);
+			smf_putc(o, 8 * s->tics_per_unit / 96);
 		}
 
 	}
-	smf_putvar(o, used, delta);
-	smf_putc(o, used, 0xff);
-	smf_putc(o, used, 0x2f);
-	smf_putc(o, used, 0x00);
+	smf_putvar(o, delta);
+	smf_putc(o, 0xff);
+	smf_putc(o, 0x2f);
+	smf_putc(o, 0x00);
 	statelist_done(&slist);
 }
 
 /*
- * store a sysex in the smf
+ * store a sysex in the smf, without the leading 0xf0 byte
  */
 void
-smf_putsysex(struct smf *o, unsigned *used, struct sysex *sx)
+smf_putsysex(struct smf *o, struct sysex *sx)
 {
 	struct chunk *c;
-	unsigned i, first;
+	unsigned first;
 
 	first = 1;
 	for (c = sx->first; c != NULL; c = c->next) {
-		for (i = 0; i < c->used; i++) {
-			if (first) {
-				first = 0;
-			} else {
-				smf_putc(o, used, c->data[i]);
-			}
-		}
+		if (first && c->used > 0) {
+			first = 0;
+			smf_putbuf(o, c->data + 1, c->used - 1);
+		} else
+			smf_putbuf(o, c->data, c->used);
 	}
 }
 
@@ -461,23 +540,25 @@ smf_putsysex(struct smf *o, unsigned *used, struct sysex *sx)
  * store a sysex back in the smf
  */
 void
-smf_putsx(struct smf *o, unsigned *used, struct song *s, struct songsx *songsx)
+smf_putsx(struct smf *o, struct song *s, struct songsx *songsx)
 {
-	unsigned sysexused;
+	unsigned len;
 	struct sysex *sx;
+	struct chunk *c;
 
 	for (sx = songsx->sx.first; sx != NULL; sx = sx->next) {
-		sysexused = 0;
-		smf_putvar(o, used, 0);
-		smf_putc(o, used, 0xf0);
-		smf_putsysex(o, &sysexused, sx);
-		smf_putvar(o, used, sysexused);
-		smf_putsysex(o, used, sx);
+		len = 0;
+		for (c = sx->first; c != NULL; c = c->next)
+			len += c->used;
+		smf_putvar(o, 0);
+		smf_putc(o, 0xf0);
+		smf_putvar(o, len > 0 ? len - 1 : 0);
+		smf_putsysex(o, sx);
 	}
-	smf_putvar(o, used, 0);
-	smf_putc(o, used, 0xff);
-	smf_putc(o, used, 0x2f);
-	smf_putc(o, used, 0x00);
+	smf_putvar(o, 0);
+	smf_putc(o, 0xff);
+	smf_putc(o, 0x2f);
+	smf_putc(o, 0x00);
 }
 
 /*
@@ -490,7 +571,7 @@ song_exportsmf(struct song *o, char *filename)
 	struct songtrk *t;
 	struct songchan *i;
 	struct songsx *s;
-	unsigned ntrks, nchan, nsx, used;
+	unsigned ntrks, nchan, nsx;
 
 	if (!smf_open(&f, filename, "w")) {
 		return 0;
@@ -513,27 +594,26 @@ song_exportsmf(struct song *o, char *filename)
 	/*
 	 * write the header
 	 */
-	smf_putheader(&f, smftype_header, 6);
-	smf_put16(&f, NULL, 1);				/* format = 1 */
-	smf_put16(&f, NULL, nsx + ntrks + nchan + 1);	/* +1 -> meta track */
-	smf_put16(&f, NULL, o->tics_per_unit / 4);		/* tics per quarter */
+	smf_putheader(&f, smftype_header);
+	smf_put16(&f, 1);				/* format = 1 */
+	smf_put16(&f, nsx + ntrks + nchan + 1);	/* +1 -> meta track */
+	smf_put16(&f, o->tics_per_unit / 4);		/* tics per quarter */
+	smf_putend(&f);
 
 	/*
 	 * write the tempo track
 	 */
-	used = 0;
-	smf_puttrack(&f, &used, o, &o->meta);
-	smf_putheader(&f, smftype_track, used);
-	smf_puttrack(&f, NULL, o, &o->meta);
+	smf_putheader(&f, smftype_track);
+	smf_puttrack(&f, o, &o->meta);
+	smf_putend(&f);
 
 	/*
 	 * write each sx
 	 */
 	SONG_FOREACH_SX(o, s) {
-		used = 0;
-		smf_putsx(&f, &used, o, s);
-		smf_putheader(&f, smftype_track, used);
-		smf_putsx(&f, NULL, o, s);
+		smf_putheader(&f, smftype_track);
+		smf_putsx(&f, o, s);
+		smf_putend(&f);
 	}
 
 	/*
@@ -542,23 +622,20 @@ song_exportsmf(struct song *o, char *filename)
 	SONG_FOREACH_CHAN(o, i) {
 		if (i->isinput)
 			continue;
-		used = 0;
-		smf_puttrack(&f, &used, o, &i->conf);
-		smf_putheader(&f, smftype_track, used);
-		smf_puttrack(&f, NULL, o, &i->conf);
+		smf_putheader(&f, smftype_track);
+		smf_puttrack(&f, o, &i->conf);
+		smf_putend(&f);
 	}
 
 	/*
 	 * write each track
 	 */
 	SONG_FOREACH_TRK(o, t) {
-		used = 0;
-		smf_puttrack(&f, &used, o, &t->track);
-		smf_putheader(&f, smftype_track, used);
-		smf_puttrack(&f, NULL, o, &t->track);
+		smf_putheader(&f, smftype_track);
+		smf_puttrack(&f, o, &t->track);
+		smf_putend(&f);
 	}
-	smf_close(&f);
-	return 1;
+	return smf_close(&f);
 }
 
 /*
@@ -567,59 +644,91 @@ song_exportsmf(struct song *o, char *filename)
 unsigned
 smf_getsysex(struct smf *o, struct sysex *sx)
 {
-	unsigned i, length, c;
+	unsigned length;
 
 	if (!smf_getvar(o, &length)) {
 		return 0;
 	}
-	for (i = 0; i < length; i++) {
-		if (!smf_getc(o, &c)) {
+	if (length > o->cend - o->p) {
+		cons_err("failed to read one byte");
+		return 0;
+	}
+	sysex_addbuf(sx, o->p, length);
+	o->p += length;
+	return 1;
+}
+
+/*
+ * skip the given number of bytes, return 0 on error
+ */
+unsigned
+smf_skip(struct smf *o, unsigned length)
+{
+	if (length > o->cend - o->p) {
+		cons_err("failed to read one byte");
+		return 0;
+	}
+	o->p += length;
+	return 1;
+}
+
+/*
+ * locate the given number of track chunks, and initialize one smf
+ * structure per track, so tracks can be parsed independently
+ */
+unsigned
+smf_index(struct smf *o, struct smf *trk, unsigned ntrks)
+{
+	unsigned i;
+
+	for (i = 0; i < ntrks; i++) {
+		if (!smf_getheader(o, smftype_track)) {
 			return 0;
 		}
-		sysex_add(sx, c);
+		trk[i] = *o;
+		o->p = o->cend;
 	}
 	return 1;
 }
 
 /*
- * parse a track 'varlen event varlen event ... varlen event'
+ * parse a track 'varlen event varlen event ... varlen event' from a
+ * chunk located with smf_index(), sysex messages are appended to the
+ * given list. Events are packed and dispatched as they are decoded:
+ * meta events to the 'meta' buffer and voice events to the buffer of
+ * their channel (entries of 'chan' may point to the same buffer).
+ * All buffers are extended to the end of the track. Only the song
+ * tics_per_unit is used, so tracks may be parsed in any order.
  */
 unsigned
-smf_gettrack(struct smf *o, struct song *s, struct songtrk *t)
+smf_gettrack(struct smf *o, struct song *s, struct trackbuf **chan,
+    struct trackbuf *meta, struct sysexlist *sxlist)
 {
-	unsigned delta, i, status, type, length, abspos;
+	unsigned delta, status, type, length, abspos;
 	unsigned tempo, num, den, dummy;
 	struct statelist slist;
-	struct songsx *songsx;
-	struct seqev *pos, *se;
+	struct trackbuf *tb;
 	struct sysex *sx;
 	struct mididev *dev;
 	struct ev ev, rev;
 	unsigned xctlset, evset;
-	unsigned c;
+	unsigned c, i;
 
-	if (!smf_getheader(o, smftype_track)) {
-		return 0;
-	}
 	status = 0;
 	abspos = 0;
-	track_clear(&t->track);
-	pos = t->track.first;
-	songsx = (struct songsx *)s->sxlist;	/* first (and unique) sysex in song */
-	if (songsx == NULL) {
-		songsx = song_sxnew(s, "smf");
-	}
 	statelist_init(&slist);
 	for (;;) {
-		if (o->index >= o->length) {
+		if (o->p == o->cend) {
 			statelist_done(&slist);
+			trackbuf_moveto(meta, abspos);
+			for (i = 0; i <= EV_MAXCH; i++)
+				trackbuf_moveto(chan[i], abspos);
 			return 1;
 		}
 		if (!smf_getvar(o, &delta)) {
 			goto err;
 		}
 		abspos += delta;
-		pos->delta += delta;
 		if (!smf_getc(o, &c)) {
 			goto err;;
 		}
@@ -672,10 +781,8 @@ smf_gettrack(struct smf *o, struct song *s, struct songtrk *t)
 				goto putev;
 			} else {
 			ignoremeta:
-				for (i = 0; i < length; i++) {
-					if (!smf_getc(o, &c)) {
-						goto err;
-					}
+				if (!smf_skip(o, length)) {
+					goto err;
 				}
 			}
 		} else if (c == 0xf7) {
@@ -685,10 +792,8 @@ smf_gettrack(struct smf *o, struct song *s, struct songtrk *t)
 			if (!smf_getvar(o, &length)) {
 				goto err;
 			}
-			for (i = 0; i < length; i++) {
-				if (!smf_getc(o, &c)) {
-					goto err;
-				}
+			if (!smf_skip(o, length)) {
+				goto err;
 			}
 		} else if (c == 0xf0) {
 			/* sys ex */
@@ -700,7 +805,7 @@ smf_gettrack(struct smf *o, struct song *s, struct songtrk *t)
 				goto err;
 			}
 			if (sysex_check(sx)) {
-				sysexlist_put(&songsx->sx, sx);
+				sysexlist_put(sxlist, sx);
 			} else {
 				cons_err("corrupted sysex message, ignored");
 				/*
@@ -754,9 +859,9 @@ smf_gettrack(struct smf *o, struct song *s, struct songtrk *t)
 			}
 			if (conv_packev(&slist, xctlset, evset,
 				&ev, &rev)) {
-				se = seqev_new();
-				se->ev = rev;
-				seqev_ins(pos, se);
+				tb = EV_ISMETA(&rev) ? meta : chan[rev.ch];
+				trackbuf_moveto(tb, abspos);
+				trackbuf_put(tb, &rev);
 			}
 			/*
 			log_puts("ev: ");
@@ -782,65 +887,185 @@ smf_gettrack(struct smf *o, struct song *s, struct songtrk *t)
 }
 
 /*
- * fix song imported from format 1 smf
+ * send the contents of a track buffer to the parent process
  */
-void
-song_fix1(struct song *o)
+unsigned
+smf_putbuf_par(int fd, struct trackbuf *tb)
 {
-	struct track copy;
-	struct seqptr *tp, *cp;
-	struct state *st;
-	struct statelist slist;
-	struct songtrk *t, *tnext;
-	unsigned delta;
+	unsigned hdr[2];
 
-	SONG_FOREACH_TRK(o, t) {
-		/*
-		 * move meta events into meta track
-		 */
-		delta = 0;
-		track_init(&copy);
-		cp = seqptr_new(&copy);
-		tp = seqptr_new(&t->track);
-		statelist_init(&slist);
-		for (;;) {
-			delta = seqptr_ticdel(tp, ~0U, &slist);
-			seqptr_ticput(tp, delta);
-			seqptr_ticput(cp, delta);
-			st = seqptr_evdel(tp, &slist);
-			if (st == NULL) {
-				break;
-			}
-			if (st->phase & EV_PHASE_FIRST) {
-				st->tag = EV_ISMETA(&st->ev) ? 1 : 0;
-			}
-			if (st->tag) {
-				seqptr_evput(cp, &st->ev);
-			} else {
-				seqptr_evput(tp, &st->ev);
-			}
+	hdr[0] = tb->nevs;
+	hdr[1] = tb->delta;
+	return batch_mdep_write(fd, hdr, sizeof(hdr)) &&
+	    batch_mdep_write(fd, tb->evs, tb->nevs * sizeof(struct seqev_data));
+}
+
+/*
+ * send a sysex list to the parent process
+ */
+unsigned
+smf_putsx_par(int fd, struct sysexlist *l)
+{
+	struct sysex *sx;
+	struct chunk *c;
+	unsigned n;
+
+	n = 0;
+	for (sx = l->first; sx != NULL; sx = sx->next)
+		n++;
+	if (!batch_mdep_write(fd, &n, sizeof(n)))
+		return 0;
+	for (sx = l->first; sx != NULL; sx = sx->next) {
+		n = 0;
+		for (c = sx->first; c != NULL; c = c->next)
+			n += c->used;
+		if (!batch_mdep_write(fd, &n, sizeof(n)))
+			return 0;
+		for (c = sx->first; c != NULL; c = c->next) {
+			if (!batch_mdep_write(fd, c->data, c->used))
+				return 0;
 		}
-		statelist_done(&slist);
-		seqptr_del(tp);
-		seqptr_del(cp);
-		track_merge(&o->meta, &copy);
-		track_done(&copy);
 	}
+	return 1;
+}
 
-	/*
-	 * remove the first track, if there are not events
-	 */
-	for (t = (struct songtrk *)o->trklist; t != NULL; t = tnext) {
-		tnext = (struct songtrk *)t->name.next;
-		if (t->track.first->ev.cmd == EV_NULL) {
-			song_trkdel(o, t);
+/*
+ * parse the tracks assigned to the given process, each one is sent as
+ * its index, a success flag, the meta buffer, the voice buffers and
+ * the sysex list. Parsing stops on the first error
+ */
+void
+smf_parwork(void *arg, unsigned idx, int fd)
+{
+	struct smf_par *p = arg;
+	struct trackbuf meta, buf[EV_MAXCH + 1], *chan[EV_MAXCH + 1];
+	struct sysexlist sxlist;
+	unsigned hdr[2], i, c, nbufs;
+
+	nbufs = p->split ? EV_MAXCH + 1 : 1;
+	for (c = 0; c <= EV_MAXCH; c++)
+		chan[c] = &buf[p->split ? c : 0];
+	for (i = idx; i < p->ntrks; i += p->njobs) {
+		trackbuf_init(&meta);
+		for (c = 0; c < nbufs; c++)
+			trackbuf_init(&buf[c]);
+		sysexlist_init(&sxlist);
+		hdr[0] = i;
+		hdr[1] = smf_gettrack(&p->trk[i], p->song, chan, &meta, &sxlist);
+		if (!batch_mdep_write(fd, hdr, sizeof(hdr)))
+			hdr[1] = 0;
+		if (hdr[1] && !smf_putbuf_par(fd, &meta))
+			hdr[1] = 0;
+		for (c = 0; c < nbufs; c++) {
+			if (hdr[1] && !smf_putbuf_par(fd, &buf[c]))
+				hdr[1] = 0;
+			trackbuf_done(&buf[c]);
+		}
+		if (hdr[1] && !smf_putsx_par(fd, &sxlist))
+			hdr[1] = 0;
+		sysexlist_done(&sxlist);
+		trackbuf_done(&meta);
+		if (!hdr[1])
+			return;
+	}
+}
+
+/*
+ * copy the given number of bytes from the output of a process, which
+ * is read through a smf structure, return 0 on error
+ */
+unsigned
+smf_getraw_par(struct smf *o, void *buf, unsigned len)
+{
+	if (len > o->end - o->p) {
+		cons_err("truncated output of track parser");
+		return 0;
+	}
+	memcpy(buf, o->p, len);
+	o->p += len;
+	return 1;
+}
+
+/*
+ * read a track buffer sent by smf_putbuf_par()
+ */
+unsigned
+smf_getbuf_par(struct smf *o, struct trackbuf *tb)
+{
+	struct seqev_data e;
+	unsigned hdr[2], i;
+
+	if (!smf_getraw_par(o, hdr, sizeof(hdr)))
+		return 0;
+	if (hdr[0] > (o->end - o->p) / sizeof(struct seqev_data)) {
+		cons_err("truncated output of track parser");
+		return 0;
+	}
+	for (i = 0; i < hdr[0]; i++) {
+		memcpy(&e, o->p, sizeof(struct seqev_data));
+		o->p += sizeof(struct seqev_data);
+		trackbuf_wait(tb, e.delta);
+		trackbuf_put(tb, &e.ev);
+	}
+	trackbuf_wait(tb, hdr[1]);
+	return 1;
+}
+
+/*
+ * read a sysex list sent by smf_putsx_par()
+ */
+unsigned
+smf_getsx_par(struct smf *o, struct sysexlist *l)
+{
+	struct sysex *sx;
+	unsigned n, len;
+
+	if (!smf_getraw_par(o, &n, sizeof(n)))
+		return 0;
+	while (n-- > 0) {
+		if (!smf_getraw_par(o, &len, sizeof(len)))
+			return 0;
+		if (len > o->end - o->p) {
+			cons_err("truncated output of track parser");
+			return 0;
 		}
+		sx = sysex_new(0);
+		sysex_addbuf(sx, o->p, len);
+		sysexlist_put(l, sx);
+		o->p += len;
 	}
+	return 1;
 }
 
 /*
- * fix song imported from format 0 SMFs: call fix1 to move meta events
- * to the meta-track then split it creating one track per channel
+ * read the given track, as parsed by smf_parwork(), return 0 if it
+ * couldn't be parsed
+ */
+unsigned
+smf_gettrack_par(struct smf *o, unsigned idx, struct trackbuf *meta,
+    struct trackbuf *buf, unsigned nbufs, struct sysexlist *sxlist)
+{
+	unsigned hdr[2], c;
+
+	if (!smf_getraw_par(o, hdr, sizeof(hdr)))
+		return 0;
+	if (hdr[0] != idx) {
+		cons_err("corrupted output of track parser");
+		return 0;
+	}
+	if (!hdr[1] || !smf_getbuf_par(o, meta))
+		return 0;
+	for (c = 0; c < nbufs; c++) {
+		if (!smf_getbuf_par(o, &buf[c]))
+			return 0;
+	}
+	return smf_getsx_par(o, sxlist);
+}
+
+/*
+ * fix song imported from format 0 SMFs with more than one track:
+ * split the first track creating one track per channel. SMFs with a
+ * single track are split while they are parsed
  */
 void
 song_fix0(struct song *o)
@@ -853,7 +1078,6 @@ song_fix0(struct song *o)
 	unsigned delta;
 	unsigned i;
 
-	song_fix1(o);
 	smf = (struct songtrk *)o->trklist;
 	if (smf == NULL) {
 		return;
@@ -903,7 +1127,16 @@ song_importsmf(char *filename)
 	struct songtrk *t;
 	unsigned format, ntrks, timecode, i;
 	char trackname[MAXTRACKNAME];
-	struct smf f;
+	struct smf f, trk[SMF_MAXTRKS];
+	struct songsx *songsx;
+	struct sysexlist sxlist;
+	struct trackbuf meta, buf[EV_MAXCH + 1], *chan[EV_MAXCH + 1];
+	struct track copy, chtrk[EV_MAXCH + 1];
+	struct smf_par par;
+	struct smf out[SMF_MAXJOBS];
+	unsigned char *data[SMF_MAXJOBS];
+	unsigned len[SMF_MAXJOBS];
+	unsigned split, nbufs, empty, c, ok;
 
 	if (!smf_open(&f, filename, "r")) {
 		goto bad1;
@@ -921,7 +1154,7 @@ song_importsmf(char *filename)
 	if (!smf_get16(&f, &ntrks)) {
 		goto bad2;
 	}
-	if (ntrks >= 256) {
+	if (ntrks >= SMF_MAXTRKS) {
 		cons_err("too many tracks in midi file");
 		goto bad2;
 	}
@@ -933,32 +1166,119 @@ song_importsmf(char *filename)
 		goto bad2;
 	}
 
+	if (!smf_index(&f, trk, ntrks)) {
+		goto bad2;
+	}
+
 	o = song_new();
 	o->tics_per_unit = timecode * 4;   /* timecode = tics per quarter */
+	songsx = NULL;
+	if (ntrks > 0) {
+		songsx = (struct songsx *)o->sxlist;
+		if (songsx == NULL)
+			songsx = song_sxnew(o, "smf");
+	}
+
+	/*
+	 * parse each track in its own buffers and sysex list, then
+	 * append them to the song in the file order. Meta events are
+	 * moved to the meta-track and, if the file has a single
+	 * format 0 track, voice events are dispatched to one track per
+	 * channel. Tracks without voice events are removed
+	 */
+	split = (format == 0 && ntrks == 1);
+	nbufs = split ? EV_MAXCH + 1 : 1;
+	for (c = 0; c <= EV_MAXCH; c++)
+		chan[c] = &buf[split ? c : 0];
+
+	/*
+	 * tracks of large files are parsed with one process per
+	 * processor. If processes can't be started, tracks are parsed
+	 * here, as for small files
+	 */
+	par.trk = trk;
+	par.song = o;
+	par.ntrks = ntrks;
+	par.split = split;
+	par.njobs = batch_mdep_ncpu();
+	if (par.njobs > SMF_MAXJOBS)
+		par.njobs = SMF_MAXJOBS;
+	if (par.njobs > ntrks)
+		par.njobs = ntrks;
+	if (par.njobs <= 1 || f.end - f.data < SMF_MINPAR ||
+	    !batch_mdep_run(par.njobs, smf_parwork, &par, data, len))
+		par.njobs = 0;
+	for (c = 0; c < par.njobs; c++) {
+		out[c].file = NULL;
+		out[c].path = filename;
+		out[c].data = out[c].p = out[c].cend = data[c];
+		out[c].end = data[c] + len[c];
+	}
 
 	for (i = 0; i < ntrks; i++) {
 		snprintf(trackname, MAXTRACKNAME, "trk%02u", i);
 		t = song_trknew(o, trackname);
-		if (!smf_gettrack(&f, o, t)) {
+		trackbuf_init(&meta);
+		for (c = 0; c < nbufs; c++)
+			trackbuf_init(&buf[c]);
+		sysexlist_init(&sxlist);
+		if (par.njobs > 0) {
+			ok = smf_gettrack_par(&out[i % par.njobs], i,
+			    &meta, buf, nbufs, &sxlist);
+		} else
+			ok = smf_gettrack(&trk[i], o, chan, &meta, &sxlist);
+		if (!ok) {
+			sysexlist_done(&sxlist);
+			for (c = 0; c < nbufs; c++)
+				trackbuf_done(&buf[c]);
+			trackbuf_done(&meta);
 			goto bad3;
 		}
-		track_check(&t->track);
+		sysexlist_splice(&songsx->sx, &sxlist);
+
+		track_init(&copy);
+		track_build(&copy, &meta);
+		trackbuf_done(&meta);
+		track_check(&copy);
+		track_merge(&o->meta, &copy);
+		track_done(&copy);
+
+		empty = 1;
+		for (c = 0; c < nbufs; c++) {
+			track_init(&chtrk[c]);
+			track_build(&chtrk[c], &buf[c]);
+			trackbuf_done(&buf[c]);
+			track_check(&chtrk[c]);
+			if (chtrk[c].first->ev.cmd != EV_NULL)
+				empty = 0;
+		}
+		if (!empty) {
+			track_swap(&t->track, &chtrk[0]);
+			for (c = 1; c < nbufs; c++) {
+				snprintf(trackname, MAXTRACKNAME, "trk%02u", c);
+				t = song_trknew(o, trackname);
+				track_swap(&t->track, &chtrk[c]);
+			}
+		} else
+			song_trkdel(o, t);
+		for (c = 0; c < nbufs; c++)
+			track_done(&chtrk[c]);
 	}
+	for (c = 0; c < par.njobs; c++)
+		smf_close(&out[c]);
 	smf_close(&f);
 
-	if (format == 0) {
+	if (format == 0 && !split)
 		song_fix0(o);
-	} else if (format == 1) {
-		song_fix1(o);
-	}
-
 
 	/*
 	 * TODO: move sysex messages into separate songsx
 	 */
 	return o;
 
-bad3:	song_delete(o);
+bad3:	for (c = 0; c < par.njobs; c++)
+		smf_close(&out[c]);
+	song_delete(o);
 bad2:	smf_close(&f);
 bad1:	return 0;
 }
@@ -17,7 +17,40 @@
 #ifndef MIDISH_SMF_H
 #define MIDISH_SMF_H
 
+#include <stdio.h>
+
+#define SMF_MAXTRKS	256		/* max tracks in a file */
+#define SMF_EVLEN(status) (smf_evlen[((status) >> 4) & 7])
+
 struct song;
+struct sysexlist;
+
+/*
+ * the whole file is kept in memory. When reading, it's loaded at once
+ * and parsed by pointer, chunk boundaries are checked against the
+ * ``cend'' pointer only, once chunk headers are checked against the
+ * file size. When writing, chunks are encoded in a growable buffer in
+ * a single pass, their length is patched once they are complete, and
+ * the buffer is written at once when the file is closed.
+ */
+struct smf
+{
+	FILE *file;			/* file, if writing */
+	char *path;			/* file name, for errors */
+	unsigned char *data;		/* file contents */
+	unsigned char *p;		/* current position */
+	unsigned char *cend;		/* end of current chunk */
+	unsigned char *end;		/* end of file or buffer */
+};
+
+unsigned smf_get32(struct smf *, unsigned *);
+unsigned smf_get24(struct smf *, unsigned *);
+unsigned smf_get16(struct smf *, unsigned *);
+unsigned smf_getc(struct smf *, unsigned *);
+unsigned smf_getvar(struct smf *, unsigned *);
+unsigned smf_getheader(struct smf *, char *);
+unsigned smf_skip(struct smf *, unsigned);
+unsigned smf_index(struct smf *, struct smf *, unsigned);
 
 unsigned song_exportsmf(struct song *, char *);
 struct song *song_importsmf(char *);
@@ -25,4 +58,7 @@ struct song *song_importsmf(char *);
 int syx_import(char *, struct sysexlist *, int);
 int syx_export(char *, struct sysexlist *);
 
+extern char smftype_header[4], smftype_track[4];
+extern unsigned smf_evlen[];
+
 #endif /* MIDISH_SMF_H */
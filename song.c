@@ -26,7 +26,10 @@
 #include "defs.h"
 #include "mixout.h"
 #include "norm.h"
+#include "thru.h"
+#include "trace.h"
 #include "undo.h"
+#include "journal.h"
 
 #define TAG_OFF		0
 #define TAG_PLAY	1
@@ -429,6 +432,8 @@ song_setcurfilt(struct song *o, struct songfilt *f)
 	o->curfilt = f;
 	if (o->curout && o->curout->filt != f)
 		o->curout = NULL;
+	if (o->mode == SONG_IDLE)
+		thru_setfilt(f ? &f->filt : NULL);
 	if (mux_isopen)
 		mux_flush();
 }
@@ -975,6 +980,7 @@ song_trkmute(struct song *s, struct songtrk *t)
 	if (s->mode >= SONG_PLAY)
 		song_confcancel(&t->trackptr->statelist, PRIO_TRACK);
 	t->mute = 1;
+	journal_mute(s, t);
 }
 
 /*
@@ -986,6 +992,7 @@ song_trkunmute(struct song *s, struct songtrk *t)
 	if (s->mode >= SONG_PLAY)
 		song_confrestore(&t->trackptr->statelist, 1, PRIO_TRACK);
 	t->mute = 0;
+	journal_mute(s, t);
 }
 
 /*
@@ -1160,6 +1167,7 @@ song_evcb(struct song *o, struct ev *ev)
 	unsigned i, nev;
 	unsigned usec24;
 
+	TRACE_EV(TRACE_SONG, ev);
 	if (o->tap_mode != SONG_TAP_OFF &&
 	    evspec_matchev(&o->tap_evspec, ev)) {
 		if (!(ev_phase(ev) & EV_PHASE_FIRST))
@@ -1209,6 +1217,7 @@ song_evcb(struct song *o, struct ev *ev)
 	 */
 	ev = filtout;
 	for (i = 0; i < nev; i++) {
+		TRACE_EV(TRACE_FILT, ev);
 		if (o->mode >= SONG_REC) {
 			s = statelist_update(&o->rec_input, ev);
 			if (s->phase & EV_PHASE_FIRST) {
@@ -1584,6 +1593,15 @@ song_setmode(struct song *o, unsigned newmode)
 	}
 	if (newmode > oldmode)
 		metro_setmode(&o->metro, newmode);
+
+	/*
+	 * use the fast MIDI-thru path only if nothing else is
+	 * sent to the output
+	 */
+	if (newmode == SONG_IDLE)
+		thru_setfilt(o->curfilt ? &o->curfilt->filt : NULL);
+	else
+		thru_disable();
 }
 
 /*
@@ -0,0 +1,1066 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * binary song files. A file is a header followed by a list of
+ * sections:
+ *
+ *	magic		8 bytes, SONGBIN_MAGIC
+ *	version		u32, SONGBIN_VERSION
+ *	sections	tag (4 bytes), size (u32), payload
+ *
+ * integers are little endian, strings are a u32 length followed by
+ * the characters. Tracks are a u32 event count followed by an array
+ * of events of SONGBIN_EVSIZE bytes each:
+ *
+ *	bytes 0-3	delta, u32
+ *	byte 4		cmd
+ *	byte 5		dev, 0 if the event has no device
+ *	byte 6		ch, 0 if the event has no channel
+ *	byte 7		0, unused
+ *	bytes 8-11	v0, u32, 0 if unused
+ *	bytes 12-15	v1, u32, 0 if unused
+ *
+ * the last event is always the end-of-track marker, which carries the
+ * blank space at the end of the track. Each field is packed and
+ * unpacked byte by byte, so files don't depend on the host byte order
+ * or struct layout, and events are checked as they are loaded.
+ *
+ * sections are written in the order of the text format, and loading
+ * creates objects with the same routines as load_song(), so converting
+ * a song from one format to the other doesn't change it. Unknown
+ * sections are skipped.
+ *
+ * files are mapped in memory and events are copied in bulk into
+ * tracks with track_build(), instead of being parsed one character at
+ * a time.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "utils.h"
+#include "defs.h"
+#include "ev.h"
+#include "cons.h"
+#include "str.h"
+#include "song.h"
+#include "filt.h"
+#include "sysex.h"
+#include "metro.h"
+#include "stream.h"
+#include "songbin.h"
+
+#define SONGBIN_MAGIC	"MIDISHB\n"
+#define SONGBIN_VERSION	1
+#define SONGBIN_HDRSIZE	12
+#define SONGBIN_BUFSZ	0x1000		/* initial size of output buffer */
+
+/*
+ * filter rule types
+ */
+#define SONGBIN_MAP	0
+#define SONGBIN_TRANSP	1
+#define SONGBIN_VCURVE	2
+
+void songbin_putevspec(struct songbin_out *, struct evspec *);
+void songbin_puttrack(struct songbin_out *, struct track *);
+
+unsigned songbin_getevspec(struct songbin_in *, struct evspec *);
+unsigned songbin_gettrack(struct songbin_in *, struct track *);
+unsigned songbin_getevpat(struct songbin_in *);
+unsigned songbin_getsong(struct songbin_in *, struct song *);
+unsigned songbin_getchan(struct songbin_in *, struct song *);
+unsigned songbin_getsongfilt(struct songbin_in *, struct song *);
+unsigned songbin_getsongtrk(struct songbin_in *, struct song *);
+unsigned songbin_getsongsx(struct songbin_in *, struct song *);
+unsigned songbin_getmetro(struct songbin_in *, struct song *);
+
+void
+songbin_outinit(struct songbin_out *o)
+{
+	o->size = SONGBIN_BUFSZ;
+	o->buf = xmalloc(o->size, "songbin");
+	o->used = 0;
+}
+
+void
+songbin_outdone(struct songbin_out *o)
+{
+	xfree(o->buf);
+}
+
+/*
+ * make room for the given number of bytes
+ */
+void
+songbin_grow(struct songbin_out *o, unsigned n)
+{
+	unsigned char *buf;
+	unsigned size;
+
+	if (o->used + n <= o->size)
+		return;
+	size = o->size;
+	while (o->used + n > size)
+		size *= 2;
+	buf = xmalloc(size, "songbin");
+	memcpy(buf, o->buf, o->used);
+	xfree(o->buf);
+	o->buf = buf;
+	o->size = size;
+}
+
+void
+songbin_putu8(struct songbin_out *o, unsigned val)
+{
+	songbin_grow(o, 1);
+	o->buf[o->used++] = val;
+}
+
+void
+songbin_putu32(struct songbin_out *o, unsigned val)
+{
+	unsigned char *p;
+
+	songbin_grow(o, 4);
+	p = o->buf + o->used;
+	p[0] = val & 0xff;
+	p[1] = (val >> 8) & 0xff;
+	p[2] = (val >> 16) & 0xff;
+	p[3] = (val >> 24) & 0xff;
+	o->used += 4;
+}
+
+void
+songbin_putstr(struct songbin_out *o, char *str)
+{
+	unsigned len;
+
+	len = strlen(str);
+	songbin_putu32(o, len);
+	songbin_grow(o, len);
+	memcpy(o->buf + o->used, str, len);
+	o->used += len;
+}
+
+/*
+ * store the name of an object, or an empty string if there's none
+ */
+void
+songbin_putname(struct songbin_out *o, struct name *name)
+{
+	songbin_putstr(o, name ? name->str : "");
+}
+
+/*
+ * store an event, fields not used by the event type may be left
+ * uninitialized in memory, so they are stored as zero
+ */
+void
+songbin_putev(struct songbin_out *o, unsigned delta, struct ev *ev)
+{
+	struct evinfo *ei = &evinfo[ev->cmd];
+	unsigned char *p;
+	unsigned dev, ch, v0, v1;
+
+	dev = (ei->flags & EV_HAS_DEV) ? ev->dev : 0;
+	ch = (ei->flags & EV_HAS_CH) ? ev->ch : 0;
+	v0 = (ei->nparams >= 1) ? ev->v0 : 0;
+	v1 = (ei->nparams >= 2) ? ev->v1 : 0;
+	songbin_grow(o, SONGBIN_EVSIZE);
+	p = o->buf + o->used;
+	p[0] = delta & 0xff;
+	p[1] = (delta >> 8) & 0xff;
+	p[2] = (delta >> 16) & 0xff;
+	p[3] = (delta >> 24) & 0xff;
+	p[4] = ev->cmd;
+	p[5] = dev;
+	p[6] = ch;
+	p[7] = 0;
+	p[8] = v0 & 0xff;
+	p[9] = (v0 >> 8) & 0xff;
+	p[10] = (v0 >> 16) & 0xff;
+	p[11] = (v0 >> 24) & 0xff;
+	p[12] = v1 & 0xff;
+	p[13] = (v1 >> 8) & 0xff;
+	p[14] = (v1 >> 16) & 0xff;
+	p[15] = (v1 >> 24) & 0xff;
+	o->used += SONGBIN_EVSIZE;
+}
+
+void
+songbin_putevspec(struct songbin_out *o, struct evspec *es)
+{
+	songbin_putu32(o, es->cmd);
+	songbin_putu32(o, es->dev_min);
+	songbin_putu32(o, es->dev_max);
+	songbin_putu32(o, es->ch_min);
+	songbin_putu32(o, es->ch_max);
+	songbin_putu32(o, es->v0_min);
+	songbin_putu32(o, es->v0_max);
+	songbin_putu32(o, es->v1_min);
+	songbin_putu32(o, es->v1_max);
+}
+
+/*
+ * store the events of a track, the copy made by the previous save is
+ * reused if the track wasn't modified since
+ */
+void
+songbin_puttrack(struct songbin_out *o, struct track *t)
+{
+	struct seqev *i;
+	unsigned start;
+
+	if (t->bin.data != NULL) {
+		songbin_grow(o, t->bin.len);
+		memcpy(o->buf + o->used, t->bin.data, t->bin.len);
+		o->used += t->bin.len;
+		return;
+	}
+	start = o->used;
+	songbin_putu32(o, track_numev(t));
+	for (i = t->first; i != NULL; i = i->next)
+		songbin_putev(o, i->delta, &i->ev);
+	track_blkset(&t->bin, o->buf + start, o->used - start, 0);
+}
+
+/*
+ * store filter rules in the order they are written in text files
+ */
+void
+songbin_putfilt(struct songbin_out *o, struct filt *f)
+{
+	struct filtnode *s, *snext, *d;
+	unsigned pos, n;
+
+	pos = o->used;
+	songbin_putu32(o, 0);
+	n = 0;
+	snext = NULL;
+	while (snext != f->map) {
+		for (s = f->map; s->next != snext; s = s->next)
+			; /* nothing */
+		for (d = s->dstlist; d != NULL; d = d->next) {
+			songbin_putu32(o, SONGBIN_MAP);
+			songbin_putevspec(o, &s->es);
+			songbin_putevspec(o, &d->es);
+			n++;
+		}
+		snext = s;
+	}
+	for (d = f->transp; d != NULL; d = d->next) {
+		songbin_putu32(o, SONGBIN_TRANSP);
+		songbin_putevspec(o, &d->es);
+		songbin_putu32(o, d->u.transp.plus & 0x7f);
+		n++;
+	}
+	for (d = f->vcurve; d != NULL; d = d->next) {
+		songbin_putu32(o, SONGBIN_VCURVE);
+		songbin_putevspec(o, &d->es);
+		songbin_putu32(o, (64 - d->u.vel.nweight) & 0x7f);
+		n++;
+	}
+	o->buf[pos] = n & 0xff;
+	o->buf[pos + 1] = (n >> 8) & 0xff;
+	o->buf[pos + 2] = (n >> 16) & 0xff;
+	o->buf[pos + 3] = (n >> 24) & 0xff;
+}
+
+void
+songbin_putsysex(struct songbin_out *o, struct sysex *sx)
+{
+	struct chunk *c;
+	unsigned len;
+
+	len = 0;
+	for (c = sx->first; c != NULL; c = c->next)
+		len += c->used;
+	songbin_putu32(o, sx->unit);
+	songbin_putu32(o, len);
+	songbin_grow(o, len);
+	for (c = sx->first; c != NULL; c = c->next) {
+		memcpy(o->buf + o->used, c->data, c->used);
+		o->used += c->used;
+	}
+}
+
+/*
+ * store the messages of a sysex bank
+ */
+void
+songbin_putsxlist(struct songbin_out *o, struct sysexlist *l)
+{
+	struct sysex *sx;
+	unsigned n;
+
+	n = 0;
+	for (sx = l->first; sx != NULL; sx = sx->next)
+		n++;
+	songbin_putu32(o, n);
+	for (sx = l->first; sx != NULL; sx = sx->next)
+		songbin_putsysex(o, sx);
+}
+
+/*
+ * start a section with the given tag, return the position of its
+ * size, to be set by songbin_end()
+ */
+unsigned
+songbin_begin(struct songbin_out *o, char *tag)
+{
+	songbin_grow(o, 4);
+	memcpy(o->buf + o->used, tag, 4);
+	o->used += 4;
+	songbin_putu32(o, 0);
+	return o->used;
+}
+
+void
+songbin_end(struct songbin_out *o, unsigned start)
+{
+	unsigned size = o->used - start;
+	unsigned char *p = o->buf + start - 4;
+
+	p[0] = size & 0xff;
+	p[1] = (size >> 8) & 0xff;
+	p[2] = (size >> 16) & 0xff;
+	p[3] = (size >> 24) & 0xff;
+}
+
+/*
+ * store current objects and settings
+ */
+void
+songbin_putcur(struct songbin_out *o, struct song *s)
+{
+	songbin_putname(o, (struct name *)s->curtrk);
+	songbin_putname(o, (struct name *)s->curfilt);
+	songbin_putname(o, (struct name *)s->cursx);
+	songbin_putname(o, (struct name *)s->curin);
+	songbin_putname(o, (struct name *)s->curout);
+	songbin_putu32(o, s->curpos);
+	songbin_putu32(o, s->curlen);
+	songbin_putu32(o, s->curquant);
+	songbin_putevspec(o, &s->curev);
+	songbin_putu32(o, s->tap_mode);
+	songbin_putevspec(o, &s->tap_evspec);
+}
+
+/*
+ * save the song in binary format in the given file
+ */
+unsigned
+songbin_save(struct song *s, char *path)
+{
+	struct songbin_out out, *o = &out;
+	struct songtrk *t;
+	struct songchan *i;
+	struct songfilt *g;
+	struct songsx *l;
+	unsigned char *p;
+	unsigned cmd, pos, n;
+	FILE *f;
+
+	songbin_outinit(o);
+	songbin_grow(o, 8);
+	memcpy(o->buf, SONGBIN_MAGIC, 8);
+	o->used = 8;
+	songbin_putu32(o, SONGBIN_VERSION);
+
+	pos = songbin_begin(o, "SONG");
+	songbin_putu32(o, s->tics_per_unit);
+	songbin_putu32(o, s->tempo_factor);
+	songbin_end(o, pos);
+
+	pos = songbin_begin(o, "META");
+	songbin_puttrack(o, &s->meta);
+	songbin_end(o, pos);
+
+	for (cmd = EV_PAT0; cmd < EV_PAT0 + EV_NPAT; cmd++) {
+		if (evinfo[cmd].ev == NULL)
+			continue;
+		p = evinfo[cmd].pattern;
+		for (n = 0; p[n] != 0xf7; n++)
+			; /* nothing */
+		n++;
+		pos = songbin_begin(o, "EPAT");
+		songbin_putstr(o, evinfo[cmd].ev);
+		songbin_putu32(o, n);
+		songbin_grow(o, n);
+		memcpy(o->buf + o->used, p, n);
+		o->used += n;
+		songbin_end(o, pos);
+	}
+	SONG_FOREACH_CHAN(s, i) {
+		pos = songbin_begin(o, "CHAN");
+		songbin_putstr(o, i->name.str);
+		songbin_putu32(o, i->isinput);
+		songbin_putu32(o, i->dev);
+		songbin_putu32(o, i->ch);
+		songbin_puttrack(o, &i->conf);
+		songbin_end(o, pos);
+	}
+	SONG_FOREACH_FILT(s, g) {
+		pos = songbin_begin(o, "FILT");
+		songbin_putstr(o, g->name.str);
+		songbin_putfilt(o, &g->filt);
+		songbin_end(o, pos);
+	}
+	SONG_FOREACH_TRK(s, t) {
+		pos = songbin_begin(o, "TRAK");
+		songbin_putstr(o, t->name.str);
+		songbin_putname(o, (struct name *)t->curfilt);
+		songbin_putu32(o, t->mute);
+		songbin_puttrack(o, &t->track);
+		songbin_end(o, pos);
+	}
+	SONG_FOREACH_SX(s, l) {
+		pos = songbin_begin(o, "SYSX");
+		songbin_putstr(o, l->name.str);
+		songbin_putsxlist(o, &l->sx);
+		songbin_end(o, pos);
+	}
+
+	pos = songbin_begin(o, "CURS");
+	songbin_putcur(o, s);
+	songbin_end(o, pos);
+
+	pos = songbin_begin(o, "METR");
+	songbin_putu32(o, s->metro.mask);
+	songbin_putev(o, 0, &s->metro.lo);
+	songbin_putev(o, 0, &s->metro.hi);
+	songbin_end(o, pos);
+
+	f = fopen(path, "w");
+	if (f == NULL) {
+		cons_errs(path, "failed to open output file");
+		songbin_outdone(o);
+		return 0;
+	}
+	if (fwrite(o->buf, 1, o->used, f) != o->used || fclose(f) != 0) {
+		cons_errs(path, "failed to write output file");
+		songbin_outdone(o);
+		return 0;
+	}
+	songbin_outdone(o);
+	return 1;
+}
+
+/*
+ * report an error, only the first one is reported
+ */
+void
+songbin_err(struct songbin_in *o, char *msg)
+{
+	if (!o->err)
+		cons_errs(o->path, msg);
+	o->err = 1;
+}
+
+unsigned
+songbin_getu8(struct songbin_in *o)
+{
+	if (o->end - o->p < 1) {
+		songbin_err(o, "truncated file");
+		return 0;
+	}
+	return *o->p++;
+}
+
+unsigned
+songbin_getu32(struct songbin_in *o)
+{
+	unsigned char *p = o->p;
+
+	if (o->end - p < 4) {
+		songbin_err(o, "truncated file");
+		return 0;
+	}
+	o->p += 4;
+	return p[0] | p[1] << 8 | p[2] << 16 | (unsigned)p[3] << 24;
+}
+
+/*
+ * read a string in the given buffer of the given size, including
+ * the terminating zero
+ */
+unsigned
+songbin_getstr(struct songbin_in *o, char *buf, unsigned size)
+{
+	unsigned len;
+
+	len = songbin_getu32(o);
+	if (o->err)
+		return 0;
+	if (len >= size) {
+		songbin_err(o, "string too long");
+		return 0;
+	}
+	if (o->end - o->p < len) {
+		songbin_err(o, "truncated file");
+		return 0;
+	}
+	memcpy(buf, o->p, len);
+	buf[len] = '\0';
+	o->p += len;
+	if (strlen(buf) != len) {
+		songbin_err(o, "corrupted string");
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * read a name in a SONGBIN_MAXSTR bytes buffer, an empty name
+ * means no object
+ */
+unsigned
+songbin_getname(struct songbin_in *o, char *buf)
+{
+	return songbin_getstr(o, buf, SONGBIN_MAXSTR);
+}
+
+/*
+ * read a packed event and check it could have been loaded from a
+ * text file
+ */
+unsigned
+songbin_getev(struct songbin_in *o, unsigned *delta, struct ev *ev)
+{
+	unsigned char *p = o->p;
+	struct evinfo *ei;
+
+	if (o->end - p < SONGBIN_EVSIZE) {
+		songbin_err(o, "truncated file");
+		return 0;
+	}
+	o->p += SONGBIN_EVSIZE;
+	*delta = p[0] | p[1] << 8 | p[2] << 16 | (unsigned)p[3] << 24;
+	ev->cmd = p[4];
+	ev->dev = p[5];
+	ev->ch = p[6];
+	ev->v0 = p[8] | p[9] << 8 | p[10] << 16 | (unsigned)p[11] << 24;
+	ev->v1 = p[12] | p[13] << 8 | p[14] << 16 | (unsigned)p[15] << 24;
+	if (ev->cmd >= EV_NUMCMD || evinfo[ev->cmd].ev == NULL)
+		goto bad;
+	ei = &evinfo[ev->cmd];
+	if (((ei->flags & EV_HAS_DEV) && ev->dev > EV_MAXDEV) ||
+	    ((ei->flags & EV_HAS_CH) && ev->ch > EV_MAXCH))
+		goto bad;
+	if (ev->cmd == EV_TEMPO) {
+		if (ev->v0 < TEMPO_MIN || ev->v0 > TEMPO_MAX)
+			goto bad;
+		return 1;
+	}
+	if (ev->cmd == EV_TIMESIG) {
+		if (ev->v0 < 1 || ev->v0 > TIMESIG_BEATS_MAX ||
+		    ev->v1 < 1 || ev->v1 > TIMESIG_TICS_MAX)
+			goto bad;
+		return 1;
+	}
+	if (ei->nparams >= 1 && ev->v0 != EV_UNDEF &&
+	    (ev->v0 < ei->v0_min || ev->v0 > ei->v0_max))
+		goto bad;
+	if (ei->nparams >= 2 && ev->v1 != EV_UNDEF &&
+	    (ev->v1 < ei->v1_min || ev->v1 > ei->v1_max))
+		goto bad;
+	return 1;
+bad:
+	songbin_err(o, "corrupted event");
+	return 0;
+}
+
+unsigned
+songbin_getevspec(struct songbin_in *o, struct evspec *es)
+{
+	es->cmd = songbin_getu32(o);
+	es->dev_min = songbin_getu32(o);
+	es->dev_max = songbin_getu32(o);
+	es->ch_min = songbin_getu32(o);
+	es->ch_max = songbin_getu32(o);
+	es->v0_min = songbin_getu32(o);
+	es->v0_max = songbin_getu32(o);
+	es->v1_min = songbin_getu32(o);
+	es->v1_max = songbin_getu32(o);
+	if (o->err)
+		return 0;
+	if (es->cmd >= EV_NUMCMD || (es->cmd != EVSPEC_EMPTY &&
+	    (es->dev_min > es->dev_max || es->dev_max > EV_MAXDEV ||
+	    es->ch_min > es->ch_max || es->ch_max > EV_MAXCH))) {
+		songbin_err(o, "corrupted event range");
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * read a track, events are built into the track by blocks of
+ * TRACKBUF_LEN events
+ */
+unsigned
+songbin_gettrack(struct songbin_in *o, struct track *t)
+{
+	struct trackbuf tb;
+	struct ev ev;
+	unsigned n, delta;
+
+	n = songbin_getu32(o);
+	if (o->err)
+		return 0;
+	if (n == 0 || (o->end - o->p) / SONGBIN_EVSIZE < n) {
+		songbin_err(o, "corrupted track");
+		return 0;
+	}
+	track_clear(t);
+	trackbuf_init(&tb);
+	while (n-- > 0) {
+		if (!songbin_getev(o, &delta, &ev))
+			break;
+		trackbuf_wait(&tb, delta);
+		if (ev.cmd == EV_NULL) {
+			if (n > 0)
+				songbin_err(o, "corrupted track");
+			break;
+		}
+		if (n == 0) {
+			songbin_err(o, "corrupted track");
+			break;
+		}
+		trackbuf_put(&tb, &ev);
+		if (tb.nevs == tb.maxevs)
+			track_build(t, &tb);
+	}
+	track_build(t, &tb);
+	trackbuf_done(&tb);
+	return !o->err;
+}
+
+/*
+ * read filter rules and add them with the same routines as
+ * load_rule()
+ */
+unsigned
+songbin_getfilt(struct songbin_in *o, struct filt *f)
+{
+	struct evspec from, to;
+	unsigned n, type, val;
+
+	n = songbin_getu32(o);
+	while (!o->err && n-- > 0) {
+		type = songbin_getu32(o);
+		if (!songbin_getevspec(o, &from))
+			return 0;
+		switch (type) {
+		case SONGBIN_MAP:
+			if (!songbin_getevspec(o, &to))
+				return 0;
+			if (!filt_mapload(f, &from, &to)) {
+				songbin_err(o, "corrupted map rule");
+				return 0;
+			}
+			break;
+		case SONGBIN_TRANSP:
+			val = songbin_getu32(o);
+			if (val > EV_MAXCOARSE) {
+				songbin_err(o, "corrupted transp rule");
+				return 0;
+			}
+			if (!filt_transpload(f, &from, val)) {
+				songbin_err(o, "corrupted transp rule");
+				return 0;
+			}
+			break;
+		case SONGBIN_VCURVE:
+			val = songbin_getu32(o);
+			if (val < 1 || val > EV_MAXCOARSE) {
+				songbin_err(o, "corrupted vcurve rule");
+				return 0;
+			}
+			if (!filt_vcurveload(f, &from, val)) {
+				songbin_err(o, "corrupted vcurve rule");
+				return 0;
+			}
+			break;
+		default:
+			songbin_err(o, "unknown filter rule");
+			return 0;
+		}
+	}
+	return !o->err;
+}
+
+/*
+ * define a sysex pattern, as load_evpat() does
+ */
+unsigned
+songbin_getevpat(struct songbin_in *o)
+{
+	char ref[SONGBIN_MAXSTR];
+	unsigned char *pattern;
+	unsigned cmd, size;
+	char *name;
+
+	if (!songbin_getname(o, ref))
+		return 0;
+	size = songbin_getu32(o);
+	if (o->err)
+		return 0;
+	if (size == 0 || size > EV_PATSIZE || o->end - o->p < size ||
+	    o->p[size - 1] != 0xf7) {
+		songbin_err(o, "corrupted sysex pattern");
+		return 0;
+	}
+	if (evpat_lookup(ref, &cmd))
+		evpat_unconf(cmd);
+	for (cmd = EV_PAT0;; cmd++) {
+		if (cmd == EV_PAT0 + EV_NPAT) {
+			songbin_err(o, "too many sysex patterns");
+			return 0;
+		}
+		if (evinfo[cmd].ev == NULL)
+			break;
+	}
+	name = str_new(ref);
+	pattern = xmalloc(EV_PATSIZE, "evpat");
+	memcpy(pattern, o->p, size);
+	o->p += size;
+	if (!evpat_set(cmd, name, pattern, size)) {
+		str_delete(name);
+		xfree(pattern);
+		songbin_err(o, "bad sysex pattern");
+		return 0;
+	}
+	return 1;
+}
+
+unsigned
+songbin_getsong(struct songbin_in *o, struct song *s)
+{
+	unsigned tpu, factor;
+
+	tpu = songbin_getu32(o);
+	factor = songbin_getu32(o);
+	if (o->err)
+		return 0;
+	if (tpu < 96 || tpu % 96 != 0 || factor < 0x80 || factor > 0x200) {
+		songbin_err(o, "corrupted song parameters");
+		return 0;
+	}
+	s->tics_per_unit = tpu;
+	s->tempo_factor = factor;
+	return 1;
+}
+
+unsigned
+songbin_getchan(struct songbin_in *o, struct song *s)
+{
+	char name[SONGBIN_MAXSTR];
+	struct songchan *i;
+	unsigned input, dev, ch;
+
+	if (!songbin_getname(o, name))
+		return 0;
+	input = songbin_getu32(o);
+	dev = songbin_getu32(o);
+	ch = songbin_getu32(o);
+	if (o->err)
+		return 0;
+	if (name[0] == '\0' || input > 1 || dev > EV_MAXDEV || ch > EV_MAXCH) {
+		songbin_err(o, "corrupted channel");
+		return 0;
+	}
+	i = song_chanlookup(s, name, input);
+	if (i == NULL) {
+		i = song_channew(s, name, 0, 0, input);
+		song_setcurchan(s, NULL, input);
+		if (i->filt)
+			filt_reset(&i->filt->filt);
+	}
+	i->dev = dev;
+	i->ch = ch;
+	if (!songbin_gettrack(o, &i->conf))
+		return 0;
+	track_setchan(&i->conf, i->dev, i->ch);
+	return 1;
+}
+
+unsigned
+songbin_getsongfilt(struct songbin_in *o, struct song *s)
+{
+	char name[SONGBIN_MAXSTR];
+	struct songfilt *g;
+
+	if (!songbin_getname(o, name))
+		return 0;
+	if (name[0] == '\0') {
+		songbin_err(o, "corrupted filter");
+		return 0;
+	}
+	g = song_filtlookup(s, name);
+	if (g == NULL) {
+		g = song_filtnew(s, name);
+		song_setcurfilt(s, NULL);
+	}
+	return songbin_getfilt(o, &g->filt);
+}
+
+unsigned
+songbin_getsongtrk(struct songbin_in *o, struct song *s)
+{
+	char name[SONGBIN_MAXSTR], fname[SONGBIN_MAXSTR];
+	struct songtrk *t;
+	struct songfilt *f;
+	unsigned mute;
+
+	if (!songbin_getname(o, name) || !songbin_getname(o, fname))
+		return 0;
+	mute = songbin_getu32(o);
+	if (o->err)
+		return 0;
+	if (name[0] == '\0' || mute > 1) {
+		songbin_err(o, "corrupted track");
+		return 0;
+	}
+	t = song_trklookup(s, name);
+	if (t == NULL) {
+		t = song_trknew(s, name);
+		song_setcurtrk(s, NULL);
+	}
+	if (fname[0] != '\0') {
+		f = song_filtlookup(s, fname);
+		if (f == NULL) {
+			f = song_filtnew(s, fname);
+			song_setcurfilt(s, NULL);
+		}
+		t->curfilt = f;
+	}
+	t->mute = mute;
+	return songbin_gettrack(o, &t->track);
+}
+
+/*
+ * read the messages of a sysex bank and append them to the list
+ */
+unsigned
+songbin_getsxlist(struct songbin_in *o, struct sysexlist *l)
+{
+	struct sysex *sx;
+	unsigned n, unit, len;
+
+	n = songbin_getu32(o);
+	while (!o->err && n-- > 0) {
+		unit = songbin_getu32(o);
+		len = songbin_getu32(o);
+		if (o->err)
+			return 0;
+		if (unit > EV_MAXDEV || o->end - o->p < len) {
+			songbin_err(o, "corrupted sysex");
+			return 0;
+		}
+		sx = sysex_new(unit);
+		sysex_addbuf(sx, o->p, len);
+		sysexlist_put(l, sx);
+		o->p += len;
+	}
+	return !o->err;
+}
+
+unsigned
+songbin_getsongsx(struct songbin_in *o, struct song *s)
+{
+	char name[SONGBIN_MAXSTR];
+	struct songsx *l;
+
+	if (!songbin_getname(o, name))
+		return 0;
+	if (name[0] == '\0') {
+		songbin_err(o, "corrupted sysex bank");
+		return 0;
+	}
+	l = song_sxlookup(s, name);
+	if (l == NULL) {
+		l = song_sxnew(s, name);
+		song_setcursx(s, NULL);
+	}
+	return songbin_getsxlist(o, &l->sx);
+}
+
+/*
+ * restore current objects and settings; missing objects are
+ * ignored, as in load_song()
+ */
+unsigned
+songbin_getcur(struct songbin_in *o, struct song *s)
+{
+	char trk[SONGBIN_MAXSTR], filt[SONGBIN_MAXSTR], sx[SONGBIN_MAXSTR];
+	char in[SONGBIN_MAXSTR], out[SONGBIN_MAXSTR];
+	struct songtrk *t;
+	struct songfilt *g;
+	struct songsx *l;
+	struct songchan *i;
+	struct evspec curev, tapev;
+	unsigned curpos, curlen, curquant, tap;
+
+	if (!songbin_getname(o, trk) || !songbin_getname(o, filt) ||
+	    !songbin_getname(o, sx) || !songbin_getname(o, in) ||
+	    !songbin_getname(o, out))
+		return 0;
+	curpos = songbin_getu32(o);
+	curlen = songbin_getu32(o);
+	curquant = songbin_getu32(o);
+	if (!songbin_getevspec(o, &curev))
+		return 0;
+	tap = songbin_getu32(o);
+	if (!songbin_getevspec(o, &tapev))
+		return 0;
+	if (curquant > s->tics_per_unit || tap > SONG_TAP_TEMPO) {
+		songbin_err(o, "corrupted song parameters");
+		return 0;
+	}
+
+	/*
+	 * an empty name means no current object, as the song may have
+	 * one (journal replay), it must be unset
+	 */
+	t = (trk[0] != '\0') ? song_trklookup(s, trk) : NULL;
+	s->curtrk = t;
+	g = (filt[0] != '\0') ? song_filtlookup(s, filt) : NULL;
+	s->curfilt = g;
+	l = (sx[0] != '\0') ? song_sxlookup(s, sx) : NULL;
+	s->cursx = l;
+	i = (in[0] != '\0') ? song_chanlookup(s, in, 1) : NULL;
+	song_setcurchan(s, i, 1);
+	i = (out[0] != '\0') ? song_chanlookup(s, out, 0) : NULL;
+	song_setcurchan(s, i, 0);
+	s->curpos = curpos;
+	s->curlen = curlen;
+	s->curquant = curquant;
+	s->curev = curev;
+	s->tap_mode = tap;
+	s->tap_evspec = tapev;
+	return 1;
+}
+
+unsigned
+songbin_getmetro(struct songbin_in *o, struct song *s)
+{
+	struct ev lo, hi;
+	unsigned mask, delta;
+
+	mask = songbin_getu32(o);
+	if (!songbin_getev(o, &delta, &lo) || !songbin_getev(o, &delta, &hi))
+		return 0;
+	if (lo.cmd != EV_NON || hi.cmd != EV_NON ||
+	    (mask & ~((1 << SONG_PLAY) | (1 << SONG_REC)))) {
+		songbin_err(o, "corrupted metronome");
+		return 0;
+	}
+	metro_setmask(&s->metro, mask);
+	s->metro.lo = lo;
+	s->metro.hi = hi;
+	return 1;
+}
+
+/*
+ * return true if the given file is a binary song file
+ */
+unsigned
+songbin_probe(char *path)
+{
+	char magic[8];
+	FILE *f;
+	unsigned res;
+
+	f = fopen(path, "r");
+	if (f == NULL)
+		return 0;
+	res = fread(magic, 1, 8, f) == 8 && memcmp(magic, SONGBIN_MAGIC, 8) == 0;
+	fclose(f);
+	return res;
+}
+
+/*
+ * load a binary song file into the given (empty) song
+ */
+unsigned
+songbin_load(struct song *s, char *path)
+{
+	struct songbin_in in, *o = &in;
+	unsigned char *data, *tag, *end;
+	unsigned long mtime;
+	unsigned version, size;
+	size_t len;
+
+	data = stream_mdep_map(path, &len, &mtime);
+	if (data == NULL)
+		return 0;
+	o->path = path;
+	o->p = data;
+	o->end = data + len;
+	o->err = 0;
+	if (len < SONGBIN_HDRSIZE || memcmp(data, SONGBIN_MAGIC, 8) != 0) {
+		songbin_err(o, "not a binary song file");
+		goto done;
+	}
+	o->p += 8;
+	version = songbin_getu32(o);
+	if (version > SONGBIN_VERSION) {
+		songbin_err(o, "midish version too old to read this file");
+		goto done;
+	}
+	while (!o->err && o->p != o->end) {
+		if (o->end - o->p < 8) {
+			songbin_err(o, "truncated file");
+			break;
+		}
+		tag = o->p;
+		o->p += 4;
+		size = songbin_getu32(o);
+		if (o->end - o->p < size) {
+			songbin_err(o, "truncated file");
+			break;
+		}
+
+		/*
+		 * don't let a section read past its end
+		 */
+		end = o->p + size;
+		o->end = end;
+		if (memcmp(tag, "SONG", 4) == 0)
+			songbin_getsong(o, s);
+		else if (memcmp(tag, "META", 4) == 0)
+			songbin_gettrack(o, &s->meta);
+		else if (memcmp(tag, "EPAT", 4) == 0)
+			songbin_getevpat(o);
+		else if (memcmp(tag, "CHAN", 4) == 0)
+			songbin_getchan(o, s);
+		else if (memcmp(tag, "FILT", 4) == 0)
+			songbin_getsongfilt(o, s);
+		else if (memcmp(tag, "TRAK", 4) == 0)
+			songbin_getsongtrk(o, s);
+		else if (memcmp(tag, "SYSX", 4) == 0)
+			songbin_getsongsx(o, s);
+		else if (memcmp(tag, "CURS", 4) == 0)
+			songbin_getcur(o, s);
+		else if (memcmp(tag, "METR", 4) == 0)
+			songbin_getmetro(o, s);
+		o->p = end;
+		o->end = data + len;
+	}
+done:
+	stream_mdep_unmap(data, len);
+	return !o->err;
+}
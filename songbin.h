@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef MIDISH_SONGBIN_H
+#define MIDISH_SONGBIN_H
+
+#define SONGBIN_EVSIZE	16		/* size of a packed event */
+#define SONGBIN_MAXSTR	1024		/* max length of a name */
+
+struct song;
+struct name;
+struct ev;
+struct filt;
+struct sysex;
+struct sysexlist;
+
+/*
+ * file being written, kept in memory until it's complete
+ */
+struct songbin_out {
+	unsigned char *buf;
+	unsigned used, size;
+};
+
+/*
+ * file being read, err is set on the first error and subsequent
+ * reads return zero
+ */
+struct songbin_in {
+	char *path;
+	unsigned char *p, *end;
+	unsigned err;
+};
+
+void songbin_outinit(struct songbin_out *);
+void songbin_outdone(struct songbin_out *);
+void songbin_grow(struct songbin_out *, unsigned);
+void songbin_putu8(struct songbin_out *, unsigned);
+void songbin_putu32(struct songbin_out *, unsigned);
+void songbin_putstr(struct songbin_out *, char *);
+void songbin_putname(struct songbin_out *, struct name *);
+void songbin_putev(struct songbin_out *, unsigned, struct ev *);
+void songbin_putfilt(struct songbin_out *, struct filt *);
+void songbin_putsysex(struct songbin_out *, struct sysex *);
+void songbin_putsxlist(struct songbin_out *, struct sysexlist *);
+void songbin_putcur(struct songbin_out *, struct song *);
+unsigned songbin_begin(struct songbin_out *, char *);
+void songbin_end(struct songbin_out *, unsigned);
+
+void songbin_err(struct songbin_in *, char *);
+unsigned songbin_getu8(struct songbin_in *);
+unsigned songbin_getu32(struct songbin_in *);
+unsigned songbin_getstr(struct songbin_in *, char *, unsigned);
+unsigned songbin_getname(struct songbin_in *, char *);
+unsigned songbin_getev(struct songbin_in *, unsigned *, struct ev *);
+unsigned songbin_getfilt(struct songbin_in *, struct filt *);
+unsigned songbin_getsxlist(struct songbin_in *, struct sysexlist *);
+unsigned songbin_getcur(struct songbin_in *, struct song *);
+
+unsigned songbin_save(struct song *, char *);
+unsigned songbin_probe(char *);
+unsigned songbin_load(struct song *, char *);
+
+#endif /* MIDISH_SONGBIN_H */
@@ -0,0 +1,800 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * play a standard MIDI file without importing it into a song.
+ *
+ * the file is mapped in memory and track chunks are decoded lazily,
+ * one event at a time: a cursor is kept on each chunk and a binary
+ * heap of track numbers, ordered by the time of the next event of
+ * each track, merges them in time order. Events are sent to the
+ * output as they become due, so start-up time and memory usage don't
+ * depend on the file size.
+ *
+ * to start playback in the middle of the file, a sparse index is
+ * built while the file is traversed: every STREAM_IDXSTEP measures
+ * the track cursors are saved, along with the tempo, the time
+ * signature and the state of the controllers. Seeking restores the
+ * nearest preceding entry, then skips the remaining events, updating
+ * the controller state, which is sent before playback starts. The
+ * last file played and its index are kept, so playing the same file
+ * again doesn't need to traverse it from the beginning.
+ *
+ * the same decoder is used to compute summaries of files (event
+ * counts, duration, ...) in a single pass without building a song.
+ */
+#include <stddef.h>
+#include <string.h>
+#include "utils.h"
+#include "defs.h"
+#include "ev.h"
+#include "cons.h"
+#include "mux.h"
+#include "timo.h"
+#include "song.h"
+#include "str.h"
+#include "smf.h"
+#include "stream.h"
+
+#define STREAM_IDXSTEP	16		/* measures between index entries */
+#define STREAM_MAXWAIT	(24 * 100000)	/* max time between timeouts */
+#define STREAM_TEMPO	500000		/* default tempo, in usec */
+#define STREAM_UNSET	0xff		/* controller never set */
+
+/*
+ * position of a track cursor, as offsets in the file so index entries
+ * remain valid if the file is mapped at another address
+ */
+struct stream_mark {
+	unsigned off;			/* offset of the next event */
+	unsigned end;			/* offset of the end of the chunk */
+	unsigned status;		/* running status */
+	unsigned tic;			/* absolute time of the next event */
+	unsigned eot;			/* true if no more events */
+};
+
+/*
+ * state of the file at a given position, excluding track cursors
+ */
+struct stream_pos {
+	unsigned tic;			/* current time */
+	unsigned measure;		/* current measure */
+	unsigned mtic;			/* time the measure started */
+	unsigned mlen;			/* measure length in tics */
+	unsigned usec24;		/* tic length */
+	unsigned char ctl[16][128];	/* last controller values */
+	unsigned char prog[16];		/* last program changes */
+	unsigned bend[16];		/* last bend values */
+};
+
+/*
+ * sparse index entry
+ */
+struct stream_idx {
+	struct stream_pos pos;
+	struct stream_mark *trk;	/* cursor of each track */
+};
+
+struct stream_trk {
+	struct smf smf;			/* decoder position */
+	unsigned status;		/* running status */
+	unsigned tic;			/* absolute time of the next event */
+	unsigned eot;			/* true if no more events */
+};
+
+struct stream {
+	char *path;			/* file name */
+	unsigned char *data;		/* file contents */
+	size_t size;			/* file size */
+	unsigned long mtime;		/* modification time */
+	unsigned format;		/* file format, 0 or 1 */
+	unsigned ntrks;			/* number of track chunks */
+	unsigned tpq;			/* tics per quarter note */
+	struct stream_trk *trk;		/* track cursors */
+	unsigned *heap;			/* tracks, next event first */
+	unsigned nheap;			/* number of tracks in the heap */
+	struct stream_pos pos;		/* current state */
+	struct stream_idx *idx;		/* sparse index */
+	unsigned nidx, maxidx;		/* used and allocated entries */
+	struct timo timo;		/* next event timeout */
+	unsigned due;			/* abs. time of current position */
+	unsigned done;			/* true if end of file reached */
+	unsigned char notes[16][128];	/* number of notes on */
+	struct stream_stats *stats;	/* if scanning, the summary */
+};
+
+struct stream *stream_cache = NULL;
+
+void stream_del(struct stream *);
+void stream_mark(struct stream *, struct stream_mark *);
+void stream_restore(struct stream *, struct stream_idx *);
+void stream_idxadd(struct stream *);
+void stream_advance(struct stream *, unsigned);
+unsigned stream_event(struct stream *, unsigned, unsigned);
+void stream_next(struct stream *, unsigned);
+void stream_seek(struct stream *, unsigned);
+void stream_chase(struct stream *);
+void stream_notesoff(struct stream *);
+void stream_timocb(void *);
+
+/*
+ * return true if the next event of track 'i' is before the one of
+ * track 'j', tracks are ordered by number if events have the same
+ * time, so merging is deterministic
+ */
+#define STREAM_BEFORE(s, i, j) \
+	((s)->trk[i].tic < (s)->trk[j].tic || \
+	((s)->trk[i].tic == (s)->trk[j].tic && (i) < (j)))
+
+/*
+ * insert a track in the heap
+ */
+void
+stream_heapins(struct stream *s, unsigned t)
+{
+	unsigned i, p;
+
+	i = s->nheap++;
+	while (i > 0) {
+		p = (i - 1) / 2;
+		if (!STREAM_BEFORE(s, t, s->heap[p]))
+			break;
+		s->heap[i] = s->heap[p];
+		i = p;
+	}
+	s->heap[i] = t;
+}
+
+/*
+ * remove the first track from the heap and return it
+ */
+unsigned
+stream_heapdel(struct stream *s)
+{
+	unsigned i, c, t, first;
+
+	first = s->heap[0];
+	t = s->heap[--s->nheap];
+	i = 0;
+	for (;;) {
+		c = 2 * i + 1;
+		if (c >= s->nheap)
+			break;
+		if (c + 1 < s->nheap && STREAM_BEFORE(s, s->heap[c + 1], s->heap[c]))
+			c++;
+		if (!STREAM_BEFORE(s, s->heap[c], t))
+			break;
+		s->heap[i] = s->heap[c];
+		i = c;
+	}
+	s->heap[i] = t;
+	return first;
+}
+
+/*
+ * read the delta of the next event of the given track and update its
+ * time, mark the track as finished if it has no more events
+ */
+void
+stream_getdelta(struct stream *s, unsigned i)
+{
+	struct stream_trk *t = &s->trk[i];
+	unsigned delta;
+
+	if (t->smf.p == t->smf.cend) {
+		t->eot = 1;
+		return;
+	}
+	if (!smf_getvar(&t->smf, &delta)) {
+		cons_erru(i, "track corrupted, rest ignored");
+		t->eot = 1;
+		if (s->stats)
+			s->stats->nbad++;
+		return;
+	}
+	t->tic += delta;
+}
+
+/*
+ * map the given file, check its header, and create the index entry
+ * of the beginning of the file
+ */
+struct stream *
+stream_new(char *path)
+{
+	struct stream *s;
+	struct smf f, trk[SMF_MAXTRKS];
+	unsigned format, ntrks, timecode, i;
+	unsigned char *data;
+	unsigned long mtime;
+	size_t size;
+
+	data = stream_mdep_map(path, &size, &mtime);
+	if (data == NULL)
+		return NULL;
+	f.file = NULL;
+	f.path = path;
+	f.data = f.p = f.cend = data;
+	f.end = data + size;
+	if (!smf_getheader(&f, smftype_header) ||
+	    !smf_get16(&f, &format))
+		goto bad;
+	if (format != 1 && format != 0) {
+		cons_err("only smf format 0 or 1 can be played");
+		goto bad;
+	}
+	if (!smf_get16(&f, &ntrks))
+		goto bad;
+	if (ntrks >= SMF_MAXTRKS) {
+		cons_err("too many tracks in midi file");
+		goto bad;
+	}
+	if (!smf_get16(&f, &timecode))
+		goto bad;
+	if ((timecode & 0x8000) != 0) {
+		cons_err("SMPTE timecode is not supported");
+		goto bad;
+	}
+	if (timecode == 0) {
+		cons_err("bad tics per quarter");
+		goto bad;
+	}
+	if (!smf_index(&f, trk, ntrks))
+		goto bad;
+
+	s = xmalloc(sizeof(struct stream), "stream");
+	s->path = str_new(path);
+	s->data = data;
+	s->size = size;
+	s->mtime = mtime;
+	s->format = format;
+	s->stats = NULL;
+	s->ntrks = ntrks;
+	s->tpq = timecode;
+	s->trk = xmalloc((ntrks + 1) * sizeof(struct stream_trk), "stream_trk");
+	s->heap = xmalloc((ntrks + 1) * sizeof(unsigned), "stream_heap");
+	s->nheap = 0;
+	for (i = 0; i < ntrks; i++) {
+		s->trk[i].smf = trk[i];
+		s->trk[i].status = 0;
+		s->trk[i].tic = 0;
+		s->trk[i].eot = 0;
+		stream_getdelta(s, i);
+	}
+	s->pos.tic = 0;
+	s->pos.measure = 0;
+	s->pos.mtic = 0;
+	s->pos.mlen = 4 * timecode;
+	s->pos.usec24 = STREAM_TEMPO * 24 / timecode;
+	memset(s->pos.ctl, STREAM_UNSET, sizeof(s->pos.ctl));
+	memset(s->pos.prog, STREAM_UNSET, sizeof(s->pos.prog));
+	for (i = 0; i < 16; i++)
+		s->pos.bend[i] = EV_UNDEF;
+	s->maxidx = 16;
+	s->idx = xmalloc(s->maxidx * sizeof(struct stream_idx), "stream_idx");
+	s->nidx = 0;
+	stream_idxadd(s);
+	timo_set(&s->timo, stream_timocb, s);
+	return s;
+bad:
+	stream_mdep_unmap(data, size);
+	return NULL;
+}
+
+/*
+ * unmap the file and free the index
+ */
+void
+stream_del(struct stream *s)
+{
+	unsigned i;
+
+	for (i = 0; i < s->nidx; i++)
+		xfree(s->idx[i].trk);
+	xfree(s->idx);
+	xfree(s->heap);
+	xfree(s->trk);
+	stream_mdep_unmap(s->data, s->size);
+	str_delete(s->path);
+	xfree(s);
+}
+
+/*
+ * save the track cursors in the given array
+ */
+void
+stream_mark(struct stream *s, struct stream_mark *m)
+{
+	struct stream_trk *t;
+	unsigned i;
+
+	for (i = 0; i < s->ntrks; i++) {
+		t = &s->trk[i];
+		m[i].off = t->smf.p - s->data;
+		m[i].end = t->smf.cend - s->data;
+		m[i].status = t->status;
+		m[i].tic = t->tic;
+		m[i].eot = t->eot;
+	}
+}
+
+/*
+ * move to the position of the given index entry
+ */
+void
+stream_restore(struct stream *s, struct stream_idx *e)
+{
+	struct stream_trk *t;
+	unsigned i;
+
+	s->pos = e->pos;
+	s->nheap = 0;
+	for (i = 0; i < s->ntrks; i++) {
+		t = &s->trk[i];
+		t->smf.file = NULL;
+		t->smf.path = s->path;
+		t->smf.data = s->data;
+		t->smf.end = s->data + s->size;
+		t->smf.p = s->data + e->trk[i].off;
+		t->smf.cend = s->data + e->trk[i].end;
+		t->status = e->trk[i].status;
+		t->tic = e->trk[i].tic;
+		t->eot = e->trk[i].eot;
+		if (!t->eot)
+			stream_heapins(s, i);
+	}
+}
+
+/*
+ * add an index entry for the current position, if it's after the
+ * last one. Must be called at the beginning of a measure, before any
+ * event of the measure is processed
+ */
+void
+stream_idxadd(struct stream *s)
+{
+	struct stream_idx *e;
+
+	if (s->nidx > 0 && s->idx[s->nidx - 1].pos.measure >= s->pos.measure)
+		return;
+	if (s->nidx == s->maxidx) {
+		s->maxidx *= 2;
+		e = xmalloc(s->maxidx * sizeof(struct stream_idx), "stream_idx");
+		memcpy(e, s->idx, s->nidx * sizeof(struct stream_idx));
+		xfree(s->idx);
+		s->idx = e;
+	}
+	e = &s->idx[s->nidx++];
+	e->pos = s->pos;
+	e->trk = xmalloc((s->ntrks + 1) * sizeof(struct stream_mark),
+	    "stream_mark");
+	stream_mark(s, e->trk);
+}
+
+/*
+ * move the current position forward to the given time, updating the
+ * measure number, and indexing measure boundaries
+ */
+void
+stream_advance(struct stream *s, unsigned tic)
+{
+	while (tic - s->pos.mtic >= s->pos.mlen) {
+		s->pos.mtic += s->pos.mlen;
+		s->pos.measure++;
+		s->pos.tic = s->pos.mtic;
+		if (s->pos.measure % STREAM_IDXSTEP == 0 && s->stats == NULL)
+			stream_idxadd(s);
+	}
+	s->pos.tic = tic;
+}
+
+/*
+ * decode the next event of the given track, update the state and, if
+ * 'play' is set, send it. Return 0 if the track is corrupted
+ */
+unsigned
+stream_event(struct stream *s, unsigned i, unsigned play)
+{
+	static unsigned char sysex_start = 0xf0;
+	struct stream_trk *t = &s->trk[i];
+	struct smf *f = &t->smf;
+	unsigned c, type, len, tempo, num, den;
+	unsigned char *data;
+	struct stream_stats *st = s->stats;
+	struct ev ev;
+
+	if (!smf_getc(f, &c))
+		return 0;
+	if (c == 0xff) {
+		t->status = 0;
+		if (!smf_getc(f, &type) || !smf_getvar(f, &len))
+			return 0;
+		if (type == 0x51 && len == 3) {
+			if (!smf_get24(f, &tempo))
+				return 0;
+			s->pos.usec24 = tempo * 24 / s->tpq;
+			if (s->pos.usec24 == 0)
+				s->pos.usec24 = 1;
+			if (st) {
+				if (st->ntempo == 0 || st->tempo_min > tempo)
+					st->tempo_min = tempo;
+				if (st->ntempo == 0 || st->tempo_max < tempo)
+					st->tempo_max = tempo;
+				st->ntempo++;
+			}
+		} else if (type == 0x58 && len == 4) {
+			if (!smf_getc(f, &num) || !smf_getc(f, &den) ||
+			    !smf_skip(f, 2))
+				return 0;
+			if (num == 0 || den > 6) {
+				cons_erru(i, "bad time signature, ignored");
+				return 1;
+			}
+			/*
+			 * if the signature changes in the middle of a
+			 * measure, a new measure starts
+			 */
+			if (s->pos.tic != s->pos.mtic) {
+				s->pos.mtic = s->pos.tic;
+				s->pos.measure++;
+			}
+			s->pos.mlen = num * 4 * s->tpq >> den;
+			if (s->pos.mlen == 0)
+				s->pos.mlen = 1;
+			if (st)
+				st->nsig++;
+		} else {
+			if (!smf_skip(f, len))
+				return 0;
+			if (st && type != 0x2f)
+				st->nmeta++;
+		}
+	} else if (c == 0xf0 || c == 0xf7) {
+		t->status = 0;
+		if (!smf_getvar(f, &len))
+			return 0;
+		data = f->p;
+		if (!smf_skip(f, len))
+			return 0;
+		if (st)
+			st->nsx++;
+		if (play) {
+			if (c == 0xf0)
+				mux_sendraw(0, &sysex_start, 1);
+			mux_sendraw(0, data, len);
+		}
+	} else {
+		if (c >= 0x80) {
+			t->status = c;
+			if (!smf_getc(f, &c))
+				return 0;
+		} else if (t->status == 0) {
+			cons_erru(i, "bad status");
+			return 0;
+		}
+		ev.cmd = (t->status >> 4) & 0xf;
+		ev.dev = 0;
+		ev.ch = t->status & 0xf;
+		ev.v0 = c & 0x7f;
+		if (SMF_EVLEN(t->status) == 2) {
+			if (!smf_getc(f, &c))
+				return 0;
+			c &= 0x7f;
+			if (ev.cmd == EV_BEND) {
+				ev.v0 += c << 7;
+			} else {
+				ev.v1 = c;
+			}
+		}
+		switch (ev.cmd) {
+		case EV_NON:
+			if (ev.note_vel == 0) {
+				ev.cmd = EV_NOFF;
+				ev.note_vel = EV_NOFF_DEFAULTVEL;
+				if (s->notes[ev.ch][ev.note_num] > 0)
+					s->notes[ev.ch][ev.note_num]--;
+			} else if (s->notes[ev.ch][ev.note_num] < 0xff)
+				s->notes[ev.ch][ev.note_num]++;
+			break;
+		case EV_NOFF:
+			if (s->notes[ev.ch][ev.note_num] > 0)
+				s->notes[ev.ch][ev.note_num]--;
+			break;
+		case EV_CTL:
+			s->pos.ctl[ev.ch][ev.ctl_num] = ev.ctl_val;
+			break;
+		case EV_PC:
+			s->pos.prog[ev.ch] = ev.v0;
+			break;
+		case EV_BEND:
+			s->pos.bend[ev.ch] = ev.bend_val;
+			break;
+		}
+		if (st) {
+			switch (ev.cmd) {
+			case EV_NON:
+				st->nnote++;
+				break;
+			case EV_KAT:
+				st->nkat++;
+				break;
+			case EV_CTL:
+				st->nctl++;
+				break;
+			case EV_PC:
+				st->npc++;
+				break;
+			case EV_CAT:
+				st->ncat++;
+				break;
+			case EV_BEND:
+				st->nbend++;
+				break;
+			}
+			st->chans |= 1 << ev.ch;
+		}
+		if (play)
+			mux_putev(&ev);
+	}
+	return 1;
+}
+
+/*
+ * process all events at the current position, 'play' has the same
+ * meaning as for stream_event()
+ */
+void
+stream_next(struct stream *s, unsigned play)
+{
+	unsigned i;
+
+	while (s->nheap > 0 && s->trk[s->heap[0]].tic == s->pos.tic) {
+		i = stream_heapdel(s);
+		if (!stream_event(s, i, play)) {
+			cons_erru(i, "track corrupted, rest ignored");
+			s->trk[i].eot = 1;
+			if (s->stats)
+				s->stats->nbad++;
+			continue;
+		}
+		stream_getdelta(s, i);
+		if (!s->trk[i].eot)
+			stream_heapins(s, i);
+	}
+}
+
+/*
+ * move to the beginning of the given measure, without sending
+ * events. If the file is shorter, move to its end
+ */
+void
+stream_seek(struct stream *s, unsigned measure)
+{
+	unsigned i, next;
+
+	for (i = s->nidx - 1; i > 0; i--) {
+		if (s->idx[i].pos.measure <= measure)
+			break;
+	}
+	stream_restore(s, &s->idx[i]);
+	while (s->nheap > 0 && s->pos.measure < measure) {
+		next = s->trk[s->heap[0]].tic;
+		if (next - s->pos.mtic >= s->pos.mlen) {
+			stream_advance(s, s->pos.mtic + s->pos.mlen);
+			continue;
+		}
+		stream_advance(s, next);
+		stream_next(s, 0);
+	}
+}
+
+/*
+ * send the controller state of the current position: bank select
+ * first, then program changes, then other controllers and bend.
+ * Channel mode messages and (N)RPN related controllers are not sent
+ * as they don't make sense out of context
+ */
+void
+stream_chase(struct stream *s)
+{
+	static unsigned char first[] = {0, 32};
+	struct ev ev;
+	unsigned ch, i, val;
+
+	ev.dev = 0;
+	for (ch = 0; ch < 16; ch++) {
+		ev.ch = ch;
+		ev.cmd = EV_CTL;
+		for (i = 0; i < sizeof(first); i++) {
+			val = s->pos.ctl[ch][first[i]];
+			if (val == STREAM_UNSET)
+				continue;
+			ev.ctl_num = first[i];
+			ev.ctl_val = val;
+			mux_putev(&ev);
+		}
+		if (s->pos.prog[ch] != STREAM_UNSET) {
+			ev.cmd = EV_PC;
+			ev.v0 = s->pos.prog[ch];
+			mux_putev(&ev);
+		}
+		ev.cmd = EV_CTL;
+		for (i = 1; i < 120; i++) {
+			val = s->pos.ctl[ch][i];
+			if (val == STREAM_UNSET || i == 32 || i == 6 || i == 38 ||
+			    (i >= 96 && i <= 101))
+				continue;
+			ev.ctl_num = i;
+			ev.ctl_val = val;
+			mux_putev(&ev);
+		}
+		if (s->pos.bend[ch] != EV_UNDEF) {
+			ev.cmd = EV_BEND;
+			ev.bend_val = s->pos.bend[ch];
+			mux_putev(&ev);
+		}
+	}
+}
+
+/*
+ * send a note-off for every sounding note
+ */
+void
+stream_notesoff(struct stream *s)
+{
+	struct ev ev;
+	unsigned ch, i;
+
+	ev.cmd = EV_NOFF;
+	ev.dev = 0;
+	ev.note_vel = EV_NOFF_DEFAULTVEL;
+	for (ch = 0; ch < 16; ch++) {
+		ev.ch = ch;
+		for (i = 0; i < 128; i++) {
+			while (s->notes[ch][i] > 0) {
+				ev.note_num = i;
+				mux_putev(&ev);
+				s->notes[ch][i]--;
+			}
+		}
+	}
+	mux_flush();
+}
+
+/*
+ * send events that are due and schedule the next timeout. Long
+ * waits are split, so measure boundaries are indexed and tempo
+ * changes are taken into account on time. The absolute time of the
+ * current position is kept, so rounding errors don't accumulate
+ */
+void
+stream_timocb(void *addr)
+{
+	struct stream *s = addr;
+	unsigned next, n, max;
+	int delta;
+
+	for (;;) {
+		stream_next(s, 1);
+		if (s->nheap == 0) {
+			s->done = 1;
+			mux_flush();
+			return;
+		}
+		next = s->trk[s->heap[0]].tic;
+		n = next - s->pos.tic;
+		max = STREAM_MAXWAIT / s->pos.usec24;
+		if (max == 0)
+			max = 1;
+		if (n > max)
+			n = max;
+		stream_advance(s, s->pos.tic + n);
+		s->due += n * s->pos.usec24;
+		delta = s->due - timo_abstime;
+		if (delta > 0) {
+			mux_flush();
+			timo_add(&s->timo, delta);
+			return;
+		}
+	}
+}
+
+/*
+ * play the given file starting at the given measure on device 0.
+ * The song must be stopped. Return 0 if the file couldn't be read
+ */
+unsigned
+stream_play(struct song *o, char *path, unsigned measure)
+{
+	struct stream *s;
+	unsigned char *data;
+	unsigned long mtime;
+	size_t size;
+
+	/*
+	 * reuse the index of the last file if it's unchanged
+	 */
+	s = stream_cache;
+	if (s != NULL && str_eq(s->path, path)) {
+		data = stream_mdep_map(path, &size, &mtime);
+		if (data == NULL)
+			return 0;
+		stream_mdep_unmap(s->data, s->size);
+		s->data = data;
+		if (size != s->size || mtime != s->mtime) {
+			stream_del(s);
+			stream_cache = s = NULL;
+		}
+	} else
+		s = NULL;
+	if (s == NULL) {
+		if (stream_cache) {
+			stream_del(stream_cache);
+			stream_cache = NULL;
+		}
+		s = stream_new(path);
+		if (s == NULL)
+			return 0;
+		stream_cache = s;
+	}
+
+	stream_seek(s, measure);
+	memset(s->notes, 0, sizeof(s->notes));
+	s->done = 0;
+	song_idle(o);
+	stream_chase(s);
+	s->due = timo_abstime;
+	stream_timocb(s);
+	cons_err("press ^C to stop playback");
+	while (!s->done && mux_mdep_wait(0))
+		; /* nothing */
+	cons_err("playback stopped");
+	timo_del(&s->timo);
+	stream_notesoff(s);
+	song_stop(o);
+	return 1;
+}
+
+/*
+ * compute the summary of the given file in a single pass, without
+ * building a song. Return 0 if the file couldn't be read
+ */
+unsigned
+stream_scan(char *path, struct stream_stats *st)
+{
+	struct stream *s;
+	unsigned next;
+
+	s = stream_new(path);
+	if (s == NULL)
+		return 0;
+	memset(st, 0, sizeof(struct stream_stats));
+	st->format = s->format;
+	st->ntrks = s->ntrks;
+	st->tpq = s->tpq;
+	s->stats = st;
+	stream_restore(s, &s->idx[0]);
+	while (s->nheap > 0) {
+		next = s->trk[s->heap[0]].tic;
+		st->usec24 += (unsigned long long)(next - s->pos.tic) *
+		    s->pos.usec24;
+		stream_advance(s, next);
+		stream_next(s, 0);
+	}
+	st->tics = s->pos.tic;
+	stream_del(s);
+	return 1;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef MIDISH_STREAM_H
+#define MIDISH_STREAM_H
+
+struct song;
+
+/*
+ * summary of a file, computed without building a song
+ */
+struct stream_stats {
+	unsigned format;		/* 0 or 1 */
+	unsigned ntrks;			/* number of track chunks */
+	unsigned tpq;			/* tics per quarter */
+	unsigned tics;			/* duration in tics */
+	unsigned long long usec24;	/* duration in 24th of usec */
+	unsigned nnote;			/* note-on events */
+	unsigned nkat, nctl, npc;	/* other voice events */
+	unsigned ncat, nbend;
+	unsigned nsx;			/* sysex and raw data messages */
+	unsigned ntempo;		/* tempo changes */
+	unsigned tempo_min, tempo_max;	/* in usec per quarter */
+	unsigned nsig;			/* time signature changes */
+	unsigned nmeta;			/* other meta events */
+	unsigned chans;			/* bitmap of channels used */
+	unsigned nbad;			/* corrupted tracks */
+};
+
+unsigned stream_play(struct song *, char *, unsigned);
+unsigned stream_scan(char *, struct stream_stats *);
+
+unsigned char *stream_mdep_map(char *, size_t *, unsigned long *);
+void stream_mdep_unmap(unsigned char *, size_t);
+
+#endif /* MIDISH_STREAM_H */
@@ -27,6 +27,8 @@
  * list.
  */
 
+#include <string.h>
+
 #include "utils.h"
 #include "sysex.h"
 #include "defs.h"
@@ -126,6 +128,35 @@ sysex_add(struct sysex *o, unsigned data)
 	ck->data[ck->used++] = data;
 }
 
+/*
+ * add the given bytes to the message
+ */
+void
+sysex_addbuf(struct sysex *o, unsigned char *buf, unsigned count)
+{
+	struct chunk *ck;
+	unsigned n;
+
+	ck = o->last;
+	if (!ck) {
+		ck = o->first = o->last = chunk_new();
+	}
+	while (count > 0) {
+		if (ck->used >= CHUNK_SIZE) {
+			ck->next = chunk_new();
+			ck = ck->next;
+			o->last = ck;
+		}
+		n = CHUNK_SIZE - ck->used;
+		if (n > count)
+			n = count;
+		memcpy(ck->data + ck->used, buf, n);
+		ck->used += n;
+		buf += n;
+		count -= n;
+	}
+}
+
 /*
  * dump the sysex message on stderr
  */
@@ -235,6 +266,19 @@ sysexlist_put(struct sysexlist *o, struct sysex *e)
 	o->lastptr = &e->next;
 }
 
+/*
+ * move all messages of the second list at the end of the first one
+ */
+void
+sysexlist_splice(struct sysexlist *o, struct sysexlist *src)
+{
+	if (src->first == NULL)
+		return;
+	*o->lastptr = src->first;
+	o->lastptr = src->lastptr;
+	sysexlist_init(src);
+}
+
 /*
  * detach the first sysex message from the list
  */
@@ -51,6 +51,7 @@ void	      sysex_pool_done(void);
 struct sysex *sysex_new(unsigned);
 void	      sysex_del(struct sysex *);
 void	      sysex_add(struct sysex *, unsigned);
+void	      sysex_addbuf(struct sysex *, unsigned char *, unsigned);
 void	      sysex_log(struct sysex *);
 unsigned      sysex_check(struct sysex *);
 
@@ -58,6 +59,7 @@ void 	      sysexlist_init(struct sysexlist *);
 void	      sysexlist_done(struct sysexlist *);
 void	      sysexlist_clear(struct sysexlist *);
 void	      sysexlist_put(struct sysexlist *, struct sysex *);
+void	      sysexlist_splice(struct sysexlist *, struct sysexlist *);
 struct sysex *sysexlist_get(struct sysexlist *);
 void	      sysexlist_log(struct sysexlist *);
 
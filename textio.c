@@ -16,10 +16,14 @@
 
 /*
  * textin implemets inputs from text files (or stdin)
- * (open/close, line numbering, etc...). Used by lex
+ * (open/close, line numbering, etc...). Used by lex.
+ * Files are read by large blocks that lexers scan directly; the
+ * position of a character is calculated only when it's needed,
+ * i.e. to report an error.
  *
  * textout implements outputs into text files (or stdout)
- * (open/close, indentation...)
+ * (open/close, indentation...), or into memory buffers, allowing
+ * parts of files to be generated once and copied many times
  *
  */
 
@@ -31,16 +35,24 @@
 #include "textio.h"
 #include "cons.h"
 
+#define TEXTIN_BUFSZ	0x10000
+
 struct textin
 {
 	FILE *file;
-	unsigned line, col;
+	unsigned char *end;		/* end of the current block */
+	unsigned line, col;		/* position of the block start */
+	unsigned char buf[TEXTIN_BUFSZ];
 };
 
+#define TEXTOUT_BUFSZ	0x1000
+
 struct textout
 {
-	FILE *file;
+	FILE *file;			/* NULL if memory buffer */
 	unsigned indent, isconsole, col;
+	unsigned char *buf;		/* memory buffer */
+	unsigned used, size;
 };
 
 /* -------------------------------------------------------- input --- */
@@ -61,6 +73,7 @@ textin_new(char *filename)
 			return 0;
 		}
 	}
+	o->end = o->buf;
 	o->line = o->col = 0;
 	return o;
 }
@@ -72,34 +85,54 @@ textin_delete(struct textin *o)
 	xfree(o);
 }
 
+/*
+ * discard the current block and read the next one, the caller
+ * scans characters between start and end; the block is empty at the
+ * end of the file. Return 0 on error
+ */
 unsigned
-textin_getchar(struct textin *o, int *c)
+textin_getbuf(struct textin *o, unsigned char **start, unsigned char **end)
 {
-	*c = fgetc(o->file);
-	if (*c == EOF) {
-		*c = CHAR_EOF;
-		if (ferror(o->file)) {
-			log_perror("fgetc");
-		}
-		return 1;
-	}
-	if (*c == '\n') {
-		o->col = 0;
-		o->line++;
-	} else if (*c == '\t') {
-		o->col += 8;
-	} else {
-		o->col++;
+	size_t n;
+
+	textin_getpos(o, o->end, &o->line, &o->col);
+	n = fread(o->buf, 1, TEXTIN_BUFSZ, o->file);
+	if (n == 0 && ferror(o->file)) {
+		log_perror("fread");
+		return 0;
 	}
-	*c = *c & 0xff;
+	o->end = o->buf + n;
+	*start = o->buf;
+	*end = o->end;
 	return 1;
 }
 
+/*
+ * return the position of the given character of the current block,
+ * or of the end of file if it's the block end
+ */
 void
-textin_getpos(struct textin *o, unsigned *line, unsigned *col)
+textin_getpos(struct textin *o, unsigned char *ptr,
+    unsigned *line, unsigned *col)
 {
-	*line = o->line;
-	*col = o->col;
+	unsigned char *p, *q;
+	unsigned l, c;
+
+	l = o->line;
+	c = o->col;
+	q = o->buf;
+	for (;;) {
+		p = memchr(q, '\n', ptr - q);
+		if (p == NULL)
+			break;
+		l++;
+		c = 0;
+		q = p + 1;
+	}
+	for (p = q; p != ptr; p++)
+		c += (*p == '\t') ? 8 : 1;
+	*line = l;
+	*col = c;
 }
 
 /* ------------------------------------------------------- output --- */
@@ -124,18 +157,95 @@ textout_new(char *filename)
 	}
 	o->indent = 0;
 	o->col = 0;
+	o->buf = NULL;
+	return o;
+}
+
+/*
+ * create a memory buffer to generate text meant to be copied into
+ * the given output at its current position, so indentation is the same
+ */
+struct textout *
+textout_newbuf(struct textout *f)
+{
+	struct textout *o;
+
+	o = xmalloc(sizeof(struct textout), "textout");
+	o->file = NULL;
+	o->isconsole = 0;
+	o->indent = f->indent;
+	o->col = f->col;
+	o->size = TEXTOUT_BUFSZ;
+	o->used = 0;
+	o->buf = xmalloc(o->size, "textout_buf");
 	return o;
 }
 
 void
 textout_delete(struct textout *o)
 {
-	if (!o->isconsole) {
+	if (o->buf) {
+		xfree(o->buf);
+	} else if (!o->isconsole) {
 		fclose(o->file);
 	}
 	xfree(o);
 }
 
+/*
+ * return the text stored in a memory buffer
+ */
+unsigned char *
+textout_getbuf(struct textout *o, unsigned *len)
+{
+	*len = o->used;
+	return o->buf;
+}
+
+void
+textout_write(struct textout *o, char *data, unsigned len)
+{
+	unsigned char *buf;
+	unsigned size;
+
+	if (o->isconsole) {
+		log_putc(data, len);
+	} else if (o->buf) {
+		if (o->used + len > o->size) {
+			size = o->size;
+			while (o->used + len > size)
+				size *= 2;
+			buf = xmalloc(size, "textout_buf");
+			memcpy(buf, o->buf, o->used);
+			xfree(o->buf);
+			o->buf = buf;
+			o->size = size;
+		}
+		memcpy(o->buf + o->used, data, len);
+		o->used += len;
+	} else
+		fwrite(data, len, 1, o->file);
+}
+
+/*
+ * copy text generated with textout_newbuf() at the same position
+ */
+void
+textout_putraw(struct textout *o, unsigned char *data, unsigned len)
+{
+	unsigned char *p;
+
+	textout_write(o, (char *)data, len);
+	for (p = data + len; p != data; p--) {
+		if (p[-1] == '\n') {
+			o->col = 0;
+			break;
+		}
+	}
+	for (; p != data + len; p++)
+		o->col += (*p == '\t') ? 8 : 1;
+}
+
 void
 textout_shiftleft(struct textout *o)
 {
@@ -161,10 +271,7 @@ textout_putstr(struct textout *o, char *str)
 
 		if (o->col == 0) {
 			for (i = 0; i < o->indent; i++) {
-				if (o->isconsole)
-					log_putc(buf, sizeof(buf));
-				else
-					fwrite(buf, sizeof(buf), 1, o->file);
+				textout_write(o, buf, sizeof(buf));
 				o->col += 8;
 			}
 		}
@@ -178,10 +285,7 @@ textout_putstr(struct textout *o, char *str)
 			o->col++;
 		}
 
-		if (o->isconsole)
-			log_putc(str, p - str);
-		else
-			fwrite(str, p - str, 1, o->file);
+		textout_write(o, str, p - str);
 		str = p;
 	}
 }
@@ -189,10 +293,23 @@ textout_putstr(struct textout *o, char *str)
 void
 textout_putlong(struct textout *o, long val)
 {
-	char buf[sizeof(val) * 3 + 1];
+	char buf[sizeof(val) * 3 + 2], *p;
+	unsigned long u;
 
-	snprintf(buf, sizeof(buf), "%ld", val);
-	textout_putstr(o, buf);
+	/*
+	 * convert by hand, snprintf() is too slow to output large
+	 * songs, which contain mostly numbers
+	 */
+	p = buf + sizeof(buf);
+	*--p = '\0';
+	u = (val < 0) ? -(unsigned long)val : (unsigned long)val;
+	do {
+		*--p = '0' + u % 10;
+		u /= 10;
+	} while (u > 0);
+	if (val < 0)
+		*--p = '-';
+	textout_putstr(o, p);
 }
 
 void
@@ -19,16 +19,32 @@
 
 #define CHAR_EOF (-1)
 
+/*
+ * character classes shared by the song file and script lexers
+ */
+#define IS_SPACE(c)	((c) == ' ' || (c) == '\r' || (c) == '\t')
+#define IS_PRINTABLE(c)	((c) >= ' ' && (c) != 0x7f)
+#define IS_DIGIT(c)	((c) >= '0' && (c) <= '9')
+#define IS_ALPHA(c)	(((c) >= 'A' && (c) <= 'Z') || \
+			 ((c) >= 'a' && (c) <= 'z'))
+#define IS_IDFIRST(c)	(IS_ALPHA(c) || (c) == '_')
+#define IS_IDNEXT(c)	(IS_IDFIRST(c) || IS_DIGIT(c))
+#define IS_QUOTE(c)	((c) == '"')
+
 struct textin;
 struct textout;
 
 struct textin *textin_new(char *);
 void textin_delete(struct textin *);
-unsigned textin_getchar(struct textin *, int *);
-void textin_getpos(struct textin *, unsigned *, unsigned *);
+unsigned textin_getbuf(struct textin *, unsigned char **, unsigned char **);
+void textin_getpos(struct textin *, unsigned char *, unsigned *, unsigned *);
 
 struct textout *textout_new(char *);
+struct textout *textout_newbuf(struct textout *);
 void textout_delete(struct textout *);
+unsigned char *textout_getbuf(struct textout *, unsigned *);
+void textout_write(struct textout *, char *, unsigned);
+void textout_putraw(struct textout *, unsigned char *, unsigned);
 void textout_shiftleft(struct textout *);
 void textout_shiftright(struct textout *);
 void textout_putstr(struct textout *, char *);
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * thru.c
+ *
+ * fast path for MIDI-thru in idle mode. If the current filter is a
+ * simple device/channel remap (or if there's no filter at all), then
+ * the destinations of notes are computed once for all input channels
+ * and stored in a table. Note frames are then sent directly to the
+ * output devices, without going through filt_do(), the mixout
+ * statelist and the output converter.
+ *
+ * The normalizer still keeps the state of the input frames, so
+ * norm_shut() and friends can cancel them. It tags frames started
+ * while the fast path is enabled, and sends all their events through
+ * it, so a frame is never split between the two paths.
+ *
+ * The table is computed again when a new frame starts if the current
+ * filter was replaced or if any filter was modified since.
+ *
+ * Notes are written immediately, unless they are part of a batch of
+ * input events, which is flushed at once when it's processed.
+ *
+ */
+
+#include "utils.h"
+#include "defs.h"
+#include "ev.h"
+#include "filt.h"
+#include "mididev.h"
+#include "mux.h"
+#include "song.h"
+#include "thru.h"
+#include "trace.h"
+
+/*
+ * destinations of a given input device/channel pair
+ */
+struct thru_dst {
+	unsigned ndst;
+	unsigned char dev[THRU_MAXDST], ch[THRU_MAXDST];
+};
+
+unsigned thru_debug = 0;
+unsigned thru_enabled = 0;	/* table is valid, fast path in use */
+unsigned thru_active = 0;	/* idle mode, fast path may be used */
+unsigned thru_gen;		/* filt_gen the table was computed for */
+struct filt *thru_filt;		/* filter the table was computed for */
+struct thru_dst thru_tab[DEFAULT_MAXNDEVS][EV_MAXCH + 1];
+
+/*
+ * return 1 if the given evspec matches either all notes of its
+ * device/channel range or no note at all, ie if the way notes are
+ * mapped doesn't depend on the note number or velocity
+ */
+unsigned
+thru_isremap(struct evspec *es)
+{
+	switch (es->cmd) {
+	case EVSPEC_ANY:
+	case EVSPEC_EMPTY:
+		return 1;
+	case EVSPEC_NOTE:
+		return es->v0_min == 0 && es->v0_max == EV_MAXCOARSE &&
+		    es->v1_min == 0 && es->v1_max == EV_MAXCOARSE;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * compute the destination table for the given filter and enable the
+ * fast path. If the filter is too complicated, then disable it
+ */
+void
+thru_setfilt(struct filt *f)
+{
+	struct filtnode *s, *d;
+	struct ev in, out[FILT_MAXNRULES];
+	unsigned dev, ch, i, nev;
+
+	thru_enabled = 0;
+	thru_active = 1;
+	thru_filt = f;
+	thru_gen = filt_gen;
+	if (f != NULL) {
+		if (f->vcurve != NULL || f->transp != NULL)
+			goto slow;
+		for (s = f->map; s != NULL; s = s->next) {
+			if (s->es.cmd != EVSPEC_ANY && s->es.cmd != EVSPEC_NOTE)
+				continue;
+			if (!thru_isremap(&s->es))
+				goto slow;
+			for (d = s->dstlist; d != NULL; d = d->next) {
+				if (!thru_isremap(&d->es))
+					goto slow;
+			}
+		}
+	}
+	for (dev = 0; dev < DEFAULT_MAXNDEVS; dev++) {
+		for (ch = 0; ch <= EV_MAXCH; ch++) {
+			in.cmd = EV_NON;
+			in.dev = dev;
+			in.ch = ch;
+			in.note_num = 0;
+			in.note_vel = 0;
+			if (f != NULL) {
+				nev = filt_do(f, &in, out);
+			} else {
+				out[0] = in;
+				nev = 1;
+			}
+			if (nev > THRU_MAXDST)
+				goto slow;
+			for (i = 0; i < nev; i++) {
+				thru_tab[dev][ch].dev[i] = out[i].dev;
+				thru_tab[dev][ch].ch[i] = out[i].ch;
+			}
+			thru_tab[dev][ch].ndst = nev;
+		}
+	}
+	thru_enabled = 1;
+	if (thru_debug)
+		log_puts("thru_setfilt: fast path enabled\n");
+	return;
+slow:
+	if (thru_debug)
+		log_puts("thru_setfilt: filter too complex, fast path disabled\n");
+}
+
+/*
+ * disable the fast path for new frames. Frames already started
+ * still use it, until they terminate
+ */
+void
+thru_disable(void)
+{
+	thru_enabled = 0;
+	thru_active = 0;
+}
+
+/*
+ * return 1 if the frame started by the given event can be sent
+ * through the fast path
+ */
+unsigned
+thru_isfast(struct ev *ev)
+{
+	struct filt *f;
+
+	if (!thru_active || usong->tap_mode != SONG_TAP_OFF)
+		return 0;
+	f = usong->curfilt ? &usong->curfilt->filt : NULL;
+	if (f != thru_filt || thru_gen != filt_gen)
+		thru_setfilt(f);
+	if (!thru_enabled)
+		return 0;
+	return ev->cmd == EV_NON || ev->cmd == EV_NOFF || ev->cmd == EV_KAT;
+}
+
+/*
+ * send the given note event to all its destinations
+ */
+void
+thru_putev(struct ev *ev)
+{
+	struct thru_dst *t;
+	struct mididev *dev;
+	struct ev oev;
+	unsigned i;
+
+	TRACE_EV(TRACE_THRU, ev);
+	if (thru_debug) {
+		log_puts("thru_putev: ");
+		ev_log(ev);
+		log_puts("\n");
+	}
+	t = &thru_tab[ev->dev][ev->ch];
+	oev = *ev;
+	for (i = 0; i < t->ndst; i++) {
+		dev = mididev_byunit[t->dev[i]];
+		if (dev == NULL)
+			continue;
+		oev.dev = t->dev[i];
+		oev.ch = t->ch[i];
+		mididev_putev(dev, &oev);
+		if (!mux_inbatch)
+			mididev_flush(dev);
+	}
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * trace.c
+ *
+ * records events passing through the stages of the pipeline (from
+ * mux_evcb() to mididev_flush()) in a ring buffer, along with a
+ * microsecond time-stamp. The ring can be saved in the Chrome trace
+ * event format (JSON), readable by chrome://tracing and Perfetto,
+ * where each stage is shown as a separate thread.
+ *
+ * Each event received by mux_evcb() gets a new id, and all entries
+ * recorded while it's processed carry it (events queued by mixout
+ * keep the id of the input event that queued them). The saved trace
+ * links entries with the same id by flow events, so the path of
+ * each input event through the pipeline, and its latency, can be
+ * followed directly. Output not caused by an input event (playback,
+ * metronome, ...) has id 0 and is not linked.
+ *
+ * midish is single threaded, so no locking is needed.
+ *
+ */
+
+#include "utils.h"
+#include "defs.h"
+#include "ev.h"
+#include "textio.h"
+#include "trace.h"
+
+unsigned trace_enabled = 0;
+struct trace_ent trace_ring[TRACE_NENT];
+unsigned trace_head;			/* next entry to write */
+unsigned trace_used;			/* valid entries */
+unsigned long trace_origin;		/* time of trace_start() */
+unsigned trace_id;			/* id of the current input event */
+unsigned trace_lastid;			/* last allocated id */
+unsigned trace_devid[DEFAULT_MAXNDEVS];	/* last id written to device */
+unsigned trace_seen[TRACE_NENT];	/* scratch for trace_markflows() */
+unsigned char trace_mark[TRACE_NENT];	/* first/last entry of its id */
+
+#define TRACE_FIRST	1
+#define TRACE_LAST	2
+
+char *trace_stagename[TRACE_NSTAGE] = {
+	"mux_evcb", "norm_evcb", "song_evcb", "filt_do",
+	"mixout_putev", "mux_putev", "thru_putev", "mididev_flush"
+};
+
+/*
+ * clear the ring and start recording
+ */
+void
+trace_start(void)
+{
+	unsigned i;
+
+	trace_head = 0;
+	trace_used = 0;
+	trace_origin = trace_mdep_gettime();
+	trace_id = trace_lastid = 0;
+	for (i = 0; i < DEFAULT_MAXNDEVS; i++)
+		trace_devid[i] = 0;
+	trace_enabled = 1;
+}
+
+/*
+ * stop recording, but keep the ring contents
+ */
+void
+trace_stop(void)
+{
+	trace_enabled = 0;
+}
+
+/*
+ * return a new entry, overwriting the oldest one if the ring is full
+ */
+struct trace_ent *
+trace_new(unsigned stage)
+{
+	struct trace_ent *e;
+
+	e = &trace_ring[trace_head];
+	trace_head = (trace_head + 1) % TRACE_NENT;
+	if (trace_used < TRACE_NENT)
+		trace_used++;
+	e->usec = trace_mdep_gettime() - trace_origin;
+	e->stage = stage;
+	e->id = trace_id;
+	return e;
+}
+
+/*
+ * record an event reaching the given stage
+ */
+void
+trace_ev(unsigned stage, struct ev *ev)
+{
+	struct trace_ent *e;
+
+	e = trace_new(stage);
+	e->cmd = ev->cmd;
+	e->dev = ev->dev;
+	e->ch = ev->ch;
+	e->v0 = ev->v0;
+	e->v1 = ev->v1;
+	if (stage == TRACE_MUXOUT)
+		trace_devid[ev->dev] = trace_id;
+}
+
+/*
+ * record a write of the given number of bytes to the given device.
+ * Output of a batch of input events is written at once, so if there's
+ * no current input event, the write is attributed to the last one
+ * that reached the device
+ */
+void
+trace_flush(unsigned unit, unsigned nbytes)
+{
+	struct trace_ent *e;
+
+	e = trace_new(TRACE_FLUSH);
+	if (e->id == 0)
+		e->id = trace_devid[unit];
+	trace_devid[unit] = 0;
+	e->cmd = EV_NULL;
+	e->dev = unit;
+	e->ch = 0;
+	e->v0 = nbytes;
+	e->v1 = 0;
+}
+
+/*
+ * write a "key": value pair
+ */
+void
+trace_putlong(struct textout *f, char *key, long val)
+{
+	textout_putstr(f, ", \"");
+	textout_putstr(f, key);
+	textout_putstr(f, "\": ");
+	textout_putlong(f, val);
+}
+
+/*
+ * mark the first and the last entries of each id, so they can be
+ * exported as the start and the end of a flow. Entries of the same id
+ * are close to each other, so ids are hashed modulo the ring size
+ */
+void
+trace_markflows(void)
+{
+	unsigned i, n, id;
+
+	for (i = 0; i < TRACE_NENT; i++) {
+		trace_mark[i] = 0;
+		trace_seen[i] = 0;
+	}
+	i = (trace_head + TRACE_NENT - trace_used) % TRACE_NENT;
+	for (n = trace_used; n > 0; n--) {
+		id = trace_ring[i].id;
+		if (id != 0 && trace_seen[id % TRACE_NENT] != id) {
+			trace_seen[id % TRACE_NENT] = id;
+			trace_mark[i] |= TRACE_FIRST;
+		}
+		i = (i + 1) % TRACE_NENT;
+	}
+	for (i = 0; i < TRACE_NENT; i++)
+		trace_seen[i] = 0;
+	i = trace_head;
+	for (n = trace_used; n > 0; n--) {
+		i = (i + TRACE_NENT - 1) % TRACE_NENT;
+		id = trace_ring[i].id;
+		if (id != 0 && trace_seen[id % TRACE_NENT] != id) {
+			trace_seen[id % TRACE_NENT] = id;
+			trace_mark[i] |= TRACE_LAST;
+		}
+	}
+}
+
+/*
+ * save the ring in the given file, in chrome trace event format.
+ * Entries are exported as zero-length slices, and entries of the same
+ * input event are linked by a flow (an "s" event on the first entry,
+ * "t" on the intermediate ones and "f" on the last one)
+ */
+unsigned
+trace_save(char *path)
+{
+	struct textout *f;
+	struct trace_ent *e;
+	unsigned i, n, mark;
+	char *name;
+
+	f = textout_new(path);
+	if (f == NULL)
+		return 0;
+	trace_markflows();
+	textout_putstr(f, "{\"traceEvents\": [\n");
+	for (i = 0; i < TRACE_NSTAGE; i++) {
+		textout_putstr(f, "{\"name\": \"thread_name\", \"ph\": \"M\"");
+		trace_putlong(f, "pid", 0);
+		trace_putlong(f, "tid", i);
+		textout_putstr(f, ", \"args\": {\"name\": \"");
+		textout_putstr(f, trace_stagename[i]);
+		textout_putstr(f, "\"}}");
+		if (i < TRACE_NSTAGE - 1 || trace_used > 0)
+			textout_putstr(f, ",");
+		textout_putstr(f, "\n");
+	}
+	i = (trace_head + TRACE_NENT - trace_used) % TRACE_NENT;
+	for (n = trace_used; n > 0; n--) {
+		e = &trace_ring[i];
+		mark = trace_mark[i];
+		if (e->stage == TRACE_FLUSH)
+			name = "write";
+		else
+			name = evinfo[e->cmd].ev ? evinfo[e->cmd].ev : "sysex";
+		textout_putstr(f, "{\"name\": \"");
+		textout_putstr(f, name);
+		textout_putstr(f, "\", \"ph\": \"X\"");
+		trace_putlong(f, "ts", e->usec);
+		trace_putlong(f, "dur", 0);
+		trace_putlong(f, "pid", 0);
+		trace_putlong(f, "tid", e->stage);
+		textout_putstr(f, ", \"args\": {\"id\": ");
+		textout_putlong(f, e->id);
+		trace_putlong(f, "dev", e->dev);
+		if (e->stage == TRACE_FLUSH) {
+			trace_putlong(f, "bytes", e->v0);
+		} else {
+			trace_putlong(f, "ch", e->ch);
+			trace_putlong(f, "v0", e->v0);
+			trace_putlong(f, "v1", e->v1);
+		}
+		textout_putstr(f, "}}");
+		if (e->id != 0 && mark != (TRACE_FIRST | TRACE_LAST)) {
+			textout_putstr(f, ",\n{\"name\": \"ev\", \"cat\": \"flow\"");
+			if (mark & TRACE_FIRST)
+				textout_putstr(f, ", \"ph\": \"s\"");
+			else if (mark & TRACE_LAST)
+				textout_putstr(f, ", \"ph\": \"f\", \"bp\": \"e\"");
+			else
+				textout_putstr(f, ", \"ph\": \"t\"");
+			trace_putlong(f, "id", e->id);
+			trace_putlong(f, "ts", e->usec);
+			trace_putlong(f, "pid", 0);
+			trace_putlong(f, "tid", e->stage);
+			textout_putstr(f, "}");
+		}
+		textout_putstr(f, n > 1 ? ",\n" : "\n");
+		i = (i + 1) % TRACE_NENT;
+	}
+	textout_putstr(f, "]}\n");
+	textout_delete(f);
+	return 1;
+}
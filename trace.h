@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef MIDISH_TRACE_H
+#define MIDISH_TRACE_H
+
+/*
+ * number of entries in the trace ring, older entries are overwritten
+ */
+#define TRACE_NENT	0x4000
+
+/*
+ * stages of the event pipeline
+ */
+#define TRACE_MUXIN	0		/* mux_evcb */
+#define TRACE_NORM	1		/* norm_evcb */
+#define TRACE_SONG	2		/* song_evcb */
+#define TRACE_FILT	3		/* filt_do output */
+#define TRACE_MIXOUT	4		/* mixout_putev */
+#define TRACE_MUXOUT	5		/* mux_putev */
+#define TRACE_THRU	6		/* thru_putev */
+#define TRACE_FLUSH	7		/* mididev_flush */
+#define TRACE_NSTAGE	8
+
+struct ev;
+
+struct trace_ent {
+	unsigned long usec;		/* time since trace start */
+	unsigned char stage, cmd, dev, ch;
+	unsigned v0, v1;		/* for TRACE_FLUSH, v0 is bytes */
+	unsigned id;			/* input event it belongs to, or 0 */
+};
+
+/*
+ * record the given event, only if tracing is enabled, so that the
+ * cost is a single test when it's disabled
+ */
+#define TRACE_EV(stage, ev) \
+	do { if (trace_enabled) trace_ev((stage), (ev)); } while (0)
+
+/*
+ * allocate a new id for the input event being processed, all
+ * entries recorded until TRACE_END() are attributed to it
+ */
+#define TRACE_BEGIN() \
+	do { if (trace_enabled) trace_id = ++trace_lastid; } while (0)
+#define TRACE_END() \
+	do { trace_id = 0; } while (0)
+
+void trace_start(void);
+void trace_stop(void);
+void trace_ev(unsigned, struct ev *);
+void trace_flush(unsigned, unsigned);
+unsigned trace_save(char *);
+
+unsigned long trace_mdep_gettime(void);
+
+extern unsigned trace_enabled;
+extern unsigned trace_id, trace_lastid;
+
+#endif /* MIDISH_TRACE_H */
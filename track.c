@@ -29,10 +29,13 @@
  *
  */
 
+#include <string.h>
 #include "utils.h"
 #include "pool.h"
 #include "track.h"
 
+#define TRACKBUF_LEN	256		/* initial size of track buffers */
+
 struct pool seqev_pool;
 
 void
@@ -79,6 +82,8 @@ track_init(struct track *o)
 	o->eot.next = NULL;
 	o->eot.prev = &o->first;
 	o->first = &o->eot;
+	o->txt.data = NULL;
+	o->bin.data = NULL;
 }
 
 /*
@@ -93,6 +98,7 @@ track_done(struct track *o)
 		inext = i->next;
 		seqev_del(i);
 	}
+	track_uncache(o);
 #ifdef TRACK_DEBUG
 	o->first = (void *)0xdeadbeef;
 #endif
@@ -134,6 +140,7 @@ track_isempty(struct track *o)
 void
 track_chomp(struct track *o)
 {
+	track_uncache(o);
 	o->eot.delta = 0;
 }
 
@@ -143,6 +150,7 @@ track_chomp(struct track *o)
 void
 track_shift(struct track *o, unsigned ntics)
 {
+	track_uncache(o);
 	o->first->delta += ntics;
 }
 
@@ -169,6 +177,41 @@ track_swap(struct track *t1, struct track *t2)
 	/* fix references to eot events */
 	*t1->eot.prev = &t1->eot;
 	*t2->eot.prev = &t2->eot;
+
+	track_uncache(t1);
+	track_uncache(t2);
+}
+
+/*
+ * free serialized copies of the track, must be called whenever the
+ * track is modified
+ */
+void
+track_uncache(struct track *o)
+{
+	if (o->txt.data) {
+		xfree(o->txt.data);
+		o->txt.data = NULL;
+	}
+	if (o->bin.data) {
+		xfree(o->bin.data);
+		o->bin.data = NULL;
+	}
+}
+
+/*
+ * store a serialized copy of the track
+ */
+void
+track_blkset(struct track_blk *b, unsigned char *data, unsigned len,
+    unsigned tag)
+{
+	if (b->data)
+		xfree(b->data);
+	b->data = xmalloc(len, "track_blk");
+	memcpy(b->data, data, len);
+	b->len = len;
+	b->tag = tag;
 }
 
 /*
@@ -263,6 +306,108 @@ track_clear(struct track *o)
 	o->eot.delta = 0;
 	o->eot.prev = &o->first;
 	o->first = &o->eot;
+	track_uncache(o);
+}
+
+/*
+ * initialize an empty track buffer. Events are appended to it with
+ * trackbuf_put() and blank space with trackbuf_wait() or
+ * trackbuf_moveto(); then track_build() appends them to a track at
+ * once. This avoids linking events one by one while the track is
+ * being parsed
+ */
+void
+trackbuf_init(struct trackbuf *o)
+{
+	o->maxevs = TRACKBUF_LEN;
+	o->evs = xmalloc(o->maxevs * sizeof(struct seqev_data), "trackbuf");
+	o->nevs = 0;
+	o->delta = 0;
+	o->tic = 0;
+}
+
+void
+trackbuf_done(struct trackbuf *o)
+{
+	xfree(o->evs);
+}
+
+/*
+ * append the given number of tics of blank space
+ */
+void
+trackbuf_wait(struct trackbuf *o, unsigned delta)
+{
+	o->delta += delta;
+	o->tic += delta;
+}
+
+/*
+ * append blank space up to the given absolute position, which must
+ * not be before the end of the buffer
+ */
+void
+trackbuf_moveto(struct trackbuf *o, unsigned tic)
+{
+	trackbuf_wait(o, tic - o->tic);
+}
+
+/*
+ * append an event after the blank space accumulated so far
+ */
+void
+trackbuf_put(struct trackbuf *o, struct ev *ev)
+{
+	struct seqev_data *evs;
+
+	if (o->nevs == o->maxevs) {
+		evs = xmalloc(2 * o->maxevs * sizeof(struct seqev_data),
+		    "trackbuf");
+		memcpy(evs, o->evs, o->maxevs * sizeof(struct seqev_data));
+		xfree(o->evs);
+		o->evs = evs;
+		o->maxevs *= 2;
+	}
+	o->evs[o->nevs].delta = o->delta;
+	o->evs[o->nevs].ev = *ev;
+	o->nevs++;
+	o->delta = 0;
+}
+
+/*
+ * append the contents of the buffer at the end of the track, in a
+ * single pass, and empty the buffer. The absolute position of the
+ * buffer is kept, so it can be filled and appended again
+ */
+void
+track_build(struct track *t, struct trackbuf *o)
+{
+	struct seqev *se, **prev;
+	struct seqev_data *e, *end;
+	unsigned delta;
+
+	/*
+	 * blank space at the end of the track is before the first
+	 * event of the buffer
+	 */
+	delta = t->eot.delta;
+	prev = t->eot.prev;
+	end = o->evs + o->nevs;
+	for (e = o->evs; e != end; e++) {
+		se = seqev_new();
+		se->delta = delta + e->delta;
+		se->ev = e->ev;
+		se->prev = prev;
+		*prev = se;
+		prev = &se->next;
+		delta = 0;
+	}
+	*prev = &t->eot;
+	t->eot.prev = prev;
+	t->eot.delta = delta + o->delta;
+	o->nevs = 0;
+	o->delta = 0;
+	track_uncache(t);
 }
 
 /*
@@ -274,6 +419,7 @@ track_setchan(struct track *src, unsigned dev, unsigned ch)
 {
 	struct seqev *i;
 
+	track_uncache(src);
 	for (i = src->first; i != NULL; i = i->next) {
 		if (EV_ISVOICE(&i->ev)) {
 			i->ev.dev = dev;
@@ -291,6 +437,7 @@ track_chanmap(struct track *o, char *map)
 	struct seqev *se;
 	unsigned dev, ch, i;
 
+	track_uncache(o);
 	for (i = 0; i < DEFAULT_MAXNCHANS; i++) {
 		map[i] = 0;
 	}
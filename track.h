@@ -25,9 +25,20 @@ struct seqev {
 	struct seqev *next, **prev;
 };
 
+/*
+ * serialized copy of the events of a track, made when the song is
+ * saved and reused by next saves, until the track is modified
+ */
+struct track_blk {
+	unsigned char *data;		/* NULL if not made yet */
+	unsigned len;
+	unsigned tag;			/* what else the contents depend on */
+};
+
 struct track {
 	struct seqev eot;		/* end-of-track event */
 	struct seqev *first;		/* head of the event list */
+	struct track_blk txt, bin;	/* text and binary copies */
 };
 
 struct track_data {
@@ -38,6 +49,16 @@ struct track_data {
 	unsigned int pos, nrm, nins;
 };
 
+/*
+ * events appended in time order, before being added to a track
+ */
+struct trackbuf {
+	struct seqev_data *evs;		/* events, in time order */
+	unsigned nevs, maxevs;		/* used and allocated events */
+	unsigned delta;			/* tics after the last event */
+	unsigned tic;			/* tics since the beginning */
+};
+
 void	      seqev_pool_init(unsigned);
 void	      seqev_pool_done(void);
 struct seqev *seqev_new(void);
@@ -54,6 +75,9 @@ unsigned      track_isempty(struct track *);
 void	      track_chomp(struct track *);
 void	      track_shift(struct track *, unsigned);
 void	      track_swap(struct track *, struct track *);
+void	      track_uncache(struct track *);
+void	      track_blkset(struct track_blk *, unsigned char *, unsigned,
+		  unsigned);
 
 unsigned      seqev_avail(struct seqev *);
 void	      seqev_ins(struct seqev *, struct seqev *);
@@ -63,6 +87,13 @@ void	      track_setchan(struct track *, unsigned, unsigned);
 void	      track_chanmap(struct track *, char *);
 unsigned      track_evcnt(struct track *, unsigned);
 
+void	      trackbuf_init(struct trackbuf *);
+void	      trackbuf_done(struct trackbuf *);
+void	      trackbuf_wait(struct trackbuf *, unsigned);
+void	      trackbuf_moveto(struct trackbuf *, unsigned);
+void	      trackbuf_put(struct trackbuf *, struct ev *);
+void	      track_build(struct track *, struct trackbuf *);
+
 unsigned track_undosave(struct track *, struct track_data *);
 unsigned track_undodiff(struct track *, struct track_data *);
 void track_undorestore(struct track *, struct track_data *);
@@ -14,6 +14,7 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <stddef.h>
 #include "utils.h"
 #include "mididev.h"
 #include "mux.h"
@@ -27,6 +28,7 @@
 #include "mixout.h"
 #include "norm.h"
 #include "undo.h"
+#include "journal.h"
 
 
 struct undo *
@@ -48,6 +50,7 @@ undo_pop(struct song *s)
 	struct songtrk *t;
 	struct undo_fdel_trk *p;
 	struct sysex *x;
+	struct songsx *l;
 	struct undo *u;
 	int done = 0;
 
@@ -71,24 +74,33 @@ undo_pop(struct song *s)
 		case UNDO_EMPTY:
 			break;
 		case UNDO_STR:
+			journal_ren(s, u->u.ren.ptr,
+			    *u->u.ren.ptr, u->u.ren.val);
 			str_delete(*u->u.ren.ptr);
 			*u->u.ren.ptr = u->u.ren.val;
 			break;
 		case UNDO_UINT:
 			*u->u.uint.ptr = u->u.uint.val;
+			journal_uint(s, u->u.uint.ptr);
 			break;
 		case UNDO_TRACK:
+			journal_track(s, u->u.track.track,
+			    u->u.track.data.pos, u->u.track.data.nins,
+			    u->u.track.data.nrm, u->u.track.data.evs);
 			track_undorestore(u->u.track.track, &u->u.track.data);
 			break;
 		case UNDO_TDEL:
 			name_add(&s->trklist, &u->u.tdel.trk->name);
 			if (s->curtrk == NULL)
 				s->curtrk = u->u.tdel.trk;
+			journal_tnew(s, u->u.tdel.trk);
 			break;
 		case UNDO_TNEW:
+			journal_tdel(s, u->u.tdel.trk);
 			song_trkdel(s, u->u.tdel.trk);
 			break;
 		case UNDO_FILT:
+			journal_filt(s, u->u.filt.filt);
 			filt_reset(u->u.filt.filt);
 			*u->u.filt.filt = u->u.filt.data;
 			break;
@@ -101,8 +113,10 @@ undo_pop(struct song *s)
 				u->u.fdel.trks = p->next;
 				xfree(p);
 			}
+			journal_fnew(s, u->u.fdel.filt);
 			break;
 		case UNDO_FNEW:
+			journal_fdel(s, u->u.fdel.filt);
 			song_filtdel(s, u->u.fdel.filt);
 			break;
 		case UNDO_CDEL:
@@ -114,16 +128,26 @@ undo_pop(struct song *s)
 				if (s->curout == NULL)
 					s->curout = u->u.cdel.chan;
 			}
+			journal_cadd(s, u->u.cdel.chan);
 			break;
 		case UNDO_CNEW:
+			journal_cdel(s, u->u.cdel.chan);
+			if (u->u.cdel.chan->filt)
+				journal_fdel(s, u->u.cdel.chan->filt);
 			song_chandel(s, u->u.cdel.chan);
 			break;
 		case UNDO_XADD:
+			l = (struct songsx *)((char *)u->u.sysex.list -
+			    offsetof(struct songsx, sx));
+			journal_sx(s, l);
 			x = sysexlist_rm(u->u.sysex.list,
 			    u->u.sysex.data.pos);
 			sysex_del(x);
 			break;
 		case UNDO_XRM:
+			l = (struct songsx *)((char *)u->u.sysex.list -
+			    offsetof(struct songsx, sx));
+			journal_sx(s, l);
 			x = sysex_undorestore(&u->u.sysex.data);
 			sysexlist_add(u->u.sysex.list,
 			    u->u.sysex.data.pos, x);
@@ -132,11 +156,16 @@ undo_pop(struct song *s)
 			name_add(&s->sxlist, &u->u.xdel.sx->name);
 			if (s->cursx == NULL)
 				s->cursx = u->u.xdel.sx;
+			journal_xnew(s, u->u.xdel.sx);
+			journal_sx(s, u->u.xdel.sx);
 			break;
 		case UNDO_XNEW:
+			journal_xdel(s, u->u.xdel.sx);
 			song_sxdel(s, u->u.xdel.sx);
 			break;
 		case UNDO_SCALE:
+			journal_scale(s,
+			    u->u.scale.newunit, u->u.scale.oldunit);
 			track_scale(&s->meta,
 			    u->u.scale.newunit, u->u.scale.oldunit);
 			SONG_FOREACH_TRK(s, t) {
@@ -286,6 +315,7 @@ undo_setstr(struct song *s, char *func, char **ptr, char *val)
 	u->u.ren.val = *ptr;
 	*ptr = str_new(val);
 	undo_push(s, u);
+	journal_ren(s, ptr, u->u.ren.val, val);
 }
 
 void
@@ -299,6 +329,7 @@ undo_setuint(struct song *s, char *func, char *tag,
 	u->u.uint.val = *ptr;
 	*ptr = val;
 	undo_push(s, u);
+	journal_uint(s, ptr);
 }
 
 void
@@ -318,6 +349,7 @@ undo_scale(struct song *s, char *func, char *tag,
 	}
 
 	undo_push(s, u);
+	journal_scale(s, oldunit, newunit);
 }
 
 unsigned
@@ -451,6 +483,7 @@ track_undorestore(struct track *t, struct track_data *u)
 		pos->prev = &se->next;
 	}
 	xfree(u->evs);
+	track_uncache(t);
 }
 
 void
@@ -477,6 +510,8 @@ undo_track_diff(struct song *s)
 	size = track_undodiff(u->u.track.track, &u->u.track.data);
 	s->undo_size += size - u->size;
 	u->size = size;
+	journal_track(s, u->u.track.track, u->u.track.data.pos,
+	    u->u.track.data.nrm, u->u.track.data.nins, NULL);
 }
 
 void
@@ -491,6 +526,7 @@ undo_tdel_do(struct song *s, struct songtrk *t, char *func)
 	undo_track_diff(s);
 	u = undo_new(s, UNDO_TDEL, NULL, NULL);
 	u->u.tdel.trk = t;
+	journal_tdel(s, t);
 	name_remove(&s->trklist, &t->name);
 	undo_push(s, u);
 }
@@ -505,6 +541,7 @@ undo_tnew_do(struct song *s, char *func, char *name)
 	u = undo_new(s, UNDO_TNEW, func, t->name.str);
 	u->u.tdel.trk = t;
 	undo_push(s, u);
+	journal_tnew(s, t);
 	return t;
 }
 
@@ -562,6 +599,7 @@ undo_filt_save(struct song *s, struct filt *f, char *func, char *name)
 	filt_undosave(f, &u->u.filt.data);
 	u->size += filt_size(&u->u.filt.data);
 	undo_push(s, u);
+	journal_filt(s, f);
 }
 
 void
@@ -574,6 +612,7 @@ undo_fdel_do(struct song *s, struct songfilt *f, char *func)
 	u = undo_new(s, UNDO_FDEL, func, f->name.str);
 	u->u.fdel.filt = f;
 	u->u.fdel.trks = NULL;
+	journal_fdel(s, f);
 
 	SONG_FOREACH_TRK(s, t) {
 		if (t->curfilt != f)
@@ -605,6 +644,7 @@ undo_fnew_do(struct song *s, char *func, char *name)
 	u->u.fdel.filt = t;
 	u->u.fdel.trks = NULL;
 	undo_push(s, u);
+	journal_fnew(s, t);
 	return t;
 }
 
@@ -619,6 +659,7 @@ undo_cnew_do(struct song *s, unsigned int dev, unsigned int ch, int input,
 	u = undo_new(s, UNDO_CNEW, func, c->name.str);
 	u->u.cdel.chan = c;
 	undo_push(s, u);
+	journal_cnew(s, c);
 	return c;
 }
 
@@ -641,6 +682,7 @@ undo_cdel_do(struct song *s, struct songchan *c, char *func)
 
 	u = undo_new(s, UNDO_CDEL, NULL, NULL);
 	u->u.cdel.chan = c;
+	journal_cdel(s, c);
 	name_remove(&s->chanlist, &c->name);
 	undo_push(s, u);
 	if (c->filt)
@@ -704,6 +746,7 @@ undo_xadd_do(struct song *s, char *func, struct songsx *sx, struct sysex *x)
 	undo_push(s, u);
 
 	sysexlist_put(&sx->sx, x);
+	journal_sx(s, sx);
 }
 
 void
@@ -721,6 +764,7 @@ undo_xrm_do(struct song *s, char *func, struct songsx *sx, unsigned int pos)
 	undo_push(s, u);
 
 	sysex_del(x);
+	journal_sx(s, sx);
 }
 
 void
@@ -735,6 +779,7 @@ undo_xdel_do(struct song *s, char *func, struct songsx *sx)
 	undo_push(s, u);
 	while (sx->sx.first)
 		undo_xrm_do(s, NULL, sx, 0);
+	journal_xdel(s, sx);
 	name_remove(&s->sxlist, &sx->name);
 }
 
@@ -748,5 +793,6 @@ undo_xnew_do(struct song *s, char *func, char *name)
 	u = undo_new(s, UNDO_XNEW, func, sx->name.str);
 	u->u.xdel.sx = sx;
 	undo_push(s, u);
+	journal_xnew(s, sx);
 	return sx;
 }
@@ -40,6 +40,8 @@
 #include "builtin.h"
 #include "smf.h"
 #include "saveload.h"
+#include "journal.h"
+#include "bgsave.h"
 
 struct song *usong;
 unsigned user_flag_batch = 0;
@@ -59,6 +61,7 @@ exec_cb(struct exec *e, struct node *root)
 		return;
 	}
 	e->result = node_exec(root, e, &data);
+	journal_commit(usong);
 	if (data != NULL) {
 		if (data->type != DATA_NIL) {
 			data_print(data);
@@ -80,7 +83,7 @@ exec_runfile(struct exec *exec, char *filename)
 	struct parse parse;
 	struct textin *in;
 	struct name **locals;
-	int c;
+	unsigned char *p, *end;
 
 	in = textin_new(filename);
 	if (in == NULL)
@@ -90,11 +93,11 @@ exec_runfile(struct exec *exec, char *filename)
 	parse_init(&parse, exec, exec_cb);
 	lex_init(&parse, filename, parse_cb, &parse);
 	for (;;) {
-		if (!textin_getchar(in, &c))
-			break;
-		lex_handle(&parse, c);
-		if (c < 0)
+		if (!textin_getbuf(in, &p, &end) || p == end) {
+			lex_handle(&parse, CHAR_EOF);
 			break;
+		}
+		lex_scan(&parse, p, end);
 	}
 	exec->locals = locals;
 	textin_delete(in);
@@ -956,6 +959,10 @@ user_mainloop(void)
 	exec_newbuiltin(exec, "debug", blt_debug,
 			name_newarg("flag",
 			name_newarg("value", NULL)));
+	exec_newbuiltin(exec, "trace", blt_trace,
+			name_newarg("value", NULL));
+	exec_newbuiltin(exec, "tracesave", blt_tracesave,
+			name_newarg("filename", NULL));
 	exec_newbuiltin(exec, "version", blt_version, NULL);
 	exec_newbuiltin(exec, "panic", blt_panic, NULL);
 	exec_newbuiltin(exec, "info", blt_info, NULL);
@@ -1003,13 +1010,38 @@ user_mainloop(void)
 	exec_newbuiltin(exec, "ls", blt_ls, NULL);
 	exec_newbuiltin(exec, "save", blt_save,
 			name_newarg("filename", NULL));
+	exec_newbuiltin(exec, "bgsave", blt_bgsave,
+			name_newarg("filename", NULL));
+	exec_newbuiltin(exec, "bsave", blt_bsave,
+			name_newarg("filename", NULL));
+	exec_newbuiltin(exec, "journal", blt_journal,
+			name_newarg("filename", NULL));
+	exec_newbuiltin(exec, "nojournal", blt_nojournal, NULL);
+	exec_newbuiltin(exec, "jreplay", blt_jreplay,
+			name_newarg("filename", NULL));
 	exec_newbuiltin(exec, "load", blt_load,
 			name_newarg("filename", NULL));
 	exec_newbuiltin(exec, "reset", blt_reset, NULL);
 	exec_newbuiltin(exec, "export", blt_export,
 			name_newarg("filename", NULL));
+	exec_newbuiltin(exec, "bgexport", blt_bgexport,
+			name_newarg("filename", NULL));
+	exec_newbuiltin(exec, "render", blt_render,
+			name_newarg("filename", NULL));
 	exec_newbuiltin(exec, "import", blt_import,
 			name_newarg("filename", NULL));
+	exec_newbuiltin(exec, "splay", blt_splay,
+			name_newarg("filename",
+			name_newarg("measure", NULL)));
+	exec_newbuiltin(exec, "smfconv", blt_smfconv,
+			name_newarg("files",
+			name_newarg("outdir",
+			name_newarg("proc",
+			name_newarg("jobs", NULL)))));
+	exec_newbuiltin(exec, "smfinfo", blt_smfinfo,
+			name_newarg("filename", NULL));
+	exec_newbuiltin(exec, "smfscan", blt_smfscan,
+			name_newarg("files", NULL));
 	exec_newbuiltin(exec, "i", blt_idle, NULL);
 	exec_newbuiltin(exec, "p", blt_play, NULL);
 	exec_newbuiltin(exec, "r", blt_rec, NULL);
@@ -1213,6 +1245,27 @@ user_mainloop(void)
 			name_newarg("tics_per_unit", NULL)));
 	exec_newbuiltin(exec, "dinfo", blt_dinfo,
 			name_newarg("devnum", NULL));
+	exec_newbuiltin(exec, "dstat", blt_dstat,
+			name_newarg("devnum", NULL));
+	exec_newbuiltin(exec, "dcapture", blt_dcapture,
+			name_newarg("devnum",
+			name_newarg("path", NULL)));
+	exec_newbuiltin(exec, "dlatency", blt_dlatency,
+			name_newarg("outdev",
+			name_newarg("indev",
+			name_newarg("count",
+			name_newarg("path", NULL)))));
+	exec_newbuiltin(exec, "dbitrate", blt_dbitrate,
+			name_newarg("devnum",
+			name_newarg("bitrate", NULL)));
+	exec_newbuiltin(exec, "dirate", blt_dirate,
+			name_newarg("devnum",
+			name_newarg("class",
+			name_newarg("rate", NULL))));
+	exec_newbuiltin(exec, "irate", blt_irate,
+			name_newarg("rate", NULL));
+	exec_newbuiltin(exec, "getirate", blt_getirate, NULL);
+	exec_newbuiltin(exec, "getithrot", blt_getithrot, NULL);
 	exec_newbuiltin(exec, "dixctl", blt_dixctl,
 			name_newarg("devnum",
 			name_newarg("ctlset", NULL)));
@@ -1251,6 +1304,8 @@ user_mainloop(void)
 	lex_done(&parse);
 	parse_done(&parse);
 	exec_delete(exec);
+	bgsave_wait();
+	journal_stop();
 	song_delete(usong);
 	usong = NULL;
 	mididev_listdone();